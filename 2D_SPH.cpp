@@ -2,6 +2,7 @@
 #include <ctime>
 
 #include "PARTICLE_2D.h"
+#include "SCHEDULER.h"
 
 using namespace std;
 
@@ -21,7 +22,10 @@ float mouseX = 0.0f;
 float mouseY = 0.0f;
 
 // simulation
-Parallel *sim;
+sph2d::Parallel *sim;
+
+// steps per rendered frame
+FrameScheduler scheduler;
 
 // animate the current runEverytime()?
 bool animate = true;
@@ -104,12 +108,77 @@ void glutKeyboard(unsigned char key, int x, int y)
   case 'r': 
     sim->resetParticles();
     break;
+  case 'i':
+    // report the current convergence mode, then cycle to the next one
+    sim->printConvergenceStats();
+    sim->convergenceMode = (sph2d::Parallel::CONVERGENCE)((sim->convergenceMode + 1) % 3);
+    sim->resetConvergenceStats();
+    break;
+  case 'z':
+    sim->doReorder = !sim->doReorder;
+    break;
   case 'w': {
     static int count = 0;
     char buffer[256];
     sprintf(buffer, "output_%i.ppm", count);
     count++;
   } break;
+  case '+':
+  case '=':
+    if (scheduler.mode == FrameScheduler::SUBSTEPS) scheduler.substeps++;
+    else scheduler.simRate *= 2.0f;
+    scheduler.printStats();
+    break;
+  case '-':
+    if (scheduler.mode == FrameScheduler::SUBSTEPS) scheduler.substeps = max(1, scheduler.substeps - 1);
+    else scheduler.simRate *= 0.5f;
+    scheduler.printStats();
+    break;
+  case 'm':
+    scheduler.mode = (scheduler.mode == FrameScheduler::SUBSTEPS) ? FrameScheduler::REALTIME : FrameScheduler::SUBSTEPS;
+    scheduler.printStats();
+    break;
+  case 't':
+    // sim-only turbo, draw one frame in ten
+    scheduler.renderEvery = (scheduler.renderEvery == 1) ? 10 : 1;
+    scheduler.printStats();
+    break;
+  case 'a':
+    sim->adaptiveDt = !sim->adaptiveDt;
+    cout << "adaptive dt " << (sim->adaptiveDt ? "on" : "off") << endl;
+    break;
+  case 'g':
+    // GPU stage timings, the table prints every 300 frames while on
+    sim->profiler.enabled = !sim->profiler.enabled;
+    if (sim->profiler.enabled) {
+      sim->profiler.printEvery = 300;
+      sim->profiler.reset();
+    } else {
+      sim->profiler.flush();
+      sim->profiler.print();
+      sim->profiler.writeCSV("profile.csv");
+    }
+    break;
+  case 'k':
+    if (sim->saveCheckpoint("checkpoint2d.bin"))
+      cout << "saved checkpoint2d.bin at t = " << sim->getSimTime() << endl;
+    break;
+  case 'j': {
+    clock_t start = clock();
+    if (sim->loadCheckpoint("checkpoint2d.bin"))
+      cout << "loaded checkpoint2d.bin in " << 1000.0 * (clock() - start) / CLOCKS_PER_SEC << " ms" << endl;
+    break;
+  }
+  case 'e':
+    // trajectory export, every 10th step
+    if (sim->trajectory.isOpen())
+      sim->stopTrajectory();
+    else if (sim->startTrajectory("trajectory2d.bin", 10))
+      cout << "exporting to trajectory2d.bin" << endl;
+    break;
+  case 'p':
+    scheduler.printStats();
+    break;
   case 'q':
     exit(0);
     break;
@@ -188,6 +257,16 @@ int main(int argc, char **argv)
 
 void runEverytime()       
 {          
+  // Update simulation, as many steps as the scheduler wants this frame
+  double simStart = sim->getSimTime();
+  int steps = animate ? scheduler.beginFrame(sim->getDt()) : 0;
+  for (int i = 0; i < steps; i++)
+    sim->compute();
+
+  bool draw = !animate || scheduler.shouldRender();
+  if (animate) scheduler.endFrame(sim->getSimTime() - simStart);
+  if (!draw) return;
+
   glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   
@@ -203,9 +282,6 @@ void runEverytime()
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  // Update simulation
-  if (animate) sim->compute();
-  
   sim->render();
 
   // swap buffers
@@ -225,11 +301,17 @@ void runOnce()
   // numParticles = 4032;
   // numParticles = 1024;
 
-  sim = new Parallel(numParticles);
+  sim = new sph2d::Parallel(numParticles);
 
   // initialize the simulation
   sim->initParticlesAndProgram();
   sim->initObject();
   sim->initRenderer("render2d/fluid_vert.glsl", "render2d/fluid_frag.glsl");
+
+  // the compiles overlapped the setup above, wait for the rest here so the
+  // report covers every program. Cold start compiles, warm start loads
+  // shadercache/
+  finishShaders();
+  printShaderStats();
 }
   
@@ -2,6 +2,7 @@
 #include <ctime>
 
 #include "PARTICLE_3D.h"
+#include "SCHEDULER.h"
 
 using namespace std;
 
@@ -16,7 +17,11 @@ int xScreenRes = 1440;
 int yScreenRes = 900;
 
 // simulation 
-Parallel *sim;
+sph3d::Parallel *sim;
+const char *obstaclePath = NULL;  // optional OBJ/STL obstacle, argv[1]
+
+// steps per rendered frame
+FrameScheduler scheduler;
 
 // animate the current runEverytime()?
 bool animate = true;
@@ -67,13 +72,81 @@ void glutKeyboard(unsigned char key, int x, int y)
   case 'r': 
     sim->resetParticles();
     break;
+  case 'i':
+    // report the current convergence mode, then cycle to the next one
+    sim->printConvergenceStats();
+    sim->convergenceMode = (sph3d::Parallel::CONVERGENCE)((sim->convergenceMode + 1) % 3);
+    sim->resetConvergenceStats();
+    break;
+  case 'f':
+    sim->fusePressureViscosity = !sim->fusePressureViscosity;
+    cout << "fused pressure/viscosity " << (sim->fusePressureViscosity ? "on" : "off") << endl;
+    break;
+  case 's':
+    sim->impostorSpheres = !sim->impostorSpheres;
+    cout << (sim->impostorSpheres ? "sphere impostors" : "sphere meshes") << endl;
+    break;
   case 'l': 
-    if (sim->doObstacle) sim->doObstacle = false;
-    else if (!sim->doObstacle) {
-      sim->setObject(glm::vec3(-1.0f, 1.0f, 0.0f));
-      sim->doObstacle = true;
+    // the box path starts over from the top left each time it comes back
+    sim->doObstacle = !sim->doObstacle;
+    if (sim->doObstacle) sim->restartObstacles();
+    break;
+  case '+':
+  case '=':
+    if (scheduler.mode == FrameScheduler::SUBSTEPS) scheduler.substeps++;
+    else scheduler.simRate *= 2.0f;
+    scheduler.printStats();
+    break;
+  case '-':
+    if (scheduler.mode == FrameScheduler::SUBSTEPS) scheduler.substeps = max(1, scheduler.substeps - 1);
+    else scheduler.simRate *= 0.5f;
+    scheduler.printStats();
+    break;
+  case 'm':
+    scheduler.mode = (scheduler.mode == FrameScheduler::SUBSTEPS) ? FrameScheduler::REALTIME : FrameScheduler::SUBSTEPS;
+    scheduler.printStats();
+    break;
+  case 't':
+    // sim-only turbo, draw one frame in ten
+    scheduler.renderEvery = (scheduler.renderEvery == 1) ? 10 : 1;
+    scheduler.printStats();
+    break;
+  case 'a':
+    sim->adaptiveDt = !sim->adaptiveDt;
+    cout << "adaptive dt " << (sim->adaptiveDt ? "on" : "off") << endl;
+    break;
+  case 'g':
+    // GPU stage timings, the table prints every 300 frames while on
+    sim->profiler.enabled = !sim->profiler.enabled;
+    if (sim->profiler.enabled) {
+      sim->profiler.printEvery = 300;
+      sim->profiler.reset();
+    } else {
+      sim->profiler.flush();
+      sim->profiler.print();
+      sim->profiler.writeCSV("profile.csv");
     }
     break;
+  case 'k':
+    if (sim->saveCheckpoint("checkpoint3d.bin"))
+      cout << "saved checkpoint3d.bin at t = " << sim->getSimTime() << endl;
+    break;
+  case 'j': {
+    clock_t start = clock();
+    if (sim->loadCheckpoint("checkpoint3d.bin"))
+      cout << "loaded checkpoint3d.bin in " << 1000.0 * (clock() - start) / CLOCKS_PER_SEC << " ms" << endl;
+    break;
+  }
+  case 'e':
+    // trajectory export, every 10th step
+    if (sim->trajectory.isOpen())
+      sim->stopTrajectory();
+    else if (sim->startTrajectory("trajectory3d.bin", 10))
+      cout << "exporting to trajectory3d.bin" << endl;
+    break;
+  case 'p':
+    scheduler.printStats();
+    break;
   case 'q':
     exit(0);
     break;
@@ -143,6 +216,7 @@ int main(int argc, char **argv)
 {
   // initialize GLUT and GL
   glutInit(&argc, argv); 
+  if (argc > 1) obstaclePath = argv[1];
 
   // open the GL window
   glvuWindow();
@@ -151,6 +225,16 @@ int main(int argc, char **argv)
 
 void runEverytime()       
 {          
+  // Update simulation, as many steps as the scheduler wants this frame
+  double simStart = sim->getSimTime();
+  int steps = animate ? scheduler.beginFrame(sim->getDt()) : 0;
+  for (int i = 0; i < steps; i++)
+    sim->compute();
+
+  bool draw = !animate || scheduler.shouldRender();
+  if (animate) scheduler.endFrame(sim->getSimTime() - simStart);
+  if (!draw) return;
+
   glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   
@@ -166,11 +250,6 @@ void runEverytime()
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  if (animate) {
-    if (sim->doObstacle) sim->loopObject();
-    sim->compute();
-  }
-
   // Always render particles and objects
   sim->render();
   
@@ -188,7 +267,7 @@ void runOnce()
 
   int numParticles = 48841;
 
-  sim = new Parallel(numParticles);
+  sim = new sph3d::Parallel(numParticles);
 
   // initialize the simulation
   sim->initSimBounds();
@@ -196,5 +275,12 @@ void runOnce()
   sim->initParticleAndPrograms();
   sim->initRenderer("render3d/bound_vert.glsl" , "render3d/bound_frag.glsl",
                     "render3d/sphere_vert.glsl" , "render3d/sphere_frag.glsl");
+  if (obstaclePath) sim->loadObstacleMesh(obstaclePath);
+
+  // the compiles overlapped the setup above, wait for the rest here so the
+  // report covers every program. Cold start compiles, warm start loads
+  // shadercache/
+  finishShaders();
+  printShaderStats();
 }
   
\ No newline at end of file
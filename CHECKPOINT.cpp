@@ -0,0 +1,200 @@
+#include "CHECKPOINT.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const uint64_t PAGE = 4096;
+
+static uint64_t alignPage(uint64_t offset)
+{
+	return (offset + PAGE - 1) / PAGE * PAGE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// writer
+///////////////////////////////////////////////////////////////////////
+
+CheckpointWriter::CheckpointWriter(int dim, int numParticles)
+{
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.dim = dim;
+	header.numParticles = numParticles;
+	header.numSections = 0;
+}
+
+void CheckpointWriter::addBuffer(const char *name, GLuint buffer, GLsizeiptr bytes)
+{
+	Entry entry = { name, buffer, nullptr, (size_t)bytes };
+	entries.push_back(entry);
+}
+
+void CheckpointWriter::addData(const char *name, const void *data, size_t bytes)
+{
+	Entry entry = { name, 0, data, bytes };
+	entries.push_back(entry);
+}
+
+bool CheckpointWriter::save(const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		cout << "could not open " << path << " for writing" << endl;
+		return false;
+	}
+
+	// lay out the sections after the header and table
+	header.numSections = entries.size();
+	vector<CheckpointSection> table(entries.size());
+	uint64_t offset = alignPage(sizeof(CheckpointHeader) + sizeof(CheckpointSection) * entries.size());
+	for (size_t i = 0; i < entries.size(); i++) {
+		memset(table[i].name, 0, sizeof(table[i].name));
+		strncpy(table[i].name, entries[i].name.c_str(), sizeof(table[i].name) - 1);
+		table[i].offset = offset;
+		table[i].bytes = entries[i].bytes;
+		offset = alignPage(offset + entries[i].bytes);
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(table.data(), sizeof(CheckpointSection), table.size(), file) == table.size();
+
+	for (size_t i = 0; ok && i < entries.size(); i++) {
+		ok = fseek(file, table[i].offset, SEEK_SET) == 0;
+		if (!ok || entries[i].bytes == 0) continue;
+
+		if (entries[i].data) {
+			ok = fwrite(entries[i].data, entries[i].bytes, 1, file) == 1;
+			continue;
+		}
+
+		// write straight out of the mapped GL buffer
+		glBindBuffer(GL_COPY_READ_BUFFER, entries[i].buffer);
+		const void *data = glMapBufferRange(GL_COPY_READ_BUFFER, 0, entries[i].bytes, GL_MAP_READ_BIT);
+		ok = data && fwrite(data, entries[i].bytes, 1, file) == 1;
+		if (data) glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+
+	ok = (fclose(file) == 0) && ok;
+	if (!ok) cout << "failed writing checkpoint " << path << endl;
+	return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// reader
+///////////////////////////////////////////////////////////////////////
+
+CheckpointReader::~CheckpointReader()
+{
+	if (mapped) munmap((void *)mapped, mappedBytes);
+}
+
+static bool validHeader(const CheckpointHeader &header, const char *path)
+{
+	if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+		cout << path << " is not a checkpoint" << endl;
+		return false;
+	}
+	if (header.version != CHECKPOINT_VERSION) {
+		cout << path << " is checkpoint version " << header.version
+			 << ", this build reads version " << CHECKPOINT_VERSION << endl;
+		return false;
+	}
+	return true;
+}
+
+bool CheckpointReader::peek(const char *path, int &dim, int &numParticles)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		cout << "could not open " << path << endl;
+		return false;
+	}
+
+	CheckpointHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1;
+	fclose(file);
+
+	if (!ok || !validHeader(header, path)) return false;
+	dim = header.dim;
+	numParticles = header.numParticles;
+	return true;
+}
+
+bool CheckpointReader::open(const char *path)
+{
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		cout << "could not open " << path << endl;
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CheckpointHeader)) {
+		cout << path << " is not a checkpoint" << endl;
+		close(fd);
+		return false;
+	}
+
+	mappedBytes = info.st_size;
+	void *data = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		cout << "could not map " << path << endl;
+		mappedBytes = 0;
+		return false;
+	}
+	mapped = (const char *)data;
+	madvise(data, mappedBytes, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+	memcpy(&header, mapped, sizeof(header));
+	if (!validHeader(header, path)) return false;
+
+	table = (const CheckpointSection *)(mapped + sizeof(CheckpointHeader));
+	if (sizeof(CheckpointHeader) + sizeof(CheckpointSection) * header.numSections > mappedBytes) {
+		cout << path << " is truncated" << endl;
+		return false;
+	}
+	for (uint32_t i = 0; i < header.numSections; i++) {
+		if (table[i].bytes > 0 && table[i].offset + table[i].bytes > mappedBytes) {
+			cout << path << " is truncated" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+const void *CheckpointReader::section(const char *name, size_t &bytes) const
+{
+	for (uint32_t i = 0; table && i < header.numSections; i++) {
+		if (strncmp(table[i].name, name, sizeof(table[i].name)) == 0) {
+			bytes = table[i].bytes;
+			return mapped + table[i].offset;
+		}
+	}
+	bytes = 0;
+	return nullptr;
+}
+
+bool CheckpointReader::upload(const char *name, GLuint buffer, GLsizeiptr bytes) const
+{
+	size_t stored;
+	const void *data = section(name, stored);
+	if (!data || stored != (size_t)bytes) {
+		cout << "checkpoint section " << name << " is missing or the wrong size" << endl;
+		return false;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, bytes, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return true;
+}
@@ -0,0 +1,88 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// Versioned binary checkpoints. A file is a header, a table of named
+// sections, then each section's bytes at a page-aligned offset. Loading maps
+// the file and hands each section's pages straight to glBufferSubData, so a
+// restore is one copy per buffer with no intermediate read. Byte order is
+// the writer's native order.
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "SHADER.h"
+
+static const char CHECKPOINT_MAGIC[8] = { 'S', 'P', 'H', 'C', 'K', 'P', 'T', 0 };
+static const uint32_t CHECKPOINT_VERSION = 2;
+
+struct CheckpointHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t dim;
+	uint32_t numParticles;
+	uint32_t numSections;
+};
+
+struct CheckpointSection {
+	char name[24];
+	uint64_t offset;
+	uint64_t bytes;
+};
+
+class CheckpointWriter {
+public:
+	CheckpointWriter(int dim, int numParticles);
+
+	// sections are only recorded here, everything is written by save()
+	void addBuffer(const char *name, GLuint buffer, GLsizeiptr bytes);
+	void addData(const char *name, const void *data, size_t bytes);
+
+	bool save(const char *path);
+
+private:
+	struct Entry { std::string name; GLuint buffer; const void *data; size_t bytes; };
+
+	CheckpointHeader header;
+	std::vector<Entry> entries;
+};
+
+class CheckpointReader {
+public:
+	CheckpointReader() {};
+	~CheckpointReader();
+
+	// maps the file and checks its magic and version
+	bool open(const char *path);
+
+	// reads only the header, to size a simulation before it is created
+	static bool peek(const char *path, int &dim, int &numParticles);
+
+	int dim() const { return header.dim; }
+	int numParticles() const { return header.numParticles; }
+
+	// pointer into the mapping, nullptr if the section is missing
+	const void *section(const char *name, size_t &bytes) const;
+
+	// copies a section into a GL buffer, false if missing or the wrong size
+	bool upload(const char *name, GLuint buffer, GLsizeiptr bytes) const;
+
+	// fixed-size POD section
+	template <class T>
+	bool read(const char *name, T &out) const
+	{
+		size_t bytes;
+		const void *data = section(name, bytes);
+		if (!data || bytes != sizeof(T)) return false;
+		out = *(const T *)data;
+		return true;
+	}
+
+private:
+	CheckpointHeader header;
+	const CheckpointSection *table = nullptr;
+	const char *mapped = nullptr;
+	size_t mappedBytes = 0;
+};
+
+#endif
@@ -0,0 +1,682 @@
+#include "CPU_SPH.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace cpusph {
+
+///////////////////////////////////////////////////////////////////////
+// defaults and initial particles, as in PARTICLE_2D.cpp / PARTICLE_3D.cpp
+///////////////////////////////////////////////////////////////////////
+
+template <>
+void Solver<2>::setDefaults()
+{
+	boundsMin = glm::vec2(0.0f, 0.0f);
+	boundsMax = glm::vec2(1024.0f, 768.0f);
+	maxIterations = 8;
+	fixedDt = 1.0f / 60.0f;
+	gravity = 120.0f;
+	restDensity = 0.02f;
+	smoothingRadius = 40.0f;
+	stiffness = 0.003f;
+	eta = 0.01f;
+	viscosityStrength = 0.9f;
+	cflNumber = 0.4f;
+	dtMin = 1.0f / 240.0f;
+	dtMax = 1.0f / 15.0f;
+}
+
+template <>
+void Solver<3>::setDefaults()
+{
+	boundsMin = glm::vec3(-2.0f, -1.0f, -1.0f);
+	boundsMax = glm::vec3(2.0f, 2.0f, 1.0f);
+	maxIterations = 1;
+	fixedDt = 0.002f;
+	gravity = 60.0f;
+	restDensity = 9900.0f;
+	smoothingRadius = 0.12f;
+	stiffness = 0.0055f;
+	eta = 0.01f;
+	viscosityStrength = 0.00009f;
+	cflNumber = 0.4f;
+	dtMin = 0.0005f;
+	dtMax = 0.008f;
+}
+
+template <>
+void Solver<2>::init()
+{
+	// grid of initial positions centered in the 1028x768 window
+	int width = (int)sqrt(numParticles);
+	int height = (numParticles + width - 1) / width;
+	float spacing = 5.0f;
+	float offsetX = (1028.0f - width * spacing) / 2.0f;
+	float offsetY = (768.0f - height * spacing) / 2.0f;
+
+	pool.parallelFor(numParticles, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			pos.set(i, glm::vec2((i % width) * spacing + offsetX, (i / width) * spacing + offsetY));
+	});
+	buildNeighborGrid();
+}
+
+template <>
+void Solver<3>::init()
+{
+	// grid cube of initial positions, shifted right of center
+	int width = (int)round(pow(numParticles, 1.0 / 3.0));
+	int height = width;
+	int depth = (numParticles - 1) / (width * height) + 1;
+	float spacing = 0.05f;
+	glm::vec3 offset = glm::vec3(-width, -height, -depth) * (spacing / 2.0f) + glm::vec3(0.5f, 0.0f, 0.0f);
+
+	pool.parallelFor(numParticles, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			glm::vec3 cell((float)(i % width), (float)((i / width) % height), (float)(i / (width * height)));
+			pos.set(i, (cell + glm::vec3(0.5f)) * spacing + offset);
+		}
+	});
+	buildNeighborGrid();
+}
+
+///////////////////////////////////////////////////////////////////////
+// setup
+///////////////////////////////////////////////////////////////////////
+
+template <int DIM>
+Solver<DIM>::Solver(int numParticles, int threads, simd::ISA maxISA)
+	: numParticles(numParticles), pool(threads), kernels(kernelsFor(DIM, maxISA))
+{
+	setDefaults();
+	dt = fixedDt;
+
+	pos.resize(numParticles);
+	vel.resize(numParticles);
+	predicted.resize(numParticles);
+	nextPos.resize(numParticles);
+	nextVel.resize(numParticles);
+	simd::resizePadded(density, numParticles);
+	simd::resizePadded(pressure, numParticles);
+	simd::resizePadded(nextPressure, numParticles);
+	particleCell.resize(numParticles);
+	nextId.resize(numParticles);
+	id.resize(numParticles);
+	for (int i = 0; i < numParticles; i++) id[i] = i;
+}
+
+template <int DIM>
+bool Solver<DIM>::setParameter(const string &name, float value)
+{
+	if (name == "dt") fixedDt = dt = value;
+	else if (name == "gravity") gravity = value;
+	else if (name == "restDensity") restDensity = value;
+	else if (name == "smoothingRadius") smoothingRadius = value;
+	else if (name == "stiffness") stiffness = value;
+	else if (name == "eta") eta = value;
+	else if (name == "viscosityStrength") viscosityStrength = value;
+	else if (name == "maxIterations") maxIterations = (int)value;
+	else if (name == "cflNumber") cflNumber = value;
+	else if (name == "dtMin") dtMin = value;
+	else if (name == "dtMax") dtMax = value;
+	else if (name == "neighborSkin") neighborSkin = value;
+	else return false;
+	return true;
+}
+
+template <int DIM>
+void Solver<DIM>::readbackPositions(vector<vec> &out) const
+{
+	out.resize(numParticles);
+	for (int slot = 0; slot < numParticles; slot++)
+		out[id[slot]] = pos.get(slot);
+}
+
+template <int DIM>
+void Solver<DIM>::readbackVelocities(vector<vec> &out) const
+{
+	out.resize(numParticles);
+	for (int slot = 0; slot < numParticles; slot++)
+		out[id[slot]] = vel.get(slot);
+}
+
+template <int DIM>
+bool Solver<DIM>::writeParticles(const vector<vec> &positions, const vector<vec> &velocities)
+{
+	if ((int)positions.size() != numParticles || (int)velocities.size() != numParticles) return false;
+
+	for (int i = 0; i < numParticles; i++) {
+		pos.set(i, positions[i]);
+		vel.set(i, velocities[i]);
+		id[i] = i;
+	}
+	buildNeighborGrid();
+	return true;
+}
+
+template <int DIM>
+template <class F>
+void Solver<DIM>::forParticles(F fn)
+{
+	int parts = particleParts();
+	int chunk = (numParticles + parts - 1) / parts;
+	pool.run(parts, [&](int part) {
+		int begin = part * chunk;
+		if (begin < numParticles) fn(begin, min(begin + chunk, numParticles), part);
+	});
+}
+
+///////////////////////////////////////////////////////////////////////
+// neighbor grid
+///////////////////////////////////////////////////////////////////////
+
+template <int DIM>
+int Solver<DIM>::cellIndex(const vec &p, int cell[3]) const
+{
+	// particles that escape the bounds are clamped into the edge cells
+	cell[2] = 0;
+	for (int d = 0; d < DIM; d++) {
+		int c = (int)floor((p[d] - boundsMin[d]) / cellSize);
+		cell[d] = min(max(c, 0), gridDims[d] - 1);
+	}
+	return (cell[2] * gridDims[1] + cell[1]) * gridDims[0] + cell[0];
+}
+
+template <int DIM>
+void Solver<DIM>::neighborRows(const vec &p, NeighborRows &rows) const
+{
+	int c[3];
+	cellIndex(p, c);
+	int x0 = max(c[0] - 1, 0), x1 = min(c[0] + 1, gridDims[0] - 1);
+	int z0 = DIM == 3 ? max(c[2] - 1, 0) : 0, z1 = DIM == 3 ? min(c[2] + 1, gridDims[2] - 1) : 0;
+	int y0 = max(c[1] - 1, 0), y1 = min(c[1] + 1, gridDims[1] - 1);
+
+	// cells along x are adjacent in cell order, so each row is one range
+	rows.count = 0;
+	for (int z = z0; z <= z1; z++)
+	for (int y = y0; y <= y1; y++) {
+		int row = (z * gridDims[1] + y) * gridDims[0];
+		rows.begin[rows.count] = cellStart[row + x0];
+		rows.end[rows.count] = cellStart[row + x1 + 1];
+		rows.count++;
+	}
+}
+
+template <int DIM>
+KernelInputs Solver<DIM>::kernelInputs(const VectorArrays<DIM> &positions) const
+{
+	KernelInputs in;
+	in.x = positions.component(0);
+	in.y = positions.component(1);
+	in.z = positions.component(2);
+	in.vx = vel.component(0);
+	in.vy = vel.component(1);
+	in.vz = vel.component(2);
+	in.pressure = pressure.data();
+	in.neighbors = neighborLists ? listNeighbors.data() : nullptr;
+	in.h = smoothingRadius;
+	in.densityCoeff = coeffs.x;
+	in.gradCoeff = coeffs.y;
+	in.viscosityCoeff = coeffs.z;
+	in.pressureScale = -stiffness / (restDensity * restDensity);
+	return in;
+}
+
+template <int DIM>
+void Solver<DIM>::fitNeighborGrid(float pad)
+{
+	// cells one smoothing radius wide cover a particle's support from the
+	// cells around it, or its list radius with neighbor lists
+	cellSize = (neighborLists ? smoothingRadius * (1.0f + neighborSkin) : smoothingRadius) + pad;
+	gridDims[2] = 1;
+	numCells = 1;
+	for (int d = 0; d < DIM; d++) {
+		gridDims[d] = max(1, (int)ceil((boundsMax[d] - boundsMin[d]) / cellSize));
+		numCells *= gridDims[d];
+	}
+}
+
+template <int DIM>
+void Solver<DIM>::buildNeighborGrid()
+{
+	// allocated for unpadded cells, padded ones never need more
+	if (cellStart.empty()) {
+		fitNeighborGrid(0.0f);
+		cellStart.resize(numCells + 1);
+		threadCounts.resize((size_t)pool.size() * numCells);
+	}
+
+	// lists are built right after binning, but without them the grid is
+	// searched by every iteration. The first looks around positions
+	// predicted dt * v ahead of the binned ones, each later one after the
+	// particles moved by another dt * v. Cells are padded by that reach, with
+	// headroom for the velocities the iterations change. Past gridPad the
+	// grid is rebinned every gridIterations iterations instead, and past one
+	// radius the run is unstable anyway.
+	float reach = 0.0f;
+	gridIterations = maxIterations;
+	if (!neighborLists) {
+		float move = dt * maxSpeed(), pad = gridPad * smoothingRadius;
+		if (move * (1.0f + 1.5f * (maxIterations - 1)) > pad)
+			gridIterations = max(1, 1 + (int)((pad - move) / (1.5f * move)));
+		reach = move * (1.0f + 1.5f * (gridIterations - 1));
+	}
+	fitNeighborGrid(min(reach, smoothingRadius));
+
+	// counting sort: per-thread histograms over each thread's slots...
+	int parts = particleParts();
+	forParticles([&](int begin, int end, int part) {
+		int *counts = &threadCounts[(size_t)part * numCells];
+		fill(counts, counts + numCells, 0);
+		int c[3];
+		for (int i = begin; i < end; i++) {
+			particleCell[i] = cellIndex(pos.get(i), c);
+			counts[particleCell[i]]++;
+		}
+	});
+
+	// ...turned into each thread's first slot per cell, cells in order and
+	// threads in order within a cell, so the sort is stable
+	pool.parallelFor(numCells, [&](int begin, int end) {
+		for (int cell = begin; cell < end; cell++) {
+			int total = 0;
+			for (int part = 0; part < parts; part++) total += threadCounts[(size_t)part * numCells + cell];
+			cellStart[cell + 1] = total;
+		}
+	}, 4096);
+	cellStart[0] = 0;
+	for (int cell = 0; cell < numCells; cell++) cellStart[cell + 1] += cellStart[cell];
+
+	pool.parallelFor(numCells, [&](int begin, int end) {
+		for (int cell = begin; cell < end; cell++) {
+			int offset = cellStart[cell];
+			for (int part = 0; part < parts; part++) {
+				int &count = threadCounts[(size_t)part * numCells + cell];
+				int n = count;
+				count = offset;
+				offset += n;
+			}
+		}
+	}, 4096);
+
+	// ...and the particles scattered into cell order. Pressure goes along
+	// for lists rebuilt partway through the iterations.
+	forParticles([&](int begin, int end, int part) {
+		int *next = &threadCounts[(size_t)part * numCells];
+		for (int i = begin; i < end; i++) {
+			int slot = next[particleCell[i]]++;
+			nextPos.set(slot, pos.get(i));
+			nextVel.set(slot, vel.get(i));
+			nextPressure[slot] = pressure[i];
+			nextId[slot] = id[i];
+		}
+	});
+	pos.swap(nextPos);
+	vel.swap(nextVel);
+	pressure.swap(nextPressure);
+	id.swap(nextId);
+	listsValid = false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// neighbor lists
+///////////////////////////////////////////////////////////////////////
+
+template <int DIM>
+void Solver<DIM>::buildNeighborLists()
+{
+	if (listOrigin.c[0].empty()) {
+		listOrigin.resize(numParticles);
+		listStart.resize(numParticles + 1);
+		listSelf.resize(numParticles);
+		partNeighbors.resize(pool.size());
+	}
+	float radius = smoothingRadius * (1.0f + neighborSkin);
+
+	// each thread lists its slots into its own array, counts go in listStart
+	KernelInputs in = kernelInputs(pos);
+	forParticles([&](int begin, int end, int part) {
+		vector<int> &found = partNeighbors[part];
+		size_t used = 0;
+		NeighborRows rows;
+		for (int i = begin; i < end; i++) {
+			float xi[3] = {in.x[i], in.y[i], DIM == 3 ? in.z[i] : 0.0f};
+			listOrigin.set(i, pos.get(i));
+			neighborRows(pos.get(i), rows);
+
+			size_t candidates = simd::maxWidth;
+			for (int row = 0; row < rows.count; row++) candidates += rows.end[row] - rows.begin[row];
+			if (used + candidates > found.size()) found.resize(max(2 * found.size(), used + candidates));
+
+			int count = kernels.list(in, xi, rows, radius, &found[used]);
+			listSelf[i] = lower_bound(&found[used], &found[used] + count, i) - &found[used];
+			used += count;
+			listStart[i + 1] = count;
+		}
+	});
+
+	listStart[0] = 0;
+	for (int i = 0; i < numParticles; i++) listStart[i + 1] += listStart[i];
+
+	// zeroed spare entries, for the packets that read past the last list
+	listNeighbors.resize(listStart[numParticles] + simd::maxWidth);
+	fill(listNeighbors.end() - simd::maxWidth, listNeighbors.end(), 0);
+	forParticles([&](int begin, int end, int part) {
+		const int *found = partNeighbors[part].data();
+		copy(found, found + (listStart[end] - listStart[begin]), listNeighbors.begin() + listStart[begin]);
+		for (int i = begin; i < end; i++) listSelf[i] += listStart[i];
+	});
+
+	listsValid = true;
+	listBuilds++;
+}
+
+template <int DIM>
+bool Solver<DIM>::listsStale()
+{
+	if (!listsValid) return true;
+
+	// a pair can only come within h after both particles moved half the
+	// skin, checked for the positions and the predicted positions
+	float limit = 0.5f * neighborSkin * smoothingRadius;
+	vector<char> partStale(pool.size(), 0);
+	forParticles([&](int begin, int end, int part) {
+		float moved2 = 0.0f;
+		for (int i = begin; i < end; i++) {
+			vec origin = listOrigin.get(i), p = pos.get(i);
+			vec q = p + dt * vel.get(i);
+			moved2 = max(moved2, max(glm::dot(p - origin, p - origin), glm::dot(q - origin, q - origin)));
+		}
+		partStale[part] = moved2 > limit * limit;
+	});
+	return find(partStale.begin(), partStale.end(), 1) != partStale.end();
+}
+
+template <int DIM>
+void Solver<DIM>::neighborsOf(int i, const vec &p, NeighborRows &rows) const
+{
+	if (!neighborLists) {
+		neighborRows(p, rows);
+		return;
+	}
+	rows.begin[0] = listStart[i];
+	rows.end[0] = listStart[i + 1];
+	rows.count = 1;
+}
+
+///////////////////////////////////////////////////////////////////////
+// symmetric forces
+///////////////////////////////////////////////////////////////////////
+
+template <int DIM>
+void Solver<DIM>::sumPairForces(const KernelInputs &in, bool withPressure, bool withViscosity)
+{
+	if (pairPressure.empty()) {
+		pairPressure.resize(pool.size());
+		pairViscosity.resize(pool.size());
+		pairBegin.resize(pool.size());
+		pairEnd.resize(pool.size());
+	}
+	fill(pairEnd.begin(), pairEnd.end(), 0);
+
+	// each part sums into its own arrays, so the opposite terms it adds to
+	// other parts' slots never race. Lists are in slot order, so a part only
+	// reaches from its first slot to the largest last entry of its lists,
+	// a few cell layers past its end in the sorted grid.
+	forParticles([&](int begin, int end, int part) {
+		int reach = end;
+		for (int i = begin; i < end; i++) reach = max(reach, listNeighbors[listStart[i + 1] - 1] + 1);
+		int window = reach - begin;
+		if ((int)pairPressure[part].c[0].size() < window + simd::maxWidth) {
+			pairPressure[part].resize(window);
+			pairViscosity[part].resize(window);
+		}
+		pairBegin[part] = begin;
+		pairEnd[part] = reach;
+
+		// the kernels index by slot, so the pointers are offset to begin
+		ForceSums out;
+		for (int d = 0; d < 3; d++) {
+			out.pressure[d] = d < DIM ? pairPressure[part].c[d].data() - begin : nullptr;
+			out.viscosity[d] = d < DIM ? pairViscosity[part].c[d].data() - begin : nullptr;
+		}
+		for (int d = 0; d < DIM; d++) {
+			fill_n(pairPressure[part].c[d].begin(), window, 0.0f);
+			fill_n(pairViscosity[part].c[d].begin(), window, 0.0f);
+		}
+
+		NeighborRows rows;
+		rows.count = 1;
+		for (int i = begin; i < end; i++) {
+			rows.begin[0] = listSelf[i] + 1;
+			rows.end[0] = listStart[i + 1];
+			kernels.pairForces(in, i, rows, withPressure, withViscosity, out);
+		}
+	});
+}
+
+template <int DIM>
+void Solver<DIM>::forcesOn(const KernelInputs &in, int i, const vec &p, bool withPressure, bool withViscosity,
+						   float pressureForce[3], float viscosityForce[3]) const
+{
+	if (!symmetricForces) {
+		NeighborRows rows;
+		neighborsOf(i, p, rows);
+		auto forcesKernel = neighborLists ? kernels.listForces : kernels.forces;
+		forcesKernel(in, i, rows, withPressure, withViscosity, pressureForce, viscosityForce);
+		return;
+	}
+
+	// the sums for slot i of the parts that reach it, with the
+	// normalizations forcesLoop applies
+	int parts = particleParts();
+	float pressureCoeff = in.pressureScale * in.gradCoeff;
+	for (int d = 0; d < 3; d++) pressureForce[d] = viscosityForce[d] = 0.0f;
+	for (int d = 0; d < DIM; d++) {
+		float pressureSum = 0.0f, viscositySum = 0.0f;
+		for (int part = 0; part < parts; part++) {
+			if (i < pairBegin[part] || i >= pairEnd[part]) continue;
+			pressureSum += pairPressure[part].c[d][i - pairBegin[part]];
+			viscositySum += pairViscosity[part].c[d][i - pairBegin[part]];
+		}
+		pressureForce[d] = pressureCoeff * pressureSum;
+		viscosityForce[d] = in.viscosityCoeff * viscositySum;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// simulation
+///////////////////////////////////////////////////////////////////////
+
+template <int DIM>
+void Solver<DIM>::checkBoundary(vec &p, vec &v) const
+{
+	for (int d = 0; d < DIM; d++) {
+		if (p[d] < boundsMin[d]) {
+			p[d] = boundsMin[d];
+			v[d] = -v[d];
+		}
+		if (p[d] > boundsMax[d]) {
+			p[d] = boundsMax[d];
+			v[d] = -v[d];
+		}
+	}
+}
+
+template <int DIM>
+void Solver<DIM>::applyExternalForces()
+{
+	forParticles([&](int begin, int end, int) {
+		for (int i = begin; i < end; i++) {
+			vec v = vel.get(i);
+			v[1] -= gravity * dt;
+			vec p = pos.get(i) + v * dt;
+			if (Space<DIM>::boundExtForces) checkBoundary(p, v);
+			pos.set(i, p);
+			vel.set(i, v);
+
+			// the pressure iterations start from zero each step
+			pressure[i] = 0.0f;
+		}
+	});
+}
+
+template <int DIM>
+float Solver<DIM>::computeDensities()
+{
+	// positions predicted once per iteration, x + dt * v
+	forParticles([&](int begin, int end, int) {
+		for (int d = 0; d < DIM; d++) {
+			float *p = &predicted.c[d][0];
+			const float *x = pos.component(d), *v = vel.component(d);
+			for (int i = begin; i < end; i++) p[i] = x[i] + dt * v[i];
+		}
+	});
+
+	vector<float> partError(pool.size(), 0.0f);
+	KernelInputs in = kernelInputs(predicted);
+	auto densityKernel = neighborLists ? kernels.listDensity : kernels.density;
+	forParticles([&](int begin, int end, int part) {
+		NeighborRows rows;
+		float maxError = 0.0f;
+
+		for (int i = begin; i < end; i++) {
+			float xi[3] = {in.x[i], in.y[i], DIM == 3 ? in.z[i] : 0.0f};
+			neighborsOf(i, predicted.get(i), rows);
+			float predDensity = densityKernel(in, xi, rows);
+
+			density[i] = predDensity;
+			pressure[i] += delta * (predDensity - restDensity);
+			maxError = max(maxError, fabs(predDensity - restDensity));
+		}
+		partError[part] = maxError;
+	});
+	return *max_element(partError.begin(), partError.end());
+}
+
+template <int DIM>
+void Solver<DIM>::applyPressures(bool withViscosity)
+{
+	KernelInputs in = kernelInputs(pos);
+	if (symmetricForces) sumPairForces(in, true, withViscosity);
+	forParticles([&](int begin, int end, int) {
+		float pressureForce[3], viscosityForce[3];
+
+		for (int i = begin; i < end; i++) {
+			vec xi = pos.get(i);
+			forcesOn(in, i, xi, true, withViscosity, pressureForce, viscosityForce);
+
+			// pressure update moves the particle, viscosity only changes velocity
+			vec v = vel.get(i);
+			for (int d = 0; d < DIM; d++) v[d] += dt * pressureForce[d];
+			vec p = xi + v * dt;
+			checkBoundary(p, v);
+			nextPos.set(i, p);
+			if (withViscosity)
+				for (int d = 0; d < DIM; d++) v[d] += viscosityStrength * viscosityForce[d];
+			nextVel.set(i, v);
+		}
+	});
+	pos.swap(nextPos);
+	vel.swap(nextVel);
+}
+
+template <int DIM>
+void Solver<DIM>::applyViscosity()
+{
+	KernelInputs in = kernelInputs(pos);
+	if (symmetricForces) sumPairForces(in, false, true);
+	forParticles([&](int begin, int end, int) {
+		float pressureForce[3], viscosityForce[3];
+
+		for (int i = begin; i < end; i++) {
+			forcesOn(in, i, pos.get(i), false, true, pressureForce, viscosityForce);
+
+			vec v = vel.get(i);
+			for (int d = 0; d < DIM; d++) v[d] += viscosityStrength * viscosityForce[d];
+			nextVel.set(i, v);
+		}
+	});
+	vel.swap(nextVel);
+}
+
+template <int DIM>
+float Solver<DIM>::maxSpeed()
+{
+	vector<float> partSpeed(pool.size(), 0.0f);
+	forParticles([&](int begin, int end, int part) {
+		float speed = 0.0f;
+		for (int i = begin; i < end; i++) speed = max(speed, glm::length(vel.get(i)));
+		partSpeed[part] = speed;
+	});
+	return *max_element(partSpeed.begin(), partSpeed.end());
+}
+
+template <int DIM>
+void Solver<DIM>::updateTimestep()
+{
+	// CFL limit, plus a gravity limit for when the fluid is at rest
+	float speed = maxSpeed();
+	float target = dtMax;
+	if (speed > 0.0f) target = min(target, cflNumber * smoothingRadius / speed);
+	target = min(target, 0.25f * sqrt(smoothingRadius / gravity));
+
+	// shrink right away, grow gradually
+	dt = max(dtMin, min(target, dt * dtGrowth));
+}
+
+template <int DIM>
+void Solver<DIM>::step()
+{
+	if (adaptiveDt) updateTimestep();
+	else dt = fixedDt;
+
+	coeffs = Space<DIM>::coefficients(smoothingRadius);
+	float beta = 2.0f * dt * dt / (restDensity * restDensity);
+	delta = 1.0f / (beta * Space<DIM>::sumGradSquared(smoothingRadius, coeffs));
+
+	// 1. apply external forces
+	applyExternalForces();
+
+	// 2. bin particles into the neighbor grid, reused by every iteration below
+	if (!neighborLists) buildNeighborGrid();
+
+	// 3. density/pressure and pressure/viscosity iterations
+	int iter = 0, binned = 0;
+	bool converged = false;
+	while (!converged && iter < maxIterations) {
+		// the lists outlive steps, rebuilt with the grid once stale
+		if (neighborLists && listsStale()) {
+			buildNeighborGrid();
+			buildNeighborLists();
+		}
+
+		// rebinned once the particles may have left the padded cells
+		if (!neighborLists && iter - binned == gridIterations) {
+			buildNeighborGrid();
+			binned = iter;
+		}
+
+		float maxDensityError = computeDensities();
+		if (fusePressureViscosity) {
+			applyPressures(true);
+		} else {
+			applyPressures(false);
+			applyViscosity();
+		}
+		iter++;
+		converged = maxDensityError <= eta;
+	}
+
+	lastIterations = iter;
+	iterationTotal += iter;
+	iterationSteps++;
+	simTime += dt;
+}
+
+template class Solver<2>;
+template class Solver<3>;
+
+} // namespace cpusph
@@ -0,0 +1,234 @@
+#ifndef CPU_SPH_H
+#define CPU_SPH_H
+
+// Multithreaded CPU PCI-SPH for hosts without a GPU, in 2D and 3D. A step
+// follows the GL solvers' compute() pass for pass: external forces, one
+// neighbor grid per step, then density/pressure and pressure/viscosity
+// iterations until the density error is under eta. The kernels, constants
+// and default parameters are the ones in compute2d/ and compute3d/.
+//
+// The neighbor grid is a counting sort into flat arrays, and the particles
+// are stored in cell order as one padded float array per component, so the
+// cells of one neighbor row are a single contiguous range that the SIMD
+// kernels (CPU_SPH_KERNELS.h) stream through a packet at a time. With
+// neighborLists the grid instead feeds Verlet lists in CSR form, each slot's
+// neighbors within h plus a skin, which the iterations and later steps reuse
+// until some particle has moved half the skin. Every pass reads the arrays
+// of the pass before and writes fresh ones, so unlike the in-place GPU
+// passes the result does not depend on the thread count. The exception is
+// symmetricForces, which walks each force pair once from the lower slot and
+// adds the opposite terms to per-thread sums, so the order of the final
+// additions follows the thread split. Obstacles, mouse forces, checkpoints and
+// trajectories stay with the GL solvers.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "SETTINGS.h"
+#include "THREADS.h"
+#include "CPU_SPH_KERNELS.h"
+
+namespace cpusph {
+
+// what differs between the dimensions: vector type and kernel
+// normalizations for smoothing radius h. The kernels themselves are in
+// CPU_SPH_LOOPS.h.
+template <int DIM> struct Space;
+
+template <> struct Space<2> {
+	typedef glm::vec2 vec;
+	static const bool fused = false;		// the 2D GL solver has no fused pass
+	static const bool boundExtForces = false;
+
+	static glm::vec3 coefficients(float h)
+	{
+		return glm::vec3(6.0f / (M_PI * pow(h, 4.0f)),
+						 -12.0f / (M_PI * pow(h, 4.0f)),
+						 4.0f / (M_PI * pow(h, 8.0f)));
+	}
+	static float sumGradSquared(float h, const glm::vec3 &) { return 24.0f / (M_PI * pow(h, 4.0f)); }
+
+	// every PCISPH iteration moves the particles, so the lists must last a
+	// few iterations of ~0.05h each
+	static float neighborSkin() { return 0.3f; }
+};
+
+template <> struct Space<3> {
+	typedef glm::vec3 vec;
+	static const bool fused = true;
+	static const bool boundExtForces = true;
+
+	// poly6 density, spiky gradient, viscosity laplacian
+	static glm::vec3 coefficients(float h)
+	{
+		return glm::vec3(315.0f / (64.0f * M_PI * pow(h, 9.0f)),
+						 -45.0f / (M_PI * pow(h, 6.0f)),
+						 15.0f / (2.0f * M_PI * pow(h, 3.0f)));
+	}
+	static float sumGradSquared(float, const glm::vec3 &coeffs) { return coeffs.x; }
+
+	// one iteration a step, reused across steps once the fluid settles
+	static float neighborSkin() { return 0.4f; }
+};
+
+// structure of arrays, one padded array per component
+template <int DIM>
+struct VectorArrays {
+	typedef typename Space<DIM>::vec vec;
+	simd::FloatArray c[DIM];
+
+	void resize(int n) { for (int d = 0; d < DIM; d++) simd::resizePadded(c[d], n); }
+	void swap(VectorArrays &other) { for (int d = 0; d < DIM; d++) c[d].swap(other.c[d]); }
+
+	vec get(int i) const
+	{
+		vec v;
+		for (int d = 0; d < DIM; d++) v[d] = c[d][i];
+		return v;
+	}
+	void set(int i, const vec &v) { for (int d = 0; d < DIM; d++) c[d][i] = v[d]; }
+	const float *component(int d) const { return d < DIM ? c[d].data() : nullptr; }
+};
+
+template <int DIM>
+class Solver {
+public:
+	typedef typename Space<DIM>::vec vec;
+
+	// threads = 0 uses every hardware thread. The neighbor kernels are the
+	// widest up to maxISA that the CPU has.
+	Solver(int numParticles, int threads = 0, simd::ISA maxISA = simd::AVX512);
+
+	// same particle block as the GL solver of this dimension
+	void init();
+	void step();
+
+	// set a simulation parameter by name, false if the name is unknown.
+	// Call before init, the neighbor grid is sized from smoothingRadius.
+	bool setParameter(const std::string &name, float value);
+
+	// state by particle id, the storage order changes every step
+	void readbackPositions(std::vector<vec> &out) const;
+	void readbackVelocities(std::vector<vec> &out) const;
+	// false, with nothing written, if either doesn't hold numParticles
+	bool writeParticles(const std::vector<vec> &positions, const std::vector<vec> &velocities);
+
+	int getNumParticles() const { return numParticles; }
+	int getThreads() const { return pool.size(); }
+	simd::ISA getISA() const { return kernels.isa; }
+	int getSIMDWidth() const { return kernels.width; }
+	float getDt() const { return dt; }
+	double getSimTime() const { return simTime; }
+
+	int getLastIterations() const { return lastIterations; }
+	float getAverageIterations() const { return iterationSteps ? (float)iterationTotal / iterationSteps : 0.0f; }
+	float getAverageListBuilds() const { return iterationSteps ? (float)listBuilds / iterationSteps : 0.0f; }
+	void resetConvergenceStats() { iterationTotal = 0; iterationSteps = 0; listBuilds = 0; }
+
+	// adaptive timestep, same limits as the GL solvers but with this step's
+	// max speed instead of one read back a step or two late
+	bool adaptiveDt = false;
+
+	// one neighbor pass for pressure and viscosity instead of two
+	bool fusePressureViscosity = Space<DIM>::fused;
+
+	// Verlet neighbor lists instead of grid rows, set before init
+	bool neighborLists = false;
+
+	// each pressure and viscosity pair evaluated once, needs neighborLists
+	bool symmetricForces = false;
+	long getListBuilds() const { return listBuilds; }
+
+private:
+	int numParticles;
+	ThreadPool pool;
+
+	KernelTable kernels;
+
+	// particle state in cell order, id[slot] is the particle in that slot
+	VectorArrays<DIM> pos, vel, predicted;
+	simd::FloatArray density, pressure;
+	std::vector<int> id;
+
+	// scratch for the passes that write positions and velocities
+	VectorArrays<DIM> nextPos, nextVel;
+	simd::FloatArray nextPressure;
+	std::vector<int> nextId;
+
+	// neighbor grid: particles of cell c are slots [cellStart[c], cellStart[c + 1])
+	vec boundsMin, boundsMax;
+	int gridDims[3];
+	int numCells = 0;
+	float cellSize;
+	float gridPad = 0.2f;		// cap on the padding, fraction of smoothingRadius
+	int gridIterations = 1;		// iterations per rebinning, without lists
+	std::vector<int> cellStart, particleCell;
+	std::vector<int> threadCounts;		// per-thread histograms of the sort
+	void fitNeighborGrid(float pad);
+	void buildNeighborGrid();
+	int cellIndex(const vec &p, int cell[3]) const;
+
+	// the cells around p as contiguous slot ranges, one per row
+	void neighborRows(const vec &p, NeighborRows &rows) const;
+	KernelInputs kernelInputs(const VectorArrays<DIM> &positions) const;
+
+	// neighbor lists: slot i's neighbors are listNeighbors[listStart[i],
+	// listStart[i + 1]), self included, all slots within h + skin of it
+	// when built from listOrigin. Lists are in slot order, so the entries
+	// after listSelf[i], i's own, are its half list.
+	float neighborSkin = Space<DIM>::neighborSkin();		// fraction of smoothingRadius
+	std::vector<int> listStart, listNeighbors, listSelf;
+	std::vector<std::vector<int> > partNeighbors;
+	VectorArrays<DIM> listOrigin;
+	bool listsValid = false;
+	long listBuilds = 0;
+	void buildNeighborLists();
+	bool listsStale();
+
+	// slot i's list range, or the grid rows around p without lists
+	void neighborsOf(int i, const vec &p, NeighborRows &rows) const;
+
+	// symmetric forces: per-part pair sums of the current force pass over
+	// the slots [pairBegin, pairEnd) its half lists reach, and the forces on
+	// slot i from them or from its own neighbor pass
+	std::vector<VectorArrays<DIM> > pairPressure, pairViscosity;
+	std::vector<int> pairBegin, pairEnd;
+	void sumPairForces(const KernelInputs &in, bool withPressure, bool withViscosity);
+	void forcesOn(const KernelInputs &in, int i, const vec &p, bool withPressure, bool withViscosity,
+				  float pressureForce[3], float viscosityForce[3]) const;
+
+	// passes, in order
+	void applyExternalForces();
+	float computeDensities();
+	void applyPressures(bool withViscosity);
+	void applyViscosity();
+	void checkBoundary(vec &p, vec &v) const;
+	void updateTimestep();
+	float maxSpeed();
+
+	// fn(begin, end, part) on one range of slots per thread
+	template <class F> void forParticles(F fn);
+	int particleParts() const { return std::min(pool.size(), std::max(1, numParticles / 256)); }
+
+	// parameters, the GL solver's defaults for this dimension
+	void setDefaults();
+	int maxIterations;
+	float fixedDt, dt;
+	double simTime = 0.0;
+	float gravity, restDensity, smoothingRadius, stiffness, eta, viscosityStrength;
+	float cflNumber, dtMin, dtMax, dtGrowth = 1.2f;
+	glm::vec3 coeffs;	// density, gradient, viscosity kernel normalizations
+	float delta;
+
+	int lastIterations = 0;
+	long iterationTotal = 0;
+	long iterationSteps = 0;
+};
+
+} // namespace cpusph
+
+namespace sph2d { typedef cpusph::Solver<2> CPUParallel; }
+namespace sph3d { typedef cpusph::Solver<3> CPUParallel; }
+
+#endif
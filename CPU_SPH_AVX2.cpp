@@ -0,0 +1,19 @@
+// built with -mavx2 -mfma where the compiler targets x86; the dispatcher
+// only calls in when the CPU has both
+#include "CPU_SPH_LOOPS.h"
+
+namespace cpusph {
+
+bool avx2Kernels(int dim, KernelTable &table)
+{
+#ifdef __AVX2__
+	fillTable<simd::Avx2>(dim, simd::AVX2, table);
+	return true;
+#else
+	(void)dim;
+	(void)table;
+	return false;
+#endif
+}
+
+} // namespace cpusph
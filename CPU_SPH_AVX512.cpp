@@ -0,0 +1,19 @@
+// built with -mavx512f where the compiler targets x86; the dispatcher only
+// calls in when the CPU has it
+#include "CPU_SPH_LOOPS.h"
+
+namespace cpusph {
+
+bool avx512Kernels(int dim, KernelTable &table)
+{
+#ifdef __AVX512F__
+	fillTable<simd::Avx512>(dim, simd::AVX512, table);
+	return true;
+#else
+	(void)dim;
+	(void)table;
+	return false;
+#endif
+}
+
+} // namespace cpusph
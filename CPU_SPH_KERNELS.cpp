@@ -0,0 +1,24 @@
+#include <algorithm>
+
+#include "CPU_SPH_LOOPS.h"
+
+namespace cpusph {
+
+bool scalarKernels(int dim, KernelTable &table)
+{
+	fillTable<simd::Scalar>(dim, simd::SCALAR, table);
+	return true;
+}
+
+KernelTable kernelsFor(int dim, simd::ISA limit)
+{
+	simd::ISA isa = std::min(simd::detectISA(), limit);
+
+	KernelTable table;
+	if (isa >= simd::AVX512 && avx512Kernels(dim, table)) return table;
+	if (isa >= simd::AVX2 && avx2Kernels(dim, table)) return table;
+	scalarKernels(dim, table);
+	return table;
+}
+
+} // namespace cpusph
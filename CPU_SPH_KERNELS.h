@@ -0,0 +1,78 @@
+#ifndef CPU_SPH_KERNELS_H
+#define CPU_SPH_KERNELS_H
+
+// Neighbor loops of the CPU solver: density, and pressure and viscosity
+// forces, over the contiguous slot ranges of one particle's neighbor rows or
+// over its range of a CSR neighbor list.
+// They read structure-of-arrays data and are built once per ISA
+// (CPU_SPH_KERNELS.cpp, CPU_SPH_AVX2.cpp, CPU_SPH_AVX512.cpp) from the same
+// loop bodies in CPU_SPH_LOOPS.h; kernelsFor() picks the widest the running
+// CPU and the build both have.
+
+#include "SIMD.h"
+
+namespace cpusph {
+
+// padded SoA arrays, see simd::resizePadded. z and vz are unused in 2D.
+struct KernelInputs {
+	const float *x, *y, *z;
+	const float *vx, *vy, *vz;
+	const float *pressure;
+	const int *neighbors;	// list kernels only, slots with maxWidth spare entries
+
+	float h;
+	float densityCoeff, gradCoeff, viscosityCoeff;
+	float pressureScale;	// -stiffness / restDensity^2
+};
+
+// per-slot sums of the pair kernel, before the kernel normalizations and
+// pressureScale; z is unused in 2D
+struct ForceSums {
+	float *pressure[3];
+	float *viscosity[3];
+};
+
+// one particle's neighbor rows as slot ranges [begin, end). For the list
+// kernels it is one range of positions in KernelInputs::neighbors.
+struct NeighborRows {
+	int begin[9], end[9];
+	int count;
+};
+
+struct KernelTable {
+	simd::ISA isa;
+	int width;		// floats per packet
+
+	// density at xi, self included
+	float (*density)(const KernelInputs &in, const float xi[3], const NeighborRows &rows);
+
+	// pressure and/or viscosity force on the particle in slot i
+	void (*forces)(const KernelInputs &in, int i, const NeighborRows &rows,
+				   bool pressure, bool viscosity, float pressureForce[3], float viscosityForce[3]);
+
+	// slots of the rows within radius of xi, written to out in row order;
+	// out needs room for every slot of the rows plus simd::maxWidth
+	int (*list)(const KernelInputs &in, const float xi[3], const NeighborRows &rows, float radius, int *out);
+
+	// density and forces over neighbor list ranges
+	float (*listDensity)(const KernelInputs &in, const float xi[3], const NeighborRows &rows);
+	void (*listForces)(const KernelInputs &in, int i, const NeighborRows &rows,
+					   bool pressure, bool viscosity, float pressureForce[3], float viscosityForce[3]);
+
+	// each pair of slot i with the neighbors of a list range once, i's
+	// terms added to its sums and the opposite terms to the neighbors'
+	void (*pairForces)(const KernelInputs &in, int i, const NeighborRows &rows,
+					   bool pressure, bool viscosity, const ForceSums &out);
+};
+
+// per ISA, false when this build has no kernels for it
+bool scalarKernels(int dim, KernelTable &table);
+bool avx2Kernels(int dim, KernelTable &table);
+bool avx512Kernels(int dim, KernelTable &table);
+
+// widest ISA up to limit that both the CPU and the build have
+KernelTable kernelsFor(int dim, simd::ISA limit = simd::AVX512);
+
+} // namespace cpusph
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef CPU_SPH_LOOPS_H
+#define CPU_SPH_LOOPS_H
+
+// Loop bodies of the CPU neighbor kernels, templated on the dimension and a
+// packet type from SIMD_PACKETS.h. Each neighbor row is walked a packet at a
+// time; the last packet of a row reads past its end into the next slots (or
+// the arrays' padding) and masks those lanes off. The LIST variants walk
+// positions of in.neighbors instead and gather the slots they name, and the
+// pair variant also scatters each pair's opposite contribution back. The
+// kernels are the ones in compute2d/ and compute3d/, with the normalizations
+// applied once to the sums instead of per pair.
+// Include only from the per-ISA kernel translation units.
+
+#include "CPU_SPH_KERNELS.h"
+#include "SIMD_PACKETS.h"
+
+namespace cpusph {
+namespace {
+
+// the masks of some packets are plain intrinsic types, which argument
+// dependent lookup doesn't tie to simd::
+using simd::maskAnd;
+using simd::any;
+using simd::storeIndices;
+using simd::scatterSub;
+
+// packet at slot j, or at slots neighbors[j...] for the list kernels
+template <class P, bool LIST>
+inline P fetch(const float *a, const KernelInputs &in, int j)
+{
+	return LIST ? P::gather(a, in.neighbors + j) : P::load(a + j);
+}
+
+template <int DIM, class P, bool LIST>
+float densityLoop(const KernelInputs &in, const float xi[3], const NeighborRows &rows)
+{
+	P x = P::set1(xi[0]), y = P::set1(xi[1]), z = P::set1(DIM == 3 ? xi[2] : 0.0f);
+	P h = P::set1(in.h), h2 = P::set1(in.h * in.h);
+	P acc = P::set1(0.0f);
+
+	for (int row = 0; row < rows.count; row++) {
+		int end = rows.end[row];
+		for (int j = rows.begin[row]; j < end; j += P::width) {
+			P dx = x - fetch<P, LIST>(in.x, in, j);
+			P dy = y - fetch<P, LIST>(in.y, in, j);
+			P r2 = dx * dx + dy * dy;
+			if (DIM == 3) {
+				P dz = z - fetch<P, LIST>(in.z, in, j);
+				r2 = fmadd(dz, dz, r2);
+			}
+			typename P::Mask near = maskAnd(P::lanes(end - j), r2 < h2);
+			if (!any(near)) continue;
+
+			// 2D (h - r)^2, 3D (h^2 - r^2)^3
+			P w;
+			if (DIM == 2) {
+				P d = h - sqrt(r2);
+				w = d * d;
+			} else {
+				P d = h2 - r2;
+				w = d * d * d;
+			}
+			acc = acc + select(near, w);
+		}
+	}
+	return in.densityCoeff * sum(acc);
+}
+
+template <int DIM, class P, bool LIST>
+void forcesLoop(const KernelInputs &in, int i, const NeighborRows &rows,
+				bool pressure, bool viscosity, float pressureForce[3], float viscosityForce[3])
+{
+	P x = P::set1(in.x[i]), y = P::set1(in.y[i]), z = P::set1(DIM == 3 ? in.z[i] : 0.0f);
+	P vx = P::set1(in.vx[i]), vy = P::set1(in.vy[i]), vz = P::set1(DIM == 3 ? in.vz[i] : 0.0f);
+	P pi = P::set1(in.pressure[i]);
+	P h = P::set1(in.h), h2 = P::set1(in.h * in.h), zero = P::set1(0.0f);
+	P px = zero, py = zero, pz = zero;
+	P fx = zero, fy = zero, fz = zero;
+
+	for (int row = 0; row < rows.count; row++) {
+		int end = rows.end[row];
+		for (int j = rows.begin[row]; j < end; j += P::width) {
+			P dx = x - fetch<P, LIST>(in.x, in, j);
+			P dy = y - fetch<P, LIST>(in.y, in, j);
+			P dz = zero;
+			P r2 = dx * dx + dy * dy;
+			if (DIM == 3) {
+				dz = z - fetch<P, LIST>(in.z, in, j);
+				r2 = fmadd(dz, dz, r2);
+			}
+			typename P::Mask near = maskAnd(P::lanes(end - j), r2 < h2);
+			if (!any(near)) continue;
+			P r = sqrt(r2);
+
+			if (pressure) {
+				// (pi + pj) * grad W, the gradient is 2D (h - r) and 3D
+				// (h - r)^2 along r / |r|; the particle itself has r = 0
+				P d = h - r;
+				P g = DIM == 2 ? d : d * d;
+				P s = select(maskAnd(near, r > zero), (pi + fetch<P, LIST>(in.pressure, in, j)) * g / r);
+				px = fmadd(s, dx, px);
+				py = fmadd(s, dy, py);
+				if (DIM == 3) pz = fmadd(s, dz, pz);
+			}
+			if (viscosity) {
+				// 2D (h^2 - r^2)^3, 3D (h - r); the particle itself adds vi - vi
+				P k;
+				if (DIM == 2) {
+					P d = h2 - r2;
+					k = d * d * d;
+				} else {
+					k = h - r;
+				}
+				k = select(near, k);
+				fx = fmadd(fetch<P, LIST>(in.vx, in, j) - vx, k, fx);
+				fy = fmadd(fetch<P, LIST>(in.vy, in, j) - vy, k, fy);
+				if (DIM == 3) fz = fmadd(fetch<P, LIST>(in.vz, in, j) - vz, k, fz);
+			}
+		}
+	}
+
+	float pressureCoeff = in.pressureScale * in.gradCoeff;
+	pressureForce[0] = pressureCoeff * sum(px);
+	pressureForce[1] = pressureCoeff * sum(py);
+	pressureForce[2] = pressureCoeff * sum(pz);
+	viscosityForce[0] = in.viscosityCoeff * sum(fx);
+	viscosityForce[1] = in.viscosityCoeff * sum(fy);
+	viscosityForce[2] = in.viscosityCoeff * sum(fz);
+}
+
+template <int DIM, class P>
+void pairForcesLoop(const KernelInputs &in, int i, const NeighborRows &rows,
+					bool pressure, bool viscosity, const ForceSums &out)
+{
+	P x = P::set1(in.x[i]), y = P::set1(in.y[i]), z = P::set1(DIM == 3 ? in.z[i] : 0.0f);
+	P vx = P::set1(in.vx[i]), vy = P::set1(in.vy[i]), vz = P::set1(DIM == 3 ? in.vz[i] : 0.0f);
+	P pi = P::set1(in.pressure[i]);
+	P h = P::set1(in.h), h2 = P::set1(in.h * in.h), zero = P::set1(0.0f);
+	P px = zero, py = zero, pz = zero;
+	P fx = zero, fy = zero, fz = zero;
+
+	for (int row = 0; row < rows.count; row++) {
+		int end = rows.end[row];
+		for (int j = rows.begin[row]; j < end; j += P::width) {
+			const int *slots = in.neighbors + j;
+			P dx = x - fetch<P, true>(in.x, in, j);
+			P dy = y - fetch<P, true>(in.y, in, j);
+			P dz = zero;
+			P r2 = dx * dx + dy * dy;
+			if (DIM == 3) {
+				dz = z - fetch<P, true>(in.z, in, j);
+				r2 = fmadd(dz, dz, r2);
+			}
+			typename P::Mask near = maskAnd(P::lanes(end - j), r2 < h2);
+			if (!any(near)) continue;
+			P r = sqrt(r2);
+
+			// same terms as forcesLoop, each one also subtracted from the
+			// neighbor's sums since both forces are antisymmetric
+			if (pressure) {
+				P d = h - r;
+				P g = DIM == 2 ? d : d * d;
+				P s = select(maskAnd(near, r > zero), (pi + fetch<P, true>(in.pressure, in, j)) * g / r);
+				P sx = s * dx, sy = s * dy;
+				px = px + sx;
+				py = py + sy;
+				scatterSub(out.pressure[0], slots, near, sx);
+				scatterSub(out.pressure[1], slots, near, sy);
+				if (DIM == 3) {
+					P sz = s * dz;
+					pz = pz + sz;
+					scatterSub(out.pressure[2], slots, near, sz);
+				}
+			}
+			if (viscosity) {
+				P k;
+				if (DIM == 2) {
+					P d = h2 - r2;
+					k = d * d * d;
+				} else {
+					k = h - r;
+				}
+				k = select(near, k);
+				P gx = (fetch<P, true>(in.vx, in, j) - vx) * k;
+				P gy = (fetch<P, true>(in.vy, in, j) - vy) * k;
+				fx = fx + gx;
+				fy = fy + gy;
+				scatterSub(out.viscosity[0], slots, near, gx);
+				scatterSub(out.viscosity[1], slots, near, gy);
+				if (DIM == 3) {
+					P gz = (fetch<P, true>(in.vz, in, j) - vz) * k;
+					fz = fz + gz;
+					scatterSub(out.viscosity[2], slots, near, gz);
+				}
+			}
+		}
+	}
+
+	out.pressure[0][i] += sum(px);
+	out.pressure[1][i] += sum(py);
+	out.viscosity[0][i] += sum(fx);
+	out.viscosity[1][i] += sum(fy);
+	if (DIM == 3) {
+		out.pressure[2][i] += sum(pz);
+		out.viscosity[2][i] += sum(fz);
+	}
+}
+
+template <int DIM, class P>
+int listLoop(const KernelInputs &in, const float xi[3], const NeighborRows &rows, float radius, int *out)
+{
+	P x = P::set1(xi[0]), y = P::set1(xi[1]), z = P::set1(DIM == 3 ? xi[2] : 0.0f);
+	P r2Max = P::set1(radius * radius);
+	int count = 0;
+
+	for (int row = 0; row < rows.count; row++) {
+		int end = rows.end[row];
+		for (int j = rows.begin[row]; j < end; j += P::width) {
+			P dx = x - P::load(in.x + j);
+			P dy = y - P::load(in.y + j);
+			P r2 = dx * dx + dy * dy;
+			if (DIM == 3) {
+				P dz = z - P::load(in.z + j);
+				r2 = fmadd(dz, dz, r2);
+			}
+			count += storeIndices(out + count, maskAnd(P::lanes(end - j), r2 < r2Max), j);
+		}
+	}
+	return count;
+}
+
+template <class P>
+void fillTable(int dim, simd::ISA isa, KernelTable &table)
+{
+	table.isa = isa;
+	table.width = P::width;
+	table.density = dim == 2 ? densityLoop<2, P, false> : densityLoop<3, P, false>;
+	table.forces = dim == 2 ? forcesLoop<2, P, false> : forcesLoop<3, P, false>;
+	table.listDensity = dim == 2 ? densityLoop<2, P, true> : densityLoop<3, P, true>;
+	table.listForces = dim == 2 ? forcesLoop<2, P, true> : forcesLoop<3, P, true>;
+	table.pairForces = dim == 2 ? pairForcesLoop<2, P> : pairForcesLoop<3, P>;
+	table.list = dim == 2 ? listLoop<2, P> : listLoop<3, P>;
+}
+
+} // namespace
+} // namespace cpusph
+
+#endif
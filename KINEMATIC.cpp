@@ -0,0 +1,170 @@
+#include "KINEMATIC.h"
+
+#include <cstring>
+#include <stdint.h>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////
+// paths
+///////////////////////////////////////////////////////////////////////
+
+void ObstaclePath::moveTo(const glm::vec3 &position, float speed)
+{
+	if (points.empty()) {
+		add(0.0f, position);
+		return;
+	}
+	const Waypoint &last = points.back();
+	add(last.time + glm::length(position - last.position) / speed, position);
+}
+
+int ObstaclePath::segment(double time, float &t) const
+{
+	float end = points.back().time;
+	if (loop && end > 0.0f) time = fmod(time, (double)end);
+
+	int n = (int)points.size();
+	if (n == 1 || time <= points[0].time) { t = 0.0f; return 0; }
+	if (time >= end) { t = 1.0f; return n - 2; }
+
+	int i = 0;
+	while (points[i + 1].time <= time) i++;
+	t = (float)((time - points[i].time) / (points[i + 1].time - points[i].time));
+	return i;
+}
+
+glm::vec3 ObstaclePath::position(double time) const
+{
+	float t;
+	int i = segment(time, t);
+	if (points.size() == 1) return points[0].position;
+	return glm::mix(points[i].position, points[i + 1].position, t);
+}
+
+glm::vec3 ObstaclePath::velocity(double time) const
+{
+	float t;
+	int i = segment(time, t);
+	if (points.size() == 1) return glm::vec3(0.0f);
+
+	// a finished path has stopped
+	if (!loop && time >= points.back().time) return glm::vec3(0.0f);
+	float span = points[i + 1].time - points[i].time;
+	return span > 0.0f ? (points[i + 1].position - points[i].position) / span : glm::vec3(0.0f);
+}
+
+///////////////////////////////////////////////////////////////////////
+// box table
+///////////////////////////////////////////////////////////////////////
+
+KinematicObstacles::~KinematicObstacles()
+{
+	if (ssbo) glDeleteBuffers(1, &ssbo);
+}
+
+int KinematicObstacles::add(const glm::vec3 &center, const glm::vec3 &halfExtent)
+{
+	KinematicBox box;
+	box.center = center;
+	box.halfExtent = halfExtent;
+	boxes.push_back(box);
+	return (int)boxes.size() - 1;
+}
+
+void KinematicObstacles::update(double time)
+{
+	double t = time - startTime;
+
+	vector<GPUBox> next(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		const KinematicBox &box = boxes[i];
+		glm::vec3 center = box.path.empty() ? box.center : box.path.position(t);
+		glm::vec3 velocity = box.path.empty() ? glm::vec3(0.0f) : box.path.velocity(t);
+		next[i].lo = glm::vec4(center - box.halfExtent, 0.0f);
+		next[i].hi = glm::vec4(center + box.halfExtent, 0.0f);
+		next[i].velocity = glm::vec4(velocity, 0.0f);
+	}
+
+	// static boxes never touch the buffer after the first upload
+	bool same = next.size() == table.size()
+		&& (next.empty() || memcmp(next.data(), table.data(), next.size() * sizeof(GPUBox)) == 0);
+	if (same && ssbo) return;
+	table.swap(next);
+
+	GLsizeiptr bytes = (GLsizeiptr)max<size_t>(table.size(), 1) * sizeof(GPUBox);
+	if (!ssbo) glGenBuffers(1, &ssbo);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+	if (bytes > capacity) {
+		glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+		capacity = bytes;
+	}
+	if (!table.empty())
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, table.size() * sizeof(GPUBox), table.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+///////////////////////////////////////////////////////////////////////
+// serialization
+///////////////////////////////////////////////////////////////////////
+
+// per box: center, halfExtent, loop, waypoint count, then the waypoints
+struct SavedBox {
+	glm::vec3 center;
+	glm::vec3 halfExtent;
+	uint32_t loop;
+	uint32_t numPoints;
+};
+
+void KinematicObstacles::save(vector<char> &out) const
+{
+	uint32_t numBoxes = boxes.size();
+	out.assign((const char *)&numBoxes, (const char *)&numBoxes + sizeof(numBoxes));
+
+	for (const KinematicBox &box : boxes) {
+		SavedBox saved = { box.center, box.halfExtent, box.path.loop, (uint32_t)box.path.points.size() };
+		out.insert(out.end(), (const char *)&saved, (const char *)&saved + sizeof(saved));
+		const char *points = (const char *)box.path.points.data();
+		out.insert(out.end(), points, points + box.path.points.size() * sizeof(ObstaclePath::Waypoint));
+	}
+}
+
+bool KinematicObstacles::load(const void *data, size_t bytes)
+{
+	const char *p = (const char *)data, *end = p + bytes;
+	uint32_t numBoxes;
+	if (bytes < sizeof(numBoxes)) return false;
+	memcpy(&numBoxes, p, sizeof(numBoxes));
+	p += sizeof(numBoxes);
+
+	vector<KinematicBox> loaded(numBoxes);
+	for (KinematicBox &box : loaded) {
+		SavedBox saved;
+		if ((size_t)(end - p) < sizeof(saved)) return false;
+		memcpy(&saved, p, sizeof(saved));
+		p += sizeof(saved);
+
+		size_t pointBytes = saved.numPoints * sizeof(ObstaclePath::Waypoint);
+		if ((size_t)(end - p) < pointBytes) return false;
+		box.center = saved.center;
+		box.halfExtent = saved.halfExtent;
+		box.path.loop = saved.loop != 0;
+		box.path.points.resize(saved.numPoints);
+		memcpy(box.path.points.data(), p, pointBytes);
+		p += pointBytes;
+	}
+	if (p != end) return false;
+
+	// the table is rebuilt, and the buffer regrown if needed, by the next update
+	boxes.swap(loaded);
+	table.clear();
+	return true;
+}
+
+glm::mat4 KinematicObstacles::model(int box) const
+{
+	glm::vec3 lo = glm::vec3(table[box].lo);
+	glm::vec3 hi = glm::vec3(table[box].hi);
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), 0.5f * (lo + hi));
+	return glm::scale(model, 0.5f * (hi - lo));
+}
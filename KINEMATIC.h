@@ -0,0 +1,83 @@
+#ifndef KINEMATIC_H
+#define KINEMATIC_H
+
+// Kinematic box obstacles for both solvers. The box geometry is uploaded once
+// as a unit cube (or square) and drawn with a model matrix; the motion comes
+// from scripted waypoint paths evaluated at the simulation time. Per step only
+// a small table of box bounds and velocities is rewritten, and one collision
+// dispatch tests every particle against all the boxes in it.
+
+#include <vector>
+
+#include "SETTINGS.h"
+
+// piecewise linear path through timed waypoints. A looping path starts over
+// after its last waypoint, so close it by ending where it began.
+struct ObstaclePath {
+	struct Waypoint { float time; glm::vec3 position; };
+	std::vector<Waypoint> points;
+	bool loop = true;
+
+	void add(float time, const glm::vec3 &position) { points.push_back({time, position}); }
+	// straight to position at speed, from the previous waypoint
+	void moveTo(const glm::vec3 &position, float speed);
+
+	bool empty() const { return points.empty(); }
+	glm::vec3 position(double time) const;
+	glm::vec3 velocity(double time) const;
+
+private:
+	// segment holding time and the fraction along it
+	int segment(double time, float &t) const;
+};
+
+struct KinematicBox {
+	glm::vec3 center;		// used while the path is empty
+	glm::vec3 halfExtent;
+	ObstaclePath path;
+};
+
+// std430 mirror of the Box struct in the collision shaders
+struct GPUBox {
+	glm::vec4 lo;
+	glm::vec4 hi;
+	glm::vec4 velocity;
+};
+
+class KinematicObstacles {
+public:
+	KinematicObstacles() {};
+	~KinematicObstacles();
+
+	// returns the box's index
+	int add(const glm::vec3 &center, const glm::vec3 &halfExtent);
+	ObstaclePath &path(int box) { return boxes[box].path; }
+	void clear() { boxes.clear(); table.clear(); }
+	GLuint count() const { return (GLuint)boxes.size(); }
+
+	// paths run from the last restart
+	void restart(double time) { startTime = time; }
+	double startTime = 0.0;
+
+	// evaluates the paths and rewrites the box table when it changed. The
+	// buffer is only reallocated when boxes were added.
+	void update(double time);
+	void bind(GLuint binding) const { glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo); }
+
+	// maps the unit cube [-1, 1]^3 onto the box as of the last update
+	glm::mat4 model(int box) const;
+
+	// boxes and their paths as a flat blob for checkpoints. load replaces
+	// the boxes, false if the blob is malformed.
+	void save(std::vector<char> &out) const;
+	bool load(const void *data, size_t bytes);
+
+	std::vector<KinematicBox> boxes;
+
+private:
+	std::vector<GPUBox> table;
+	GLuint ssbo = 0;
+	GLsizeiptr capacity = 0;
+};
+
+#endif
@@ -1,71 +1,111 @@
 #include "PARTICLE_2D.h"
+#include "CHECKPOINT.h"
+#include "THREADS.h"
+
+#include <thread>
+
+namespace sph2d {
 
 Parallel::Parallel(int num)
 {
 	numParticles = num;
 }
 
+Parallel::~Parallel()
+{
+	// names that were never generated are 0, which the deletes skip
+	GLuint buffers[] = {
+		posSSBO, velSSBO, densitySSBO, pressureSSBO, maxDensityError, maxSpeed, paramsUBO, dispatchArgs,
+		keySSBO, keyCountSSBO, keyOffsetSSBO, permutationSSBO, particleIdSSBO, particleSlotSSBO,
+		scratchVec2SSBO, scratchFloatSSBO, objectVBO };
+	glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+
+	GLuint arrays[] = { VAO, objectVAO };
+	glDeleteVertexArrays(sizeof(arrays) / sizeof(arrays[0]), arrays);
+
+	// the compute programs belong to the shader variant cache, only the
+	// render programs are linked for this solver alone
+	glDeleteProgram(fluidRenderer);
+	glDeleteProgram(objectRenderer);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // initialization functions
 ///////////////////////////////////////////////////////////////////////
 
-void Parallel::initParticlesAndProgram()
+void Parallel::generateParticles(vector<vec2> &positions, vector<vec2> &velocities) const
 {
-	// generate grid of initial positions
-	float *positions = new float[2 * numParticles];
-	float *velocities = new float[2 * numParticles];
-
+	// grid of initial positions
 	int width = (int)sqrt(numParticles);
 	int height = (numParticles + width - 1) / width; // ceil division
 	float spacing = 5.0f;  // use reasonable pixel spacing
 
-	for (int i = 0; i < numParticles; i++) {
-		float gridWidth = width * spacing;
-		float gridHeight = height * spacing;
-		float offsetX = (xScreenRes - gridWidth) / 2.0f;
-		float offsetY = (yScreenRes - gridHeight) / 2.0f;
+	parallelFor(numParticles, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			float gridWidth = width * spacing;
+			float gridHeight = height * spacing;
+			float offsetX = (xScreenRes - gridWidth) / 2.0f;
+			float offsetY = (yScreenRes - gridHeight) / 2.0f;
 
-		float x = (i % width) * spacing + offsetX;
-		float y = (i / width) * spacing + offsetY;
+			float x = (i % width) * spacing + offsetX;
+			float y = (i / width) * spacing + offsetY;
 
-		positions[2 * i + 0] = x;
-		positions[2 * i + 1] = y;
+			positions[i] = vec2(x, y);
+			velocities[i] = vec2(0.0f, 0.0f);
+		}
+	});
+}
 
-		velocities[2 * i + 0] = 0.0f;
-		velocities[2 * i + 1] = 0.0f;
-	}
+void Parallel::queuePrograms()
+{
+	progApplyExtForces    = queueComputeShader("compute2d/2D_extForces.glsl", shaderDefines(false));
+	progComputeDensities  = queueComputeShader("compute2d/2D_computeDensities.glsl", shaderDefines(true));
+	progApplyPressures    = queueComputeShader("compute2d/2D_applyPressures.glsl", shaderDefines(true));
+	progApplyViscosity    = queueComputeShader("compute2d/2D_viscosity.glsl", shaderDefines(true));
+	progResolveCollisions = queueComputeShader("compute2d/2D_resolveCollisions.glsl", shaderDefines(false));
+	progConvergence       = queueComputeShader("compute2d/2D_convergence.glsl");
+	progMortonKeys        = queueComputeShader("compute2d/2D_mortonKeys.glsl", shaderDefines(false));
+	progMortonScatter     = queueComputeShader("compute2d/2D_mortonScatter.glsl", shaderDefines(false));
+	progPermute           = queueComputeShader("compute2d/2D_permute.glsl", shaderDefines(false));
+	prims.init();
+}
+
+void Parallel::initParticlesAndProgram()
+{
+	// the initial conditions are filled on worker threads while this thread
+	// queues every compile; nothing waits on the driver until the first step
+	vector<vec2> positions(numParticles);
+	vector<vec2> velocities(numParticles);
+	std::thread fill([&] { generateParticles(positions, velocities); });
+	queuePrograms();
+	fill.join();
 
 	// Create SSBOs and fill them
-	initComputeShaders(positions, velocities);
+	initComputeShaders(&positions[0].x, &velocities[0].x);
 
 	// Bind SSBOs to fixed bindings
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, predPosSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, predVelSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, densitySSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, pressureSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, maxDensityError);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, pressureSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, densitySSBO);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
+	initReorder();
+
 	// Dummy VAO needed by OpenGL Core profile
 	glGenVertexArrays(1, &VAO);
 	glBindVertexArray(VAO);
 	glBindVertexArray(0);
-
-	delete[] positions;
-	delete[] velocities;
 }
 
 void Parallel::initComputeShaders(float *positions, float *velocities)
 {
 	glGenBuffers(1, &posSSBO);
 	glGenBuffers(1, &velSSBO);
-	glGenBuffers(1, &predPosSSBO);
-	glGenBuffers(1, &predVelSSBO);
 	glGenBuffers(1, &densitySSBO);
 	glGenBuffers(1, &pressureSSBO);
 	glGenBuffers(1, &maxDensityError);
+	glGenBuffers(1, &maxSpeed);
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, posSSBO);
 	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * 2 * numParticles, positions, GL_STATIC_DRAW);
@@ -73,12 +113,6 @@ void Parallel::initComputeShaders(float *positions, float *velocities)
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, velSSBO);
 	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * 2 * numParticles, velocities, GL_DYNAMIC_DRAW);
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, predPosSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * 2 * numParticles, positions, GL_DYNAMIC_DRAW);
-
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, predVelSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * 2 * numParticles, velocities, GL_DYNAMIC_DRAW);
-
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, densitySSBO);
 	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * numParticles, nullptr, GL_DYNAMIC_DRAW);
 
@@ -88,19 +122,102 @@ void Parallel::initComputeShaders(float *positions, float *velocities)
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxDensityError);
 	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float), nullptr, GL_DYNAMIC_DRAW);
 
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxSpeed);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-	progApplyExtForces    = createComputeShader("compute2d/2D_extForces.glsl");
-	progComputeDensities  = createComputeShader("compute2d/2D_computeDensities.glsl");
-	progApplyPressures    = createComputeShader("compute2d/2D_applyPressures.glsl");
-	progApplyViscosity    = createComputeShader("compute2d/2D_viscosity.glsl");
-	progResolveCollisions = createComputeShader("compute2d/2D_resolveCollisions.glsl");
+	profiler.init();
+
+	// dispatch arguments for GPU_INDIRECT mode: the iteration kernels, an
+	// executed-iteration counter and the two density error reduce passes
+	glGenBuffers(1, &dispatchArgs);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatchArgs);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 10, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// simulation parameters shared by every compute program
+	glGenBuffers(1, &paramsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, paramsUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(SimParams), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, paramsUBO);
+
+	errorReadback.init(sizeof(float), 2);
+	iterationReadback.init(sizeof(GLuint), 1);
+	speedReadback.init(sizeof(float), 1);
+
+}
+
+void Parallel::initReorder()
+{
+	// one key per smoothing-radius cell, Morton interleaved so nearby
+	// cells get nearby keys
+	float cellSize = smoothingRadius;
+	reorderDims = glm::ivec2((int)ceil((boundsMax.x - boundsMin.x) / cellSize),
+							 (int)ceil((boundsMax.y - boundsMin.y) / cellSize));
+
+	int bits = 0;
+	while ((1 << bits) < max(reorderDims.x, reorderDims.y)) bits++;
+	numKeys = 1u << (2 * bits);
+
+	glGenBuffers(1, &keySSBO);
+	glGenBuffers(1, &keyCountSSBO);
+	glGenBuffers(1, &keyOffsetSSBO);
+	glGenBuffers(1, &permutationSSBO);
+	glGenBuffers(1, &particleIdSSBO);
+	glGenBuffers(1, &particleSlotSSBO);
+	glGenBuffers(1, &scratchVec2SSBO);
+	glGenBuffers(1, &scratchFloatSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, keySSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, keyCountSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numKeys, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, keyOffsetSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numKeys, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, permutationSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleIdSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSlotSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, scratchVec2SSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * 2 * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, scratchFloatSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	resetParticleIds();
+}
+
+void Parallel::resetParticleIds()
+{
+	// identity permutation, particle i lives in slot i
+	std::vector<GLuint> identity(numParticles);
+	for (int i = 0; i < numParticles; i++) identity[i] = i;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleIdSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * numParticles, identity.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSlotSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * numParticles, identity.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 void Parallel::initRenderer(const char *vertexPath, const char *fragmentPath)
 {
-	fluidRenderer  = createRenderProgram(vertexPath, fragmentPath);
-	objectRenderer = createRenderProgram("render2d/object_vert.glsl", "render2d/object_frag.glsl");
+	fluidRenderer  = queueRenderProgram(vertexPath, fragmentPath);
+	objectRenderer = queueRenderProgram("render2d/object_vert.glsl", "render2d/object_frag.glsl");
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -109,7 +226,10 @@ void Parallel::initRenderer(const char *vertexPath, const char *fragmentPath)
 
 void Parallel::render()
 {
+	finishShaders();
+
 	// render particles
+	profiler.begin("render");
 	glUseProgram(fluidRenderer);
 
 	glBindVertexArray(VAO);
@@ -127,6 +247,7 @@ void Parallel::render()
 	// Bind SSBOs directly
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particleSlotSSBO);
 
 	// You don't even need VAO unless your shader requires it
 	glPointSize(10.0f);
@@ -134,209 +255,607 @@ void Parallel::render()
 
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, 0);
 
 	glBindVertexArray(0);
 
-	// render obstacle
-	if (!showObstacle) { glUseProgram(0); return; }
+	// render obstacles
+	if (!showObstacle) { profiler.end(); glUseProgram(0); return; }
 	
 	glUseProgram(objectRenderer);
 
 	// Send it to the shader
 	projLoc = glGetUniformLocation(objectRenderer, "uProjection");
 	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	GLint modelLoc = glGetUniformLocation(objectRenderer, "uModel");
 
+	// the outline never changes, only the model matrix
 	glBindVertexArray(objectVAO);
-    glDrawArrays(GL_LINE_STRIP, 0, 5);  // draw box outline
+	obstacles.update(simTime);
+	for (GLuint i = 0; i < obstacles.count(); i++) {
+		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(obstacles.model(i)));
+		glDrawArrays(GL_LINE_STRIP, 0, 5);  // draw box outline
+	}
     glBindVertexArray(0);
+	profiler.end();
 
 	glUseProgram(0);
 }
 
-void Parallel::compute()
+void Parallel::permuteBuffer(GLuint &buffer, GLuint &scratch, GLuint components)
 {
-	GLuint groups = (numParticles + 63) / 64;
+	GLuint groups = (numParticles + workgroupSize - 1) / workgroupSize;
 
-	// 1. apply external forces
-	glUseProgram(progApplyExtForces);
+	glUseProgram(progPermute);
+	// looked up on first use, the program may still be compiling at init
+	if (permuteComponentsLoc < 0) permuteComponentsLoc = glGetUniformLocation(progPermute, "components");
+	glUniform1ui(permuteComponentsLoc, components);
 
-	glUniform1f(glGetUniformLocation(progApplyExtForces, "dt"), dt);
-	glUniform1f(glGetUniformLocation(progApplyExtForces, "gravity"), gravity);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, permutationSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, scratch);
 
-	glUniform1f(glGetUniformLocation(progApplyExtForces, "mouseX"), mouseX);
-	glUniform1f(glGetUniformLocation(progApplyExtForces, "mouseY"), mouseY);
-	glUniform1f(glGetUniformLocation(progApplyExtForces, "mouseStrength"), mouseStrength);
-	glUniform1f(glGetUniformLocation(progApplyExtForces, "mouseRadius"), mouseRadius);
-	glUniform1i(glGetUniformLocation(progApplyExtForces, "isDown"), isDown ? 1 : 0);
-	glUniform1i(glGetUniformLocation(progApplyExtForces, "forceType"), forceType);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// the sorted copy becomes the live buffer, the old one is the next scratch
+	std::swap(buffer, scratch);
+}
+
+void Parallel::reorderParticles()
+{
+	GLuint groups = (numParticles + workgroupSize - 1) / workgroupSize;
+
+	// counting sort by Morton key: histogram, scan, scatter
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, keyCountSSBO);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUseProgram(progMortonKeys);
 
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, keySSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, keyCountSSBO);
 
 	glDispatchCompute(groups, 1, 1);
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-	
+	prims.exclusiveScan(keyCountSSBO, keyOffsetSSBO, numKeys);
+
+	glUseProgram(progMortonScatter);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, keySSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, keyOffsetSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, permutationSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particleIdSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, particleSlotSSBO);
+
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// gather every per-particle buffer into the new order, density and
+	// pressure are rebuilt before they are read again
+	permuteBuffer(posSSBO, scratchVec2SSBO, 2);
+	permuteBuffer(velSSBO, scratchVec2SSBO, 2);
+	permuteBuffer(particleIdSSBO, scratchFloatSSBO, 1);
+}
+
+bool Parallel::setParameter(const string &name, float value)
+{
+	if (name == "dt") fixedDt = dt = value;
+	else if (name == "gravity") gravity = value;
+	else if (name == "restDensity") restDensity = value;
+	else if (name == "smoothingRadius") smoothingRadius = value;
+	else if (name == "stiffness") stiffness = value;
+	else if (name == "eta") eta = value;
+	else if (name == "viscosityStrength") viscosityStrength = value;
+	else if (name == "maxIterations") maxIterations = (int)value;
+	else if (name == "cflNumber") cflNumber = value;
+	else if (name == "dtMin") dtMin = value;
+	else if (name == "dtMax") dtMax = value;
+	else return false;
+	return true;
+}
+
+void Parallel::readbackPositions(vector<vec2> &out)
+{
+	readbackParticles(posSSBO, out);
+}
+
+void Parallel::readbackVelocities(vector<vec2> &out)
+{
+	readbackParticles(velSSBO, out);
+}
+
+void Parallel::readbackParticles(GLuint buffer, vector<vec2> &out)
+{
+	std::vector<vec2> sorted(numParticles);
+	std::vector<GLuint> slots(numParticles);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * 2 * numParticles, sorted.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSlotSSBO);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * numParticles, slots.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// return in stable particle id order
+	out.resize(numParticles);
+	for (int id = 0; id < numParticles; id++)
+		out[id] = sorted[slots[id]];
+}
+
+bool Parallel::writeParticles(const vector<vec2> &positions, const vector<vec2> &velocities)
+{
+	if ((int)positions.size() != numParticles || (int)velocities.size() != numParticles) return false;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, posSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * 2 * numParticles, positions.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, velSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * 2 * numParticles, velocities.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// written in id order
+	resetParticleIds();
+	return true;
+}
+
+void Parallel::printMemoryReport()
+{
+	MemoryReport report;
+	report.add("pos", posSSBO);
+	report.add("vel", velSSBO);
+	report.add("density", densitySSBO);
+	report.add("pressure", pressureSSBO);
+	report.add("particleId", particleIdSSBO);
+	report.add("particleSlot", particleSlotSSBO);
+	report.add("key", keySSBO);
+	report.add("permutation", permutationSSBO);
+	report.add("scratchVec2", scratchVec2SSBO);
+	report.add("scratchFloat", scratchFloatSSBO);
+	report.add("keyCount", keyCountSSBO, false);
+	report.add("keyOffset", keyOffsetSSBO, false);
+	report.add("params", paramsUBO, false);
+	report.add("dispatchArgs", dispatchArgs, false);
+	report.print(numParticles);
+}
+
+void Parallel::dispatchIteration(GLuint groups)
+{
+	if (convergenceMode == GPU_INDIRECT)
+		glDispatchComputeIndirect(0);
+	else
+		glDispatchCompute(groups, 1, 1);
+}
+
+void Parallel::recordIterations(int iterations)
+{
+	lastIterations = iterations;
+	profiler.recordIterations(iterations);
+	iterationTotal += iterations;
+	iterationSteps++;
+}
+
+void Parallel::printConvergenceStats()
+{
+	const char *names[] = {"sync", "lagged", "gpu indirect"};
+	cout << "convergence " << names[convergenceMode]
+		 << ": " << getAverageIterations() << " iterations/step over "
+		 << iterationSteps << " steps (last " << lastIterations << ")" << endl;
+}
+
+glm::vec3 Parallel::kernelCoefficients() const
+{
+	float h = smoothingRadius;
+	return glm::vec3(6.0f / (M_PI * pow(h, 4.0f)),
+					 -12.0f / (M_PI * pow(h, 4.0f)),
+					 4.0f / (M_PI * pow(h, 8.0f)));
+}
+
+ShaderDefines Parallel::shaderDefines(bool kernel) const
+{
+	ShaderDefines defines;
+	defines.set("LOCAL_SIZE_X", (int)workgroupSize);
+	if (!kernel || !specializeKernels) return defines;
+
+	glm::vec3 coeffs = kernelCoefficients();
+	defines.set("KERNEL_H", smoothingRadius);
+	defines.set("DENSITY_COEFF", coeffs.x);
+	defines.set("GRAD_COEFF", coeffs.y);
+	defines.set("VISCOSITY_COEFF", coeffs.z);
+	return defines;
+}
+
+void Parallel::updateSimParams()
+{
+	SimParams params = {};
+
+	params.boundsMin = glm::vec2(boundsMin.x, boundsMin.y);
+	params.boundsMax = glm::vec2(boundsMax.x, boundsMax.y);
+	params.restitution = 0.2f;  // adjust bounce
+
+	params.mousePos = glm::vec2(mouseX, mouseY);
+	params.mouseStrength = mouseStrength;
+	params.mouseRadius = mouseRadius;
+	params.isDown = isDown ? 1 : 0;
+	params.forceType = forceType;
+
+	params.gridDims = reorderDims;
+	params.cellSize = smoothingRadius;
+	params.numParticles = numParticles;
+
+	params.dt = dt;
+	params.gravity = gravity;
+	params.restDensity = restDensity;
+	params.smoothingRadius = smoothingRadius;
+	params.stiffness = stiffness;
+	params.viscosityStrength = viscosityStrength;
+	params.eta = eta;
+
+	// kernel normalizations
+	glm::vec3 coeffs = kernelCoefficients();
+	params.densityCoeff = coeffs.x;
+	params.gradCoeff = coeffs.y;
+	params.viscosityCoeff = coeffs.z;
 
 	// delta
-	float sumGradSquared = 24.0f / (M_PI * pow(smoothingRadius, 4.0f));
+	float h = smoothingRadius;
+	float sumGradSquared = 24.0f / (M_PI * pow(h, 4.0f));
 	float beta = 2.0f * dt * dt / (restDensity * restDensity);
-	float delta = 1.0f / (beta * sumGradSquared);
+	params.delta = 1.0f / (beta * sumGradSquared);
+
+	// skip the upload on steps where nothing changed
+	if (paramsUploaded && memcmp(&params, &uploadedParams, sizeof(SimParams)) == 0)
+		return;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, paramsUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SimParams), &params);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	uploadedParams = params;
+	paramsUploaded = true;
+}
+
+void Parallel::queueMaxSpeed()
+{
+	// one fenced copy in flight at a time, so a slow GPU can't starve it
+	if (speedReadback.pending(0)) return;
+
+	prims.reduce(velSSBO, numParticles, GPUPrimitives::MAXLENGTH, maxSpeed, 0, 2, 0, 0.0f, 2);
+	speedReadback.capture(0, maxSpeed, 0, sizeof(float));
+}
+
+void Parallel::updateTimestep()
+{
+	// keep the current dt until the previous step's max speed has landed
+	if (!speedReadback.ready(0)) return;
+	float speed = *(const float *)speedReadback.wait(0);
+
+	// CFL limit, plus a gravity limit for when the fluid is at rest
+	float target = dtMax;
+	if (speed > 0.0f) target = min(target, cflNumber * smoothingRadius / speed);
+	target = min(target, 0.25f * sqrt(smoothingRadius / gravity));
+
+	// shrink right away, grow gradually
+	dt = max(dtMin, min(target, dt * dtGrowth));
+}
+
+void Parallel::compute()
+{
+	// first use of the queued programs, a no-op once they are checked
+	finishShaders();
+
+	GLuint groups = (numParticles + workgroupSize - 1) / workgroupSize;
+
+	// pick this step's dt before the parameters are uploaded
+	if (adaptiveDt) updateTimestep();
+	else dt = fixedDt;
+
+	updateSimParams();
+
+	profiler.beginFrame();
+
+	// 0. periodically restore spatial locality of the particle storage
+	if (doReorder && (stepCount % reorderInterval) == 0) {
+		profiler.begin("reorder");
+		reorderParticles();
+	}
+	stepCount++;
+
+	// 1. apply external forces
+	profiler.begin("extForces");
+	glUseProgram(progApplyExtForces);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
+
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	profiler.end();
 
 	// 2. Compute Densities + Pressures
 	int iter = 0;
-	float maxDensityErrorFloat = 999.0f;
-	int maxIterations = 8;
+	bool converged = false;
 
-	std::vector<float> zeros(numParticles, 0.0f);
+	// zero out pressure on the GPU
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pressureSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * numParticles, zeros.data());
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-	while ((maxDensityErrorFloat > eta) && (iter < maxIterations))
-	{
-		// reset maxDensityError to zero on GPU
-		float zero = 0.0f;
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxDensityError);
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float), &zero);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (convergenceMode == GPU_INDIRECT) {
+		// previous step's iteration count, if its copy has landed
+		if (iterationReadback.ready(0))
+			recordIterations(*(const GLuint *)iterationReadback.wait(0));
 
+		GLuint args[10] = {groups, 1, 1, 0, GPUPrimitives::reduceGroups(numParticles), 1, 1, 1, 1, 1};
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dispatchArgs);
+		glBufferSubData(GL_DISPATCH_INDIRECT_BUFFER, 0, sizeof(args), args);
+	}
+
+	while (!converged && (iter < maxIterations))
+	{
 		// 2a: compute densities and pressures
+		profiler.begin("densities");
 		glUseProgram(progComputeDensities);
 
-		glUniform1f(glGetUniformLocation(progComputeDensities, "dt"), dt);
-		glUniform1f(glGetUniformLocation(progComputeDensities, "restDensity"), restDensity);
-		glUniform1f(glGetUniformLocation(progComputeDensities, "smoothingRadius"), smoothingRadius);
-		glUniform1f(glGetUniformLocation(progComputeDensities, "delta"), delta);
-		glUniform1ui(glGetUniformLocation(progComputeDensities, "numParticles"), numParticles);
-
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, predPosSSBO);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, predVelSSBO);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, pressureSSBO);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, densitySSBO);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, maxDensityError);
 
-		glDispatchCompute(groups, 1, 1);
+		dispatchIteration(groups);
 		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-		// read back maxDensityError from GPU
-		uint32_t maxDensityErrorUint = 0;
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxDensityError);
-		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t), &maxDensityErrorUint);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-		std::memcpy(&maxDensityErrorFloat, &maxDensityErrorUint, sizeof(float));
+		// max |density - restDensity| into maxDensityError
+		profiler.begin("densityError");
+		// zeroed with the kernels' dispatches once converged in GPU_INDIRECT mode
+		GLintptr reduceArgs = convergenceMode == GPU_INDIRECT ? 4 * sizeof(GLuint) : -1;
+		prims.reduce(densitySSBO, numParticles, GPUPrimitives::MAXABS, maxDensityError, 0, 1, 0, restDensity, 1,
+					 reduceArgs);
+
+		float maxDensityErrorFloat = 0.0f;
+		if (convergenceMode == SYNC) {
+			// read back maxDensityError from GPU, stalls until the pass is done
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxDensityError);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float), &maxDensityErrorFloat);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		} else if (convergenceMode == LAGGED && iter + 1 < maxIterations) {
+			// fenced copy, looked at after the next iteration is queued
+			errorReadback.capture(iter % 2, maxDensityError, 0, sizeof(float));
+		}
 
 		// 2b: apply pressure corrections
+		profiler.begin("pressures");
 		glUseProgram(progApplyPressures);
 
-		glUniform1f(glGetUniformLocation(progApplyPressures, "dt"), dt);
-		glUniform1f(glGetUniformLocation(progApplyPressures, "restDensity"), restDensity);
-		glUniform1f(glGetUniformLocation(progApplyPressures, "stiffness"), stiffness);
-		glUniform1f(glGetUniformLocation(progApplyPressures, "smoothingRadius"), smoothingRadius);
-		glUniform1ui(glGetUniformLocation(progApplyPressures, "numParticles"), numParticles);
-
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, pressureSSBO);
 
-		glDispatchCompute(groups, 1, 1);
+		dispatchIteration(groups);
 		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
 		// 2c: apply viscosity forces
+		profiler.begin("viscosity");
 		glUseProgram(progApplyViscosity);
-		glUniform1f(glGetUniformLocation(progApplyViscosity, "viscosityStrength"), viscosityStrength);
-		glUniform1f(glGetUniformLocation(progApplyViscosity, "smoothingRadius"), smoothingRadius);
-		glUniform1ui(glGetUniformLocation(progApplyViscosity, "numParticles"), numParticles);
 
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
 		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
 
-		glDispatchCompute(groups, 1, 1);
+		dispatchIteration(groups);
 		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-		iter++;
-	}
-
-	if (!showObstacle) return;
-
-	// 3: resolve collisions
-	glUseProgram(progResolveCollisions); 
+		if (convergenceMode == GPU_INDIRECT) {
+			profiler.begin("convergence");
+			glUseProgram(progConvergence);
 
-	glUniform2f(glGetUniformLocation(progResolveCollisions, "boxMin"), objectCenter.x - 0.5f * objectStretch.x, objectCenter.y - 0.5f * objectStretch.y);
-	glUniform2f(glGetUniformLocation(progResolveCollisions, "boxMax"), objectCenter.x + 0.5f * objectStretch.x, objectCenter.y + 0.5f * objectStretch.y);
-	glUniform1f(glGetUniformLocation(progResolveCollisions, "restitution"), 0.2f);  // adjust bounce
-	glUniform1ui(glGetUniformLocation(progResolveCollisions, "numParticles"), numParticles);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, maxDensityError);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, dispatchArgs);
 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
+			glDispatchCompute(1, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+		}
+		profiler.end();
 
-	glDispatchCompute(groups, 1, 1);
-	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-}
+		iter++;
 
-void Parallel::resetParticles() {
-	float *positions = new float[2 * numParticles];
-	float *velocities = new float[2 * numParticles];
+		if (convergenceMode == SYNC) {
+			converged = maxDensityErrorFloat <= eta;
+		} else if (convergenceMode == LAGGED && iter >= 2) {
+			// error of the iteration before the one just queued
+			converged = *(const float *)errorReadback.wait(iter % 2) <= eta;
+		}
+	}
 
-	int width = (int)sqrt(numParticles);
-	int height = (numParticles + width - 1) / width; // ceil division
-	float spacing = 5.0f;  // use reasonable pixel spacing
+	if (convergenceMode == GPU_INDIRECT) {
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+		iterationReadback.capture(0, dispatchArgs, 3 * sizeof(GLuint), sizeof(GLuint));
+	} else {
+		recordIterations(iter);
+	}
 
-	for (int i = 0; i < numParticles; i++) {
-		float gridWidth = width * spacing;
-		float gridHeight = height * spacing;
-		float offsetX = (xScreenRes - gridWidth) / 2.0f;
-		float offsetY = (yScreenRes - gridHeight) / 2.0f;
+	// 3: resolve collisions
+	if (showObstacle && obstacles.count()) {
+		profiler.begin("collisions");
+		glUseProgram(progResolveCollisions); 
 
-		float x = (i % width) * spacing + offsetX;
-		float y = (i / width) * spacing + offsetY;
+		// boxes where they are at the end of the step
+		obstacles.update(simTime + dt);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
+		obstacles.bind(6);
+		glUniform1ui(glGetUniformLocation(progResolveCollisions, "numBoxes"), obstacles.count());
 
-		positions[2 * i + 0] = x;
-		positions[2 * i + 1] = y;
+		glDispatchCompute(groups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		profiler.end();
+	}
 
-		velocities[2 * i + 0] = 0.0f;
-		velocities[2 * i + 1] = 0.0f;
+	simTime += dt;
+	if (adaptiveDt) {
+		profiler.begin("maxSpeed");
+		queueMaxSpeed();
+		profiler.end();
 	}
 
-	// Overwrite GPU buffers with fresh data
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, posSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * 2 * numParticles, positions);
+	if (trajectory.isOpen()) {
+		profiler.begin("export");
+		GLuint buffers[] = { posSSBO, velSSBO, particleIdSSBO };
+		trajectory.step(simTime, buffers);
+		profiler.end();
+	}
+}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, velSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * 2 * numParticles, velocities);
+bool Parallel::startTrajectory(const char *path, int every)
+{
+	stopTrajectory();
+	trajectory.every = max(every, 1);
+	trajectory.addStream("pos", sizeof(float) * 2 * numParticles);
+	trajectory.addStream("vel", sizeof(float) * 2 * numParticles);
+	// storage is reordered, particleId[slot] maps each entry back to its id
+	trajectory.addStream("particleId", sizeof(GLuint) * numParticles);
+	return trajectory.open(path, 2, numParticles);
+}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, predPosSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * 2 * numParticles, positions);
+void Parallel::stopTrajectory()
+{
+	if (!trajectory.isOpen()) return;
+	trajectory.close();
+	trajectory.printStats();
+}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, predVelSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * 2 * numParticles, velocities);
+// everything on the CPU side that the step depends on
+struct CheckpointState {
+	float fixedDt, dt;
+	double simTime;
+	int stepCount;
+	int maxIterations;
+	float gravity, restDensity, smoothingRadius, stiffness, eta, viscosityStrength;
+	float cflNumber, dtMin, dtMax, dtGrowth;
+	int adaptiveDt;
+	int showObstacle;
+	double obstacleStart;
+};
+
+bool Parallel::saveCheckpoint(const char *path)
+{
+	CheckpointState state;
+	state.fixedDt = fixedDt;
+	state.dt = dt;
+	state.simTime = simTime;
+	state.stepCount = stepCount;
+	state.maxIterations = maxIterations;
+	state.gravity = gravity;
+	state.restDensity = restDensity;
+	state.smoothingRadius = smoothingRadius;
+	state.stiffness = stiffness;
+	state.eta = eta;
+	state.viscosityStrength = viscosityStrength;
+	state.cflNumber = cflNumber;
+	state.dtMin = dtMin;
+	state.dtMax = dtMax;
+	state.dtGrowth = dtGrowth;
+	state.adaptiveDt = adaptiveDt;
+	state.showObstacle = showObstacle;
+	state.obstacleStart = obstacles.startTime;
+
+	GLsizeiptr vecBytes = sizeof(float) * 2 * numParticles;
+
+	// storage is in reordered slots, so the id lookups go along with it.
+	// Density and pressure are rebuilt from scratch every step.
+	// the boxes with their paths, which the scene may have changed
+	std::vector<char> boxes;
+	obstacles.save(boxes);
+
+	CheckpointWriter writer(2, numParticles);
+	writer.addData("state", &state, sizeof(state));
+	writer.addData("boxes", boxes.data(), boxes.size());
+	writer.addBuffer("pos", posSSBO, vecBytes);
+	writer.addBuffer("vel", velSSBO, vecBytes);
+	writer.addBuffer("particleId", particleIdSSBO, sizeof(GLuint) * numParticles);
+	writer.addBuffer("particleSlot", particleSlotSSBO, sizeof(GLuint) * numParticles);
+	return writer.save(path);
+}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, densitySSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+bool Parallel::loadCheckpoint(const char *path)
+{
+	CheckpointReader reader;
+	if (!reader.open(path)) return false;
+
+	CheckpointState state;
+	if (reader.dim() != 2 || reader.numParticles() != numParticles || !reader.read("state", state)) {
+		cout << path << " does not match this simulation (" << reader.dim() << "D, "
+			 << reader.numParticles() << " particles)" << endl;
+		return false;
+	}
+	// the reorder grid is sized from the smoothing radius at init
+	if (state.smoothingRadius != smoothingRadius) {
+		cout << path << " was saved with smoothingRadius " << state.smoothingRadius << endl;
+		return false;
+	}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pressureSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+	GLsizeiptr vecBytes = sizeof(float) * 2 * numParticles;
+	bool ok = reader.upload("pos", posSSBO, vecBytes)
+		&& reader.upload("vel", velSSBO, vecBytes)
+		&& reader.upload("particleId", particleIdSSBO, sizeof(GLuint) * numParticles)
+		&& reader.upload("particleSlot", particleSlotSSBO, sizeof(GLuint) * numParticles);
+	if (!ok) return false;
+
+	size_t boxBytes;
+	const void *boxes = reader.section("boxes", boxBytes);
+	if (!boxes || !obstacles.load(boxes, boxBytes)) {
+		cout << path << " has no valid box table" << endl;
+		return false;
+	}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	fixedDt = state.fixedDt;
+	dt = state.dt;
+	simTime = state.simTime;
+	stepCount = state.stepCount;
+	maxIterations = state.maxIterations;
+	gravity = state.gravity;
+	restDensity = state.restDensity;
+	stiffness = state.stiffness;
+	eta = state.eta;
+	viscosityStrength = state.viscosityStrength;
+	cflNumber = state.cflNumber;
+	dtMin = state.dtMin;
+	dtMax = state.dtMax;
+	dtGrowth = state.dtGrowth;
+	adaptiveDt = state.adaptiveDt;
+	showObstacle = state.showObstacle;
+	obstacles.startTime = state.obstacleStart;
+
+	// drop a max speed still in flight from before the load
+	if (speedReadback.pending(0)) speedReadback.wait(0);
+	return true;
+}
 
-	delete[] positions;
-	delete[] velocities;
+void Parallel::resetParticles() {
+	// the startup block again, written over the current particles
+	vector<vec2> positions(numParticles);
+	vector<vec2> velocities(numParticles);
+	generateParticles(positions, velocities);
+	writeParticles(positions, velocities);
 }
 
 void Parallel::initObject() {
 
-	objectCenter = vec2(1028.0f / 2.0f + 200.0f, 768.0f / 2.0f - 100.0f);
-	objectStretch = vec2(150.0f, 400.0f);
+	// a static 150 x 400 wall right of center, z is unused in 2D
+	obstacles.add(glm::vec3(1028.0f / 2.0f + 200.0f, 768.0f / 2.0f - 100.0f, 0.0f),
+				  glm::vec3(75.0f, 200.0f, 1.0f));
 
 	float object[] = {
-		objectCenter.x - 0.5f * objectStretch.x, objectCenter.y - 0.5f * objectStretch.y,
-		objectCenter.x + 0.5f * objectStretch.x, objectCenter.y - 0.5f * objectStretch.y,
-		objectCenter.x + 0.5f * objectStretch.x, objectCenter.y + 0.5f * objectStretch.y,
-		objectCenter.x - 0.5f * objectStretch.x, objectCenter.y + 0.5f * objectStretch.y,
-		objectCenter.x - 0.5f * objectStretch.x, objectCenter.y - 0.5f * objectStretch.y
+		-1.0f, -1.0f,
+		 1.0f, -1.0f,
+		 1.0f,  1.0f,
+		-1.0f,  1.0f,
+		-1.0f, -1.0f
 	};
 	
 	glGenVertexArrays(1, &objectVAO);
@@ -350,4 +869,6 @@ void Parallel::initObject() {
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
     glBindVertexArray(0);
-}
\ No newline at end of file
+}
+
+} // namespace sph2d
@@ -5,9 +5,30 @@
 
 #include "SETTINGS.h"
 #include "SHADER.h"
+#include "PRIMITIVES.h"
+#include "READBACK.h"
+#include "PROFILER.h"
+#include "TRAJECTORY.h"
+#include "KINEMATIC.h"
 
 using namespace std;
 
+// both solvers name their class Parallel, the namespace lets the headless
+// runner link them into one binary
+namespace sph2d {
+
+// std140 mirror of the SimParams uniform block in compute2d/params.glsl
+struct SimParams {
+	glm::vec2 boundsMin;     glm::vec2 boundsMax;
+	glm::vec2 mousePos;      float mouseStrength;   float mouseRadius;
+	glm::ivec2 gridDims;     float cellSize;        GLuint numParticles;
+	float dt;                float gravity;         float restDensity;    float smoothingRadius;
+	float stiffness;         float delta;           float viscosityStrength; float eta;
+	float densityCoeff;      float gradCoeff;       float viscosityCoeff; float restitution;
+	int isDown;              int forceType;         int pad[2];
+};
+static_assert(sizeof(SimParams) == 112, "SimParams must match the std140 block");
+
 // Particle structure
 class Parallel
 {
@@ -19,11 +40,14 @@ public:
 	void initParticlesAndProgram();
 	void initComputeShaders(float *positions, float *velocities);
 	void initRenderer(const char *vertexPath, const char *fragmentPath);
+	void initReorder();
 
 	// simulation
 	void render();
 	void compute();
 
+	float getDt() const { return dt; }
+
 	// interaction functions
 	void injectForce(float x, float y, int pressed, int sign) { mouseX = x; 
 																mouseY = y; 
@@ -31,15 +55,72 @@ public:
 																forceType = sign; };
 	void resetParticles();
 
-	// obstacle
-	enum DIR { LEFT, DOWN, RIGHT, UP };
+	// set a simulation parameter by name, false if the name is unknown.
+	// Call before init, the reorder grid is sized from smoothingRadius.
+	bool setParameter(const string &name, float value);
+
+	// spatial reordering, sorts particle storage by Morton cell key every
+	// reorderInterval steps; ids stay stable through the slot lookup
+	bool doReorder = true;
+	int reorderInterval = 100;
+	void reorderParticles();
+	void readbackPositions(vector<vec2> &out);
+	void readbackVelocities(vector<vec2> &out);
+
+	// overwrite the particle state, in particle id order. False, with
+	// nothing written, if either vector doesn't hold numParticles.
+	bool writeParticles(const vector<vec2> &positions, const vector<vec2> &velocities);
+
+	// bytes per particle and the total size of the solver's buffers
+	void printMemoryReport();
+
+	// full state checkpoint, see CHECKPOINT.h. A checkpoint only loads into
+	// a simulation with the same particle count and smoothing radius.
+	bool saveCheckpoint(const char *path);
+	bool loadCheckpoint(const char *path);
+
+	// PCISPH convergence check. SYNC reads the density error back every
+	// iteration, LAGGED reads it through a fenced copy and decides one
+	// iteration late, GPU_INDIRECT lets the GPU zero the remaining dispatches
+	enum CONVERGENCE { SYNC, LAGGED, GPU_INDIRECT };
+	CONVERGENCE convergenceMode = GPU_INDIRECT;
+	int getLastIterations() const { return lastIterations; }
+	float getAverageIterations() const { return iterationSteps ? (float)iterationTotal / iterationSteps : 0.0f; }
+	void resetConvergenceStats() { iterationTotal = 0; iterationSteps = 0; }
+	void printConvergenceStats();
+
+	// compile the neighbor kernels with the smoothing radius and kernel
+	// coefficients baked in as literals. Set before init; a specialized
+	// solver can't change smoothingRadius afterwards.
+	bool specializeKernels = true;
+
+	// per-stage GPU timings of compute() and render(), off until enabled
+	GPUProfiler profiler;
+
+	// trajectory export, writes pos, vel and the slot->id map every Kth step
+	// from a background thread without stalling the step
+	TrajectoryWriter trajectory;
+	bool startTrajectory(const char *path, int every);
+	void stopTrajectory();
+
+	// adaptive timestep. dt follows a CFL limit on the fastest particle, which
+	// is read back through a fence a step or two late, clamped to
+	// [dtMin, dtMax] and allowed to grow by at most dtGrowth per step.
+	// When off the fixed dt is used.
+	bool adaptiveDt = false;
+	float cflNumber = 0.4f;
+	float dtMin = 1.0f/240.0f;
+	float dtMax = 1.0f/15.0f;
+	float dtGrowth = 1.2f;
+	double getSimTime() const { return simTime; }
+
+	// obstacles. initObject uploads the square outline and adds the default
+	// box; more boxes and their paths go through obstacles (KINEMATIC.h).
+	// showObstacle switches collisions and drawing for all of them.
 	bool showObstacle = false;
-	bool loopObstacle = false;
 	void initObject();
-	void moveObjectX(float delta) { objectCenter += vec2(delta, 0.0); initObject(); };
-	void moveObjectY(float delta) { objectCenter += vec2(0.0, delta); initObject(); };
-	void setObject(vec2 pos) { objectCenter = pos; currentDir = LEFT; };
-	void loopObject();
+	KinematicObstacles obstacles;
+	void restartObstacles() { obstacles.restart(simTime); }
 
 private:
 	// openGL screen
@@ -47,32 +128,47 @@ private:
 	int yScreenRes = 768;
 
 	// simulation bounds
-	vec2 boundsMin;
-	vec2 boundsMax;
+	vec2 boundsMin = vec2(0.0, 0.0);
+	vec2 boundsMax = vec2(1024.0, 768.0);
 
 	// SSBOs
-	GLuint posSSBO, velSSBO;
-	GLuint predPosSSBO, predVelSSBO;
-	GLuint densitySSBO, pressureSSBO;
-	GLuint maxDensityError;
+	// predicted positions are x + dt * v computed on the fly, and density and
+	// pressure are rebuilt every step, so only pos, vel and the ids persist
+	GLuint posSSBO = 0, velSSBO = 0;
+	GLuint densitySSBO = 0, pressureSSBO = 0;
+	GLuint maxDensityError = 0;
+
+	// reordering buffers, scratch buffers are swapped with the sorted ones
+	GLuint keySSBO = 0, keyCountSSBO = 0, keyOffsetSSBO = 0, permutationSSBO = 0;
+	GLuint particleIdSSBO = 0, particleSlotSSBO = 0;
+	GLuint scratchVec2SSBO = 0, scratchFloatSSBO = 0;
+	glm::ivec2 reorderDims;
+	GLuint numKeys = 0;
+	int stepCount = 0;
 
 	// compute shader programs (in order)
-	GLuint progApplyExtForces; 
-	GLuint progComputeDensities;
-	GLuint progApplyPressures;
-	GLuint progApplyViscosity;
-	GLuint progResolveCollisions;
+	GLuint progApplyExtForces = 0;
+	GLuint progComputeDensities = 0;
+	GLuint progApplyPressures = 0;
+	GLuint progApplyViscosity = 0;
+	GLuint progResolveCollisions = 0;
+	GLuint progMortonKeys = 0, progMortonScatter = 0, progPermute = 0;
+
+	// scan, sort and reduction programs
+	GPUPrimitives prims;
 
 	// renderer
-	GLuint fluidRenderer, objectRenderer;
-	GLuint VAO;
-	GLuint objectVAO, objectVBO; 
+	GLuint fluidRenderer = 0, objectRenderer = 0;
+	GLuint VAO = 0;
+	GLuint objectVAO = 0, objectVBO = 0;	// unit square, placed per box by the model matrix
 
 	int numParticles;
 
 	// 2d sim parameters
 	int maxIterations = 8;
-	float dt = 1.0f/60.0f;
+	float fixedDt = 1.0f/60.0f;
+	float dt = fixedDt;
+	double simTime = 0.0;
 	float gravity = 120.0f;
 	float restDensity = 0.02f;
 	float smoothingRadius = 40.0f;
@@ -80,11 +176,6 @@ private:
 	float eta = 0.01f;
 	float viscosityStrength = 0.9;
 
-	// obstacles
-	vec2 objectStretch = vec2(0.5, 0.75);
-	vec2 objectCenter = vec2(0.5, 0.5);
-	DIR currentDir = LEFT;
-
 	// mouse forces
 	float mouseStrength = 3000.0;
 	float mouseRadius = 200.0;
@@ -93,6 +184,45 @@ private:
 	float mouseX = 0.0f;
 	float mouseY = 0.0f;
 	int forceType = 1;
+
+	// parameter uniform buffer, re-uploaded only when a value changes
+	GLuint paramsUBO = 0;
+	SimParams uploadedParams;
+	bool paramsUploaded = false;
+	GLint permuteComponentsLoc = -1;
+	void updateSimParams();
+
+	// threads per workgroup of the particle kernels, injected as LOCAL_SIZE_X
+	GLuint workgroupSize = 64;
+	glm::vec3 kernelCoefficients() const;
+	ShaderDefines shaderDefines(bool kernel) const;
+
+	// startup: programs are queued while worker threads fill the particles
+	void queuePrograms();
+	void generateParticles(vector<vec2> &positions, vector<vec2> &velocities) const;
+
+	void resetParticleIds();
+	void readbackParticles(GLuint buffer, vector<vec2> &out);
+	void permuteBuffer(GLuint &buffer, GLuint &scratch, GLuint components);
+
+	// convergence readback and GPU-driven dispatch sizes
+	AsyncReadback errorReadback, iterationReadback;
+	GLuint dispatchArgs = 0;
+	GLuint progConvergence = 0;
+	int lastIterations = 0;
+	long iterationTotal = 0;
+	long iterationSteps = 0;
+
+	void dispatchIteration(GLuint groups);
+	void recordIterations(int iterations);
+
+	// max particle speed for the adaptive timestep
+	GLuint maxSpeed = 0;
+	AsyncReadback speedReadback;
+	void queueMaxSpeed();
+	void updateTimestep();
 };
 
+} // namespace sph2d
+
 #endif
\ No newline at end of file
@@ -1,11 +1,36 @@
 #include "PARTICLE_3D.h"
 #include "SPHERE.h"
+#include "CHECKPOINT.h"
+#include "THREADS.h"
+
+#include <cstring>
+#include <thread>
+
+namespace sph3d {
 
 Parallel::Parallel(int num)
 {
 	numParticles = num;
 }
 
+Parallel::~Parallel()
+{
+	// names that were never generated are 0, which the deletes skip
+	GLuint buffers[] = {
+		posSSBO, velSSBO, densitySSBO, pressureSSBO, nextPosSSBO, maxDensityError, maxSpeed,
+		cellCountSSBO, cellStartSSBO, cellEndSSBO, sortedIndexSSBO, paramsUBO, dispatchArgs,
+		boundVBO, boundEBO, sphereVBO, sphereEBO, objectVBO, meshVBO, meshEBO };
+	glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+
+	GLuint arrays[] = { boundVAO, particleVAO, objectVAO, meshVAO };
+	glDeleteVertexArrays(sizeof(arrays) / sizeof(arrays[0]), arrays);
+
+	// the compute programs belong to the shader variant cache, only the
+	// render programs are linked for this solver alone
+	GLuint programs[] = { boundRenderer, fluidRenderer, impostorRenderer, objectRenderer };
+	for (GLuint program : programs) glDeleteProgram(program);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // screen functions
 ///////////////////////////////////////////////////////////////////////
@@ -88,7 +113,6 @@ void Parallel::initSimBounds()
 
 	glGenVertexArrays(1, &boundVAO);
 	glGenBuffers(1, &boundVBO);
-	GLuint boundEBO;
 	glGenBuffers(1, &boundEBO);
 
 	glBindVertexArray(boundVAO);
@@ -108,12 +132,9 @@ void Parallel::initSimBounds()
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
-void Parallel::initParticleAndPrograms()
+void Parallel::generateParticles(vector<glm::vec4> &positions, vector<glm::vec4> &velocities, float lift) const
 {
-	std::vector<glm::vec4> positions(numParticles);
-	std::vector<glm::vec4> velocities(numParticles);
-
-	// generate a grid cube of initial positions
+	// grid cube of initial positions
 	int width = static_cast<int>(round(pow(numParticles, 1.0 / 3.0)));
 	int height = width;
 	int depth = (numParticles - 1) / (width * height) + 1;
@@ -127,31 +148,61 @@ void Parallel::initParticleAndPrograms()
 	float offsetY = -gridHeight / 2.0f;
 	float offsetZ = -gridDepth / 2.0f;
 
-	for (int i = 0; i < numParticles; i++)
-	{
-		int xi = i % width;
-		int yi = (i / width) % height;
-		int zi = i / (width * height);
+	parallelFor(numParticles, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+		{
+			int xi = i % width;
+			int yi = (i / width) % height;
+			int zi = i / (width * height);
 
-		float x = (xi + 0.5f) * spacing + offsetX;
-		float y = (yi + 0.5f) * spacing + offsetY;
-		float z = (zi + 0.5f) * spacing + offsetZ;
+			float x = (xi + 0.5f) * spacing + offsetX;
+			float y = (yi + 0.5f) * spacing + offsetY;
+			float z = (zi + 0.5f) * spacing + offsetZ;
 
-		positions[i] = glm::vec4(x, y, z, 1.0f) + glm::vec4(0.5, 0.0, 0.0, 0.0);
-		velocities[i] = glm::vec4(0.0f);
-	}
+			positions[i] = glm::vec4(x, y, z, 1.0f) + glm::vec4(0.5, lift, 0.0, 0.0);
+			velocities[i] = glm::vec4(0.0f);
+		}
+	});
+}
+
+void Parallel::queuePrograms()
+{
+	progApplyExtForces = queueComputeShader("compute3d/extForces.glsl", shaderDefines(false));
+	progComputeDensities = queueComputeShader("compute3d/computeDensities.glsl", shaderDefines(true));
+	progApplyPressures = queueComputeShader("compute3d/applyPressures.glsl", shaderDefines(true));
+	progApplyViscosity = queueComputeShader("compute3d/viscosity.glsl", shaderDefines(true));
+	progApplyPressureViscosity = queueComputeShader("compute3d/applyPressureViscosity.glsl", shaderDefines(true));
+	progResolveCollisions = queueComputeShader("compute3d/resolveCollisions.glsl", shaderDefines(false));
+	progSDFCollisions = queueComputeShader("compute3d/sdfCollisions.glsl", shaderDefines(false));
+	progConvergence = queueComputeShader("compute3d/convergence.glsl");
+	progGridHash = queueComputeShader("compute3d/gridHash.glsl", shaderDefines(false));
+	progGridScatter = queueComputeShader("compute3d/gridScatter.glsl", shaderDefines(false));
+	prims.init();
+}
+
+void Parallel::initParticleAndPrograms()
+{
+	// the initial conditions are filled on worker threads while this thread
+	// queues every compile; nothing waits on the driver until the first step
+	std::vector<glm::vec4> positions(numParticles);
+	std::vector<glm::vec4> velocities(numParticles);
+	std::thread fill([&] { generateParticles(positions, velocities); });
+	queuePrograms();
+	fill.join();
 
-	// initialize shader programs and ssbos
+	// initialize ssbos
 	initComputeShaders(positions, velocities);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, predPosSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, predVelSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, densitySSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, pressureSSBO);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, maxDensityError);
+	if (compactStorage) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, nextPosSSBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, densitySSBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, pressureSSBO);
+	}
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
+	initNeighborGrid();
+
 	// set up sphere mesh and vao for instanced rendering
 	std::vector<glm::vec3> sphereVerts;
 	std::vector<unsigned int> sphereIndices;
@@ -160,7 +211,6 @@ void Parallel::initParticleAndPrograms()
 	glGenVertexArrays(1, &particleVAO);
 	glBindVertexArray(particleVAO);
 
-	GLuint sphereVBO, sphereEBO;
 	glGenBuffers(1, &sphereVBO);
 	glGenBuffers(1, &sphereEBO);
 
@@ -181,44 +231,106 @@ void Parallel::initComputeShaders(std::vector<glm::vec4> positions, std::vector<
 {
 	glGenBuffers(1, &posSSBO);
 	glGenBuffers(1, &velSSBO);
-	glGenBuffers(1, &predPosSSBO);
-	glGenBuffers(1, &predVelSSBO);
-	glGenBuffers(1, &densitySSBO);
-	glGenBuffers(1, &pressureSSBO);
+	glGenBuffers(1, &maxDensityError);
+	glGenBuffers(1, &maxSpeed);
+
+	std::vector<GLuint> packedPos = packParticles(positions, true);
+	std::vector<GLuint> packedVel = packParticles(velocities, false);
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, posSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * numParticles, positions.data(), GL_STATIC_DRAW);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, particleBytes() * numParticles, packedPos.data(), GL_STATIC_DRAW);
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, velSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * numParticles, velocities.data(), GL_DYNAMIC_DRAW);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, particleBytes() * numParticles, packedVel.data(), GL_DYNAMIC_DRAW);
+
+	if (compactStorage) {
+		glGenBuffers(1, &nextPosSSBO);
+		glGenBuffers(1, &densitySSBO);
+		glGenBuffers(1, &pressureSSBO);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, nextPosSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, particleBytes() * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, densitySSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, pressureSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+	}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, predPosSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * numParticles, positions.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxDensityError);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float), nullptr, GL_DYNAMIC_DRAW);
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, predVelSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * numParticles, velocities.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxSpeed);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float), nullptr, GL_DYNAMIC_DRAW);
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, densitySSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// simulation parameters shared by every compute program
+	glGenBuffers(1, &paramsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, paramsUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(SimParams), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, paramsUBO);
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pressureSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+	profiler.init();
 
+	// dispatch arguments for GPU_INDIRECT mode: the iteration kernels, an
+	// executed-iteration counter and the two density error reduce passes
+	glGenBuffers(1, &dispatchArgs);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatchArgs);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 10, nullptr, GL_DYNAMIC_DRAW);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-	progApplyExtForces = createComputeShader("compute3d/extForces.glsl");
-	progComputeDensities = createComputeShader("compute3d/computeDensities.glsl");
-	progApplyPressures = createComputeShader("compute3d/applyPressures.glsl");
-	progApplyViscosity = createComputeShader("compute3d/viscosity.glsl");
-	progResolveCollisions = createComputeShader("compute3d/resolveCollisions.glsl");
+	errorReadback.init(sizeof(float), 2);
+	iterationReadback.init(sizeof(GLuint), 1);
+	speedReadback.init(sizeof(float), 1);
+}
+
+void Parallel::initNeighborGrid()
+{
+	// allocated for cells one smoothing radius wide, the padded cells of
+	// fitNeighborGrid never need more
+	cellSize = smoothingRadius;
+	gridDims = glm::ivec3(
+		(int)ceil((boundsMax.x - boundsMin.x) / cellSize),
+		(int)ceil((boundsMax.y - boundsMin.y) / cellSize),
+		(int)ceil((boundsMax.z - boundsMin.z) / cellSize));
+	numCells = gridDims.x * gridDims.y * gridDims.z;
+
+	glGenBuffers(1, &cellCountSSBO);
+	glGenBuffers(1, &cellStartSSBO);
+	glGenBuffers(1, &cellEndSSBO);
+	glGenBuffers(1, &sortedIndexSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellCountSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numCells, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellStartSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numCells, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellEndSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numCells, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortedIndexSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * numParticles, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, cellCountSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, cellStartSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, cellEndSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, sortedIndexSSBO);
 }
 
 void Parallel::initRenderer(const char *boundVertex, const char *boundFragment,
 							const char *fluidVertex, const char *fluidFragment)
 {
-	boundRenderer = createRenderProgram(boundVertex, boundFragment);
-	fluidRenderer = createRenderProgram(fluidVertex, fluidFragment);
-	objectRenderer = createRenderProgram("render3d/object_vert.glsl", "render3d/object_frag.glsl");
+	boundRenderer = queueRenderProgram(boundVertex, boundFragment);
+	// the sphere shaders read the particle buffers through storage.glsl
+	fluidRenderer = queueRenderProgram(fluidVertex, fluidFragment, shaderDefines(false));
+	impostorRenderer = queueRenderProgram("render3d/impostor_vert.glsl", "render3d/impostor_frag.glsl", shaderDefines(false));
+	objectRenderer = queueRenderProgram("render3d/object_vert.glsl", "render3d/object_frag.glsl");
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -227,6 +339,8 @@ void Parallel::initRenderer(const char *boundVertex, const char *boundFragment,
 
 void Parallel::render()
 {
+	finishShaders();
+
 	// create transformation matrices
 	glm::mat4 model = glm::mat4(1.0f);
 	model = glm::scale(model, glm::vec3(1.0f)); // scale to adjust cube size
@@ -245,6 +359,7 @@ void Parallel::render()
 	);
 
 	// RENDER BOUNDS
+	profiler.begin("render");
 	glUseProgram(boundRenderer);
 
 	// set uniforms
@@ -262,14 +377,15 @@ void Parallel::render()
 	glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
 
 	// RENDER FLUID
-	glUseProgram(fluidRenderer);
+	GLuint particleRenderer = impostorSpheres ? impostorRenderer : fluidRenderer;
+	glUseProgram(particleRenderer);
 
 	// set uniforms
-	modelLoc = glGetUniformLocation(fluidRenderer, "model");
-	viewLoc = glGetUniformLocation(fluidRenderer, "view");
-	projectionLoc = glGetUniformLocation(fluidRenderer, "projection");
-	GLint camLoc = glGetUniformLocation(fluidRenderer, "cameraPos");
-	GLint lightLoc = glGetUniformLocation(fluidRenderer, "lightPos");
+	modelLoc = glGetUniformLocation(particleRenderer, "model");
+	viewLoc = glGetUniformLocation(particleRenderer, "view");
+	projectionLoc = glGetUniformLocation(particleRenderer, "projection");
+	GLint camLoc = glGetUniformLocation(particleRenderer, "cameraPos");
+	GLint lightLoc = glGetUniformLocation(particleRenderer, "lightPos");
 
 	vec3 lightPos;
 	lightPos.x = camera.x * 0.7;
@@ -288,10 +404,13 @@ void Parallel::render()
 	glBindVertexArray(particleVAO);
 	// glPointSize(25.0f);
 	// glDrawArrays(GL_POINTS, 0, numParticles);
-	glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0, numParticles);
+	if (impostorSpheres)
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numParticles);
+	else
+		glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0, numParticles);
 
-	// RENDER OBSTACLE
-	if (!doObstacle) { glUseProgram(0); return; }
+	// RENDER OBSTACLES
+	if (!doObstacle) { profiler.end(); glUseProgram(0); return; }
 
 	glUseProgram(objectRenderer);
 
@@ -300,228 +419,747 @@ void Parallel::render()
 	viewLoc = glGetUniformLocation(objectRenderer, "view");
 	projectionLoc = glGetUniformLocation(objectRenderer, "projection");
 
-	glm::mat4 cubeModel = glm::mat4(1.0f); // centered at origin
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(cubeModel));
 	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
+	// the geometry never changes, only the model matrix
 	glBindVertexArray(objectVAO);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	obstacles.update(simTime);
+	for (GLuint i = 0; i < obstacles.count(); i++) {
+		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(obstacles.model(i)));
+		glDrawArrays(GL_TRIANGLES, 0, 36);
+	}
+	if (meshObstacle) {
+		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(obstacleModel));
+		glBindVertexArray(meshVAO);
+		glDrawElements(GL_TRIANGLES, (GLsizei)obstacleMesh.indices.size(), GL_UNSIGNED_INT, 0);
+	}
 	glBindVertexArray(0);
+	profiler.end();
 
 	glUseProgram(0);
 }
 
+glm::vec3 Parallel::kernelCoefficients() const
+{
+	// poly6 density, spiky gradient, viscosity laplacian
+	float h = smoothingRadius;
+	return glm::vec3(315.0f / (64.0f * M_PI * pow(h, 9.0f)),
+					 -45.0f / (M_PI * pow(h, 6.0f)),
+					 15.0f / (2.0f * M_PI * pow(h, 3.0f)));
+}
+
+// a GLSL vec3 constructor that round trips the floats
+static std::string vec3Literal(glm::vec3 v)
+{
+	char literal[96];
+	snprintf(literal, sizeof(literal), "vec3(%.9g, %.9g, %.9g)", v.x, v.y, v.z);
+	return literal;
+}
+
+ShaderDefines Parallel::shaderDefines(bool kernel) const
+{
+	ShaderDefines defines;
+	defines.set("LOCAL_SIZE_X", (int)workgroupSize);
+	if (compactStorage) {
+		glm::vec3 lo, hi;
+		storageBounds(lo, hi);
+		defines.set("COMPACT_STORAGE");
+		defines.set("STORAGE_MIN", vec3Literal(lo).c_str());
+		defines.set("STORAGE_MAX", vec3Literal(hi).c_str());
+	}
+	if (!kernel || !specializeKernels) return defines;
+
+	glm::vec3 coeffs = kernelCoefficients();
+	defines.set("KERNEL_H", smoothingRadius);
+	defines.set("DENSITY_COEFF", coeffs.x);
+	defines.set("GRAD_COEFF", coeffs.y);
+	defines.set("VISCOSITY_COEFF", coeffs.z);
+	return defines;
+}
+
+void Parallel::storageBounds(glm::vec3 &lo, glm::vec3 &hi) const
+{
+	// predicted positions aren't clamped, leave them a smoothing radius
+	lo = glm::vec3(boundsMin.x, boundsMin.y, boundsMin.z) - glm::vec3(smoothingRadius);
+	hi = glm::vec3(boundsMax.x, boundsMax.y, boundsMax.z) + glm::vec3(smoothingRadius);
+}
+
+// round to nearest, flushes denormals to zero like most GPUs do
+static GLuint floatToHalf(float value)
+{
+	GLuint bits;
+	memcpy(&bits, &value, sizeof(bits));
+	GLuint sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	if (exponent <= 0) return sign;
+	if (exponent >= 31) return sign | 0x7C00;
+	// a mantissa carry rolls into the exponent, which is still the right answer
+	return sign + (((GLuint)exponent << 10) | ((bits & 0x7FFFFF) >> 13)) + ((bits >> 12) & 1);
+}
+
+static float halfToFloat(GLuint half)
+{
+	GLuint sign = (half & 0x8000) << 16;
+	GLuint exponent = (half >> 10) & 0x1F;
+	GLuint bits = sign;
+	if (exponent == 31) bits |= 0x7F800000 | ((half & 0x3FF) << 13);
+	else if (exponent > 0) bits |= ((exponent - 15 + 127) << 23) | ((half & 0x3FF) << 13);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// CPU side of packPosition/packVelocity in compute3d/storage.glsl
+vector<GLuint> Parallel::packParticles(const vector<glm::vec4> &values, bool positions) const
+{
+	vector<GLuint> packed(numParticles * particleBytes() / sizeof(GLuint));
+	if (!compactStorage) {
+		memcpy(packed.data(), values.data(), particleBytes() * numParticles);
+		return packed;
+	}
+
+	glm::vec3 lo, hi;
+	storageBounds(lo, hi);
+	for (int i = 0; i < numParticles; i++) {
+		glm::vec3 v(values[i]);
+		if (positions) {
+			glm::vec3 t = glm::clamp((v - lo) / (hi - lo), 0.0f, 1.0f);
+			GLuint qx = (GLuint)round(t.x * 2097151.0f);
+			GLuint qy = (GLuint)round(t.y * 2097151.0f);
+			GLuint qz = (GLuint)round(t.z * 2097151.0f);
+			packed[2 * i] = qx | (qy << 21);
+			packed[2 * i + 1] = (qy >> 11) | (qz << 10);
+		} else {
+			packed[2 * i] = floatToHalf(v.x) | (floatToHalf(v.y) << 16);
+			packed[2 * i + 1] = floatToHalf(v.z);
+		}
+	}
+	return packed;
+}
+
+void Parallel::updateSimParams()
+{
+	SimParams params = {};
+
+	params.boundsMin = glm::vec3(boundsMin.x, boundsMin.y, boundsMin.z);
+	params.boundsMax = glm::vec3(boundsMax.x, boundsMax.y, boundsMax.z);
+	params.gridMin = params.boundsMin;
+	params.cellSize = cellSize;
+	params.gridDims = gridDims;
+	params.numParticles = numParticles;
+
+	params.restitution = 2.0f;
+
+	params.dt = dt;
+	params.gravity = gravity;
+	params.eta = eta;
+	params.restDensity = restDensity;
+	params.smoothingRadius = smoothingRadius;
+	params.stiffness = stiffness;
+	params.viscosityStrength = viscosityStrength;
+
+	// kernel normalizations
+	glm::vec3 coeffs = kernelCoefficients();
+	params.densityCoeff = coeffs.x;
+	params.gradCoeff = coeffs.y;
+	params.viscosityCoeff = coeffs.z;
+
+	float beta = 2.0f * dt * dt / (restDensity * restDensity);
+	float sumGradSquared = params.densityCoeff; // match your kernel
+	params.delta = 1.0f / (beta * sumGradSquared);
+
+	// skip the upload on steps where nothing changed
+	if (paramsUploaded && memcmp(&params, &uploadedParams, sizeof(SimParams)) == 0)
+		return;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, paramsUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SimParams), &params);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	uploadedParams = params;
+	paramsUploaded = true;
+}
+
+void Parallel::fitNeighborGrid()
+{
+	// every iteration moves the particles by dt * v and the density pass
+	// looks ahead by another dt * v. Cells one radius plus that reach wide keep
+	// every pair within the 27 cells around a particle. The max speed is a
+	// step old, hence the headroom. The pad is capped at gridPad, past it the
+	// grid is rebuilt every gridIterations iterations instead, so a fast
+	// transient doesn't inflate the search volume of every later step. Past a
+	// reach of one radius the step is far outside any CFL limit, the cap
+	// keeps an unstable run from collapsing the grid into a few cells.
+	float move = dt * (1.5f * lastMaxSpeed + gravity * dt);
+	float pad = gridPad * smoothingRadius;
+	gridIterations = maxIterations;
+	if (maxIterations * move > pad) gridIterations = max(1, (int)(pad / move));
+	cellSize = smoothingRadius + min(gridIterations * move, smoothingRadius);
+	gridDims = glm::ivec3(
+		(int)ceil((boundsMax.x - boundsMin.x) / cellSize),
+		(int)ceil((boundsMax.y - boundsMin.y) / cellSize),
+		(int)ceil((boundsMax.z - boundsMin.z) / cellSize));
+	numCells = gridDims.x * gridDims.y * gridDims.z;
+}
+
+void Parallel::buildNeighborGrid()
+{
+	GLuint groups = (numParticles + workgroupSize - 1) / workgroupSize;
+
+	// counting sort of particle indices by cell: count, scan, scatter
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellCountSSBO);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUseProgram(progGridHash);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// cellStart and cellEnd both begin at the exclusive prefix, the scatter
+	// pass then advances cellEnd as it fills each cell
+	prims.exclusiveScan(cellCountSSBO, cellStartSSBO, numCells);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, cellStartSSBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, cellEndSSBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint) * numCells);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUseProgram(progGridScatter);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Parallel::swapPositions()
+{
+	if (!compactStorage) return;
+
+	// in GPU_INDIRECT mode the CPU can't tell which queued passes ran, so the
+	// new positions are copied back instead. A pass that was skipped left the
+	// last copy in nextPos, so copying it again changes nothing.
+	if (convergenceMode == GPU_INDIRECT) {
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_COPY_READ_BUFFER, nextPosSSBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, posSSBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, particleBytes() * numParticles);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return;
+	}
+
+	std::swap(posSSBO, nextPosSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, nextPosSSBO);
+}
+
+void Parallel::dispatchIteration(GLuint groups)
+{
+	if (convergenceMode == GPU_INDIRECT)
+		glDispatchComputeIndirect(0);
+	else
+		glDispatchCompute(groups, 1, 1);
+}
+
+void Parallel::recordIterations(int iterations)
+{
+	lastIterations = iterations;
+	profiler.recordIterations(iterations);
+	iterationTotal += iterations;
+	iterationSteps++;
+}
+
+void Parallel::printConvergenceStats()
+{
+	const char *names[] = {"sync", "lagged", "gpu indirect"};
+	cout << "convergence " << names[convergenceMode]
+		 << ": " << getAverageIterations() << " iterations/step over "
+		 << iterationSteps << " steps (last " << lastIterations << ")" << endl;
+}
+
+void Parallel::queueMaxSpeed()
+{
+	// one fenced copy in flight at a time, so a slow GPU can't starve it
+	if (speedReadback.pending(0)) return;
+
+	if (compactStorage)
+		prims.reduce(velSSBO, numParticles, GPUPrimitives::MAXLENGTH_HALF, maxSpeed, 0, 2, 0, 0.0f, 3);
+	else
+		prims.reduce(velSSBO, numParticles, GPUPrimitives::MAXLENGTH, maxSpeed, 0, 4, 0, 0.0f, 3);
+	speedReadback.capture(0, maxSpeed, 0, sizeof(float));
+}
+
+bool Parallel::pollMaxSpeed()
+{
+	// without a speed for these particles the grid can't be padded, so the
+	// first step after an upload waits for one
+	if (lastMaxSpeed < 0.0f) queueMaxSpeed();
+	else if (!speedReadback.ready(0)) return false;
+
+	lastMaxSpeed = *(const float *)speedReadback.wait(0);
+	return true;
+}
+
+void Parallel::updateTimestep()
+{
+	float speed = lastMaxSpeed;
+
+	// CFL limit, plus a gravity limit for when the fluid is at rest
+	float target = dtMax;
+	if (speed > 0.0f) target = min(target, cflNumber * smoothingRadius / speed);
+	target = min(target, 0.25f * sqrt(smoothingRadius / gravity));
+
+	// shrink right away, grow gradually
+	dt = max(dtMin, min(target, dt * dtGrowth));
+}
+
 void Parallel::compute()
 {
-	GLuint groups = (numParticles + 63) / 64;
+	// first use of the queued programs, a no-op once they are checked
+	finishShaders();
 
-	// 1. find neighbors, 3d will definitely need to do this
+	GLuint groups = (numParticles + workgroupSize - 1) / workgroupSize;
 
-	// 2. apply external forces
-	glUseProgram(progApplyExtForces);
+	// pick this step's dt and cell size before the parameters are uploaded,
+	// the adaptive dt only moves when a new max speed has landed
+	bool newSpeed = pollMaxSpeed();
+	if (!adaptiveDt) dt = fixedDt;
+	else if (newSpeed) updateTimestep();
+	fitNeighborGrid();
+
+	updateSimParams();
 
-	glUniform1f(glGetUniformLocation(progApplyExtForces, "dt"), dt);
-	glUniform1f(glGetUniformLocation(progApplyExtForces, "gravity"), gravity);
-	glUniform3f(glGetUniformLocation(progApplyExtForces, "boundsMin"), boundsMin.x,
-				boundsMin.y,
-				boundsMin.z);
-	glUniform3f(glGetUniformLocation(progApplyExtForces, "boundsMax"), boundsMax.x,
-				boundsMax.y,
-				boundsMax.z);
+	profiler.beginFrame();
 
+	// 1. apply external forces
+	profiler.begin("extForces");
+	glUseProgram(progApplyExtForces);
 	glDispatchCompute(groups, 1, 1);
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-	// 3. compute densities + pressures
-	float beta = 2.0f * dt * dt / (restDensity * restDensity);
-	float sumGradSquared = 315.0f / (64.0f * M_PI * pow(smoothingRadius, 9.0f)); // match your kernel
-	float delta = 1.0f / (beta * sumGradSquared);
+	// 2. bin particles into the neighbor grid, reused by every iteration below
+	profiler.begin("grid");
+	buildNeighborGrid();
+	profiler.end();
 
+	// 3. compute densities + pressures, extForces zeroed the pressures
 	int iter = 0;
-	float maxDensityErrorFloat = 999.0f;
+	bool converged = false;
 
-	// zero out pressure
-	std::vector<float> zeros(numParticles, 0.0f);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pressureSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * numParticles, zeros.data());
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (convergenceMode == GPU_INDIRECT) {
+		// previous step's iteration count, if its copy has landed
+		if (iterationReadback.ready(0))
+			recordIterations(*(const GLuint *)iterationReadback.wait(0));
+
+		GLuint args[10] = {groups, 1, 1, 0, GPUPrimitives::reduceGroups(numParticles), 1, 1, 1, 1, 1};
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dispatchArgs);
+		glBufferSubData(GL_DISPATCH_INDIRECT_BUFFER, 0, sizeof(args), args);
+	}
 
-	while ((maxDensityErrorFloat > eta) && (iter < maxIterations))
+	while (!converged && (iter < maxIterations))
 	{
-		float zero = 0.0f;
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxDensityError);
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float), &zero);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		// rebinned once the particles may have left the padded cells
+		if (iter > 0 && iter % gridIterations == 0) {
+			profiler.begin("grid");
+			buildNeighborGrid();
+		}
 
 		// 3a: compute densities and pressures
+		profiler.begin("densities");
 		glUseProgram(progComputeDensities);
-
-		glUniform1f(glGetUniformLocation(progComputeDensities, "dt"), dt);
-		glUniform1f(glGetUniformLocation(progComputeDensities, "restDensity"), restDensity);
-		glUniform1f(glGetUniformLocation(progComputeDensities, "smoothingRadius"), smoothingRadius);
-		glUniform1f(glGetUniformLocation(progComputeDensities, "delta"), delta);
-		glUniform1ui(glGetUniformLocation(progComputeDensities, "numParticles"), numParticles);
-
-		glDispatchCompute(groups, 1, 1);
+		dispatchIteration(groups);
 		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-		// read back maxDensityError from GPU
-		uint32_t maxDensityErrorUint = 0;
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxDensityError);
-		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t), &maxDensityErrorUint);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-		std::memcpy(&maxDensityErrorFloat, &maxDensityErrorUint, sizeof(float));
-
-		// 3b: apply pressure corrections
-		glUseProgram(progApplyPressures);
-
-		glUniform1f(glGetUniformLocation(progApplyPressures, "dt"), dt);
-		glUniform1f(glGetUniformLocation(progApplyPressures, "restDensity"), restDensity);
-		glUniform1f(glGetUniformLocation(progApplyPressures, "smoothingRadius"), smoothingRadius);
-		glUniform1f(glGetUniformLocation(progApplyPressures, "stiffness"), stiffness);
-		glUniform1ui(glGetUniformLocation(progApplyPressures, "numParticles"), numParticles);
-		glUniform3f(glGetUniformLocation(progApplyPressures, "boundsMin"), boundsMin.x,
-					boundsMin.y,
-					boundsMin.z);
-		glUniform3f(glGetUniformLocation(progApplyPressures, "boundsMax"), boundsMax.x,
-					boundsMax.y,
-					boundsMax.z);
+		// max |density - restDensity| into maxDensityError
+		profiler.begin("densityError");
+		// zeroed with the kernels' dispatches once converged in GPU_INDIRECT mode
+		GLintptr reduceArgs = convergenceMode == GPU_INDIRECT ? 4 * sizeof(GLuint) : -1;
+		if (compactStorage)
+			prims.reduce(densitySSBO, numParticles, GPUPrimitives::MAXABS, maxDensityError, 0, 1, 0, restDensity, 1,
+						 reduceArgs);
+		else
+			prims.reduce(posSSBO, numParticles, GPUPrimitives::MAXABS, maxDensityError, 0, 4, 3, restDensity, 1,
+						 reduceArgs);
+
+		float maxDensityErrorFloat = 0.0f;
+		if (convergenceMode == SYNC) {
+			// read back maxDensityError from GPU, stalls until the pass is done
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, maxDensityError);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float), &maxDensityErrorFloat);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		} else if (convergenceMode == LAGGED && iter + 1 < maxIterations) {
+			// fenced copy, looked at after the next iteration is queued
+			errorReadback.capture(iter % 2, maxDensityError, 0, sizeof(float));
+		}
 
-		glDispatchCompute(groups, 1, 1);
-		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		if (fusePressureViscosity) {
+			// 3b+c: pressure corrections and viscosity in one neighbor pass
+			profiler.begin("pressureViscosity");
+			glUseProgram(progApplyPressureViscosity);
+			dispatchIteration(groups);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			swapPositions();
+		} else {
+			// 3b: apply pressure corrections
+			profiler.begin("pressures");
+			glUseProgram(progApplyPressures);
+			dispatchIteration(groups);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			swapPositions();
+
+			// 3c: apply viscosity forces
+			profiler.begin("viscosity");
+			glUseProgram(progApplyViscosity);
+			dispatchIteration(groups);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
 
-		// 3c: apply viscosity forces
-		glUseProgram(progApplyViscosity);
+		if (convergenceMode == GPU_INDIRECT) {
+			profiler.begin("convergence");
+			glUseProgram(progConvergence);
 
-		glUniform1f(glGetUniformLocation(progApplyViscosity, "viscosityStrength"), viscosityStrength);
-		glUniform1f(glGetUniformLocation(progApplyViscosity, "smoothingRadius"), smoothingRadius);
-		glUniform1ui(glGetUniformLocation(progApplyViscosity, "numParticles"), numParticles);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, maxDensityError);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, dispatchArgs);
 
-		glDispatchCompute(groups, 1, 1);
-		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			glDispatchCompute(1, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+		}
+		profiler.end();
 
 		iter++;
+
+		if (convergenceMode == SYNC) {
+			converged = maxDensityErrorFloat <= eta;
+		} else if (convergenceMode == LAGGED && iter >= 2) {
+			// error of the iteration before the one just queued
+			converged = *(const float *)errorReadback.wait(iter % 2) <= eta;
+		}
 	}
 
-	if (!doObstacle)
-		return;
+	if (convergenceMode == GPU_INDIRECT) {
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+		iterationReadback.capture(0, dispatchArgs, 3 * sizeof(GLuint), sizeof(GLuint));
+	} else {
+		recordIterations(iter);
+	}
 
-	glUseProgram(progResolveCollisions);
+	if (doObstacle) {
+		profiler.begin("collisions");
+		// boxes where they are at the end of the step
+		if (obstacles.count()) {
+			obstacles.update(simTime + dt);
+			obstacles.bind(2);
+			glUseProgram(progResolveCollisions);
+			glUniform1ui(glGetUniformLocation(progResolveCollisions, "numBoxes"), obstacles.count());
+			glDispatchCompute(groups, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+		if (meshObstacle) {
+			resolveMeshCollisions(groups);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+		profiler.end();
+	}
 
-	glUniform3f(glGetUniformLocation(progResolveCollisions, "cubeMin"), objectCenter.x - size / 2, objectCenter.y - size / 2, objectCenter.z - size / 2);
-	glUniform3f(glGetUniformLocation(progResolveCollisions, "cubeMax"), objectCenter.x + size / 2, objectCenter.y + size / 2, objectCenter.z + size / 2);
-	glUniform1f(glGetUniformLocation(progResolveCollisions, "restitution"), 2.0f);
-	glUniform1ui(glGetUniformLocation(progResolveCollisions, "numParticles"), numParticles);
+	simTime += dt;
+	profiler.begin("maxSpeed");
+	queueMaxSpeed();
+	profiler.end();
 
-	glDispatchCompute(groups, 1, 1);
-	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	if (trajectory.isOpen()) {
+		profiler.begin("export");
+		GLuint buffers[] = { posSSBO, velSSBO };
+		trajectory.step(simTime, buffers);
+		profiler.end();
+	}
 }
 
-void Parallel::resetParticles()
+bool Parallel::setParameter(const string &name, float value)
 {
-	std::vector<glm::vec4> positions(numParticles);
-	std::vector<glm::vec4> velocities(numParticles);
-
-	// Regenerate the grid cube of initial positions
-	int width = static_cast<int>(round(pow(numParticles, 1.0 / 3.0)));
-	int height = width;
-	int depth = (numParticles - 1) / (width * height) + 1;
+	if (name == "dt") fixedDt = dt = value;
+	else if (name == "gravity") gravity = value;
+	else if (name == "restDensity") restDensity = value;
+	else if (name == "smoothingRadius") smoothingRadius = value;
+	else if (name == "stiffness") stiffness = value;
+	else if (name == "eta") eta = value;
+	else if (name == "viscosityStrength") viscosityStrength = value;
+	else if (name == "maxIterations") maxIterations = (int)value;
+	else if (name == "cflNumber") cflNumber = value;
+	else if (name == "dtMin") dtMin = value;
+	else if (name == "dtMax") dtMax = value;
+	else return false;
+	return true;
+}
 
-	float spacing = 0.05f;
-	float gridWidth = width * spacing;
-	float gridHeight = height * spacing;
-	float gridDepth = depth * spacing;
+void Parallel::readbackPositions(vector<glm::vec4> &out)
+{
+	readbackParticles(posSSBO, true, out);
+}
 
-	float offsetX = -gridWidth / 2.0f;
-	float offsetY = -gridHeight / 2.0f;
-	float offsetZ = -gridDepth / 2.0f;
+void Parallel::readbackVelocities(vector<glm::vec4> &out)
+{
+	readbackParticles(velSSBO, false, out);
+}
 
-	for (int i = 0; i < numParticles; i++)
-	{
-		int xi = i % width;
-		int yi = (i / width) % height;
-		int zi = i / (width * height);
+void Parallel::readbackParticles(GLuint buffer, bool positions, vector<glm::vec4> &out)
+{
+	out.resize(numParticles);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleBytes() * numParticles, out.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (!compactStorage) return;
+
+	// unpack in place from the back, the packed words fill the first half
+	glm::vec3 lo, hi;
+	storageBounds(lo, hi);
+	const GLuint *words = reinterpret_cast<const GLuint *>(out.data());
+	for (int i = numParticles - 1; i >= 0; i--) {
+		GLuint w0 = words[2 * i], w1 = words[2 * i + 1];
+		if (positions) {
+			glm::vec3 q((float)(w0 & 0x1FFFFF), (float)((w0 >> 21) | ((w1 & 0x3FF) << 11)), (float)(w1 >> 10));
+			out[i] = glm::vec4(lo + q / 2097151.0f * (hi - lo), 1.0f);
+		} else {
+			out[i] = glm::vec4(halfToFloat(w0 & 0xFFFF), halfToFloat(w0 >> 16), halfToFloat(w1 & 0xFFFF), 0.0f);
+		}
+	}
+}
 
-		float x = (xi + 0.5f) * spacing + offsetX;
-		float y = (yi + 0.5f) * spacing + offsetY;
-		float z = (zi + 0.5f) * spacing + offsetZ;
+bool Parallel::writeParticles(const vector<glm::vec4> &positions, const vector<glm::vec4> &velocities)
+{
+	if ((int)positions.size() != numParticles || (int)velocities.size() != numParticles) return false;
 
-		positions[i] = glm::vec4(x, y, z, 1.0f) + glm::vec4(0.5, 0.4, 0.0, 0.0);
-		velocities[i] = glm::vec4(0.0f);
-	}
+	std::vector<GLuint> packedPos = packParticles(positions, true);
+	std::vector<GLuint> packedVel = packParticles(velocities, false);
 
-	// Upload to GPU
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, posSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::vec4) * numParticles, positions.data());
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleBytes() * numParticles, packedPos.data());
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, velSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::vec4) * numParticles, velocities.data());
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleBytes() * numParticles, packedVel.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, predPosSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::vec4) * numParticles, positions.data());
+	// a max speed in flight is for the old particles
+	if (speedReadback.pending(0)) speedReadback.wait(0);
+	lastMaxSpeed = -1.0f;
+	return true;
+}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, predVelSSBO);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::vec4) * numParticles, velocities.data());
+void Parallel::printMemoryReport()
+{
+	MemoryReport report;
+	report.add("pos", posSSBO);
+	report.add("nextPos", nextPosSSBO);
+	report.add("vel", velSSBO);
+	report.add("density", densitySSBO);
+	report.add("pressure", pressureSSBO);
+	report.add("sortedIndex", sortedIndexSSBO);
+	report.add("cellCount", cellCountSSBO, false);
+	report.add("cellStart", cellStartSSBO, false);
+	report.add("cellEnd", cellEndSSBO, false);
+	report.add("params", paramsUBO, false);
+	report.add("dispatchArgs", dispatchArgs, false);
+	report.print(numParticles);
+}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+bool Parallel::startTrajectory(const char *path, int every)
+{
+	stopTrajectory();
+	trajectory.every = max(every, 1);
+	// compact runs export the packed words as they are, with the bounds the
+	// fixed point positions are relative to
+	glm::vec3 lo, hi;
+	storageBounds(lo, hi);
+	if (compactStorage)
+		trajectory.addStream("posFixed21", particleBytes() * numParticles, &lo.x, &hi.x);
+	else
+		trajectory.addStream("pos", particleBytes() * numParticles);
+	trajectory.addStream(compactStorage ? "velHalf" : "vel", particleBytes() * numParticles);
+	return trajectory.open(path, 3, numParticles);
+}
+
+void Parallel::stopTrajectory()
+{
+	if (!trajectory.isOpen()) return;
+	trajectory.close();
+	trajectory.printStats();
+}
+
+// everything on the CPU side that the step depends on
+struct CheckpointState {
+	float fixedDt, dt;
+	double simTime;
+	int maxIterations;
+	float gravity, restDensity, smoothingRadius, stiffness, eta, viscosityStrength;
+	float cflNumber, dtMin, dtMax, dtGrowth;
+	int adaptiveDt;
+	int doObstacle;
+	double obstacleStart;
+};
+
+bool Parallel::saveCheckpoint(const char *path)
+{
+	CheckpointState state;
+	state.fixedDt = fixedDt;
+	state.dt = dt;
+	state.simTime = simTime;
+	state.maxIterations = maxIterations;
+	state.gravity = gravity;
+	state.restDensity = restDensity;
+	state.smoothingRadius = smoothingRadius;
+	state.stiffness = stiffness;
+	state.eta = eta;
+	state.viscosityStrength = viscosityStrength;
+	state.cflNumber = cflNumber;
+	state.dtMin = dtMin;
+	state.dtMax = dtMax;
+	state.dtGrowth = dtGrowth;
+	state.adaptiveDt = adaptiveDt;
+	state.doObstacle = doObstacle;
+	state.obstacleStart = obstacles.startTime;
+
+	// density and pressure are rebuilt from scratch every step
+	GLsizeiptr vecBytes = particleBytes() * numParticles;
+
+	// the boxes with their paths, which the scene may have changed
+	std::vector<char> boxes;
+	obstacles.save(boxes);
+
+	CheckpointWriter writer(3, numParticles);
+	writer.addData("state", &state, sizeof(state));
+	writer.addData("boxes", boxes.data(), boxes.size());
+	writer.addBuffer("pos", posSSBO, vecBytes);
+	writer.addBuffer("vel", velSSBO, vecBytes);
+	return writer.save(path);
+}
+
+bool Parallel::loadCheckpoint(const char *path)
+{
+	CheckpointReader reader;
+	if (!reader.open(path)) return false;
+
+	CheckpointState state;
+	if (reader.dim() != 3 || reader.numParticles() != numParticles || !reader.read("state", state)) {
+		cout << path << " does not match this simulation (" << reader.dim() << "D, "
+			 << reader.numParticles() << " particles)" << endl;
+		return false;
+	}
+	// the neighbor grid is sized from the smoothing radius at init
+	if (state.smoothingRadius != smoothingRadius) {
+		cout << path << " was saved with smoothingRadius " << state.smoothingRadius << endl;
+		return false;
+	}
+
+	GLsizeiptr vecBytes = particleBytes() * numParticles;
+	bool ok = reader.upload("pos", posSSBO, vecBytes)
+		&& reader.upload("vel", velSSBO, vecBytes);
+	if (!ok) return false;
+
+	size_t boxBytes;
+	const void *boxes = reader.section("boxes", boxBytes);
+	if (!boxes || !obstacles.load(boxes, boxBytes)) {
+		cout << path << " has no valid box table" << endl;
+		return false;
+	}
+
+	fixedDt = state.fixedDt;
+	dt = state.dt;
+	simTime = state.simTime;
+	maxIterations = state.maxIterations;
+	gravity = state.gravity;
+	restDensity = state.restDensity;
+	stiffness = state.stiffness;
+	eta = state.eta;
+	viscosityStrength = state.viscosityStrength;
+	cflNumber = state.cflNumber;
+	dtMin = state.dtMin;
+	dtMax = state.dtMax;
+	dtGrowth = state.dtGrowth;
+	adaptiveDt = state.adaptiveDt;
+	doObstacle = state.doObstacle;
+	obstacles.startTime = state.obstacleStart;
+
+	// drop a max speed still in flight from before the load
+	if (speedReadback.pending(0)) speedReadback.wait(0);
+	lastMaxSpeed = -1.0f;
+	return true;
+}
+
+void Parallel::resetParticles()
+{
+	// the startup block, dropped from higher up
+	std::vector<glm::vec4> positions(numParticles);
+	std::vector<glm::vec4> velocities(numParticles);
+	generateParticles(positions, velocities, 0.4f);
+	writeParticles(positions, velocities);
 }
 
 ///
 
 void Parallel::initObject()
 {
-	float half = size / 2.0f;
+	// 0.75 wide box going down the left wall, along the floor and back over
+	// the top, at the speed the old per-step loop moved it with the fixed dt
+	float speed = 0.02f / fixedDt;
+	int box = obstacles.add(glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec3(0.375f));
+	ObstaclePath &path = obstacles.path(box);
+	path.moveTo(glm::vec3(-1.0f, 1.0f, 0.0f), speed);
+	path.moveTo(glm::vec3(-1.0f, -0.5f, 0.0f), speed);
+	path.moveTo(glm::vec3(1.0f, -0.5f, 0.0f), speed);
+	path.moveTo(glm::vec3(1.0f, 1.0f, 0.0f), speed);
+	path.moveTo(glm::vec3(-1.0f, 1.0f, 0.0f), speed);
 
 	std::vector<glm::vec3> cubeVertices = {
 		// back face
-		objectCenter + glm::vec3(-half, -half, -half),
-		objectCenter + glm::vec3(half, -half, -half),
-		objectCenter + glm::vec3(half, half, -half),
-		objectCenter + glm::vec3(half, half, -half),
-		objectCenter + glm::vec3(-half, half, -half),
-		objectCenter + glm::vec3(-half, -half, -half),
+		glm::vec3(-1.0f, -1.0f, -1.0f),
+		glm::vec3(1.0f, -1.0f, -1.0f),
+		glm::vec3(1.0f, 1.0f, -1.0f),
+		glm::vec3(1.0f, 1.0f, -1.0f),
+		glm::vec3(-1.0f, 1.0f, -1.0f),
+		glm::vec3(-1.0f, -1.0f, -1.0f),
 
 		// front face
-		objectCenter + glm::vec3(-half, -half, half),
-		objectCenter + glm::vec3(half, -half, half),
-		objectCenter + glm::vec3(half, half, half),
-		objectCenter + glm::vec3(half, half, half),
-		objectCenter + glm::vec3(-half, half, half),
-		objectCenter + glm::vec3(-half, -half, half),
+		glm::vec3(-1.0f, -1.0f, 1.0f),
+		glm::vec3(1.0f, -1.0f, 1.0f),
+		glm::vec3(1.0f, 1.0f, 1.0f),
+		glm::vec3(1.0f, 1.0f, 1.0f),
+		glm::vec3(-1.0f, 1.0f, 1.0f),
+		glm::vec3(-1.0f, -1.0f, 1.0f),
 
 		// left face
-		objectCenter + glm::vec3(-half, half, half),
-		objectCenter + glm::vec3(-half, half, -half),
-		objectCenter + glm::vec3(-half, -half, -half),
-		objectCenter + glm::vec3(-half, -half, -half),
-		objectCenter + glm::vec3(-half, -half, half),
-		objectCenter + glm::vec3(-half, half, half),
+		glm::vec3(-1.0f, 1.0f, 1.0f),
+		glm::vec3(-1.0f, 1.0f, -1.0f),
+		glm::vec3(-1.0f, -1.0f, -1.0f),
+		glm::vec3(-1.0f, -1.0f, -1.0f),
+		glm::vec3(-1.0f, -1.0f, 1.0f),
+		glm::vec3(-1.0f, 1.0f, 1.0f),
 
 		// right face
-		objectCenter + glm::vec3(half, half, half),
-		objectCenter + glm::vec3(half, half, -half),
-		objectCenter + glm::vec3(half, -half, -half),
-		objectCenter + glm::vec3(half, -half, -half),
-		objectCenter + glm::vec3(half, -half, half),
-		objectCenter + glm::vec3(half, half, half),
+		glm::vec3(1.0f, 1.0f, 1.0f),
+		glm::vec3(1.0f, 1.0f, -1.0f),
+		glm::vec3(1.0f, -1.0f, -1.0f),
+		glm::vec3(1.0f, -1.0f, -1.0f),
+		glm::vec3(1.0f, -1.0f, 1.0f),
+		glm::vec3(1.0f, 1.0f, 1.0f),
 
 		// bottom face
-		objectCenter + glm::vec3(-half, -half, -half),
-		objectCenter + glm::vec3(half, -half, -half),
-		objectCenter + glm::vec3(half, -half, half),
-		objectCenter + glm::vec3(half, -half, half),
-		objectCenter + glm::vec3(-half, -half, half),
-		objectCenter + glm::vec3(-half, -half, -half),
+		glm::vec3(-1.0f, -1.0f, -1.0f),
+		glm::vec3(1.0f, -1.0f, -1.0f),
+		glm::vec3(1.0f, -1.0f, 1.0f),
+		glm::vec3(1.0f, -1.0f, 1.0f),
+		glm::vec3(-1.0f, -1.0f, 1.0f),
+		glm::vec3(-1.0f, -1.0f, -1.0f),
 
 		// top face
-		objectCenter + glm::vec3(-half, half, -half),
-		objectCenter + glm::vec3(half, half, -half),
-		objectCenter + glm::vec3(half, half, half),
-		objectCenter + glm::vec3(half, half, half),
-		objectCenter + glm::vec3(-half, half, half),
-		objectCenter + glm::vec3(-half, half, -half)};
+		glm::vec3(-1.0f, 1.0f, -1.0f),
+		glm::vec3(1.0f, 1.0f, -1.0f),
+		glm::vec3(1.0f, 1.0f, 1.0f),
+		glm::vec3(1.0f, 1.0f, 1.0f),
+		glm::vec3(-1.0f, 1.0f, 1.0f),
+		glm::vec3(-1.0f, 1.0f, -1.0f)};
 
 	glGenVertexArrays(1, &objectVAO);
 	glGenBuffers(1, &objectVBO);
@@ -535,61 +1173,72 @@ void Parallel::initObject()
 	glBindVertexArray(0);
 }
 
-void Parallel::moveObjectX(float deltaX)
+///////////////////////////////////////////////////////////////////////
+// mesh obstacle
+///////////////////////////////////////////////////////////////////////
+
+bool Parallel::loadObstacleMesh(const char *path, int resolution)
 {
-	objectCenter.x += deltaX;
-	initObject();
+	TriangleMesh mesh;
+	if (!mesh.load(path)) return false;
+
+	// pad by the margin plus a smoothing radius so the field reaches past
+	// the surface on every side
+	float padding = obstacleMargin + smoothingRadius;
+	if (!obstacleSDF.bake(mesh, resolution, padding)) {
+		cout << path << " has no triangles with an area" << endl;
+		return false;
+	}
+	obstacleSDF.upload();
+	cout << path << ": " << mesh.numTriangles() << " triangles baked into a "
+		 << obstacleSDF.dims.x << "x" << obstacleSDF.dims.y << "x" << obstacleSDF.dims.z
+		 << " distance field in " << obstacleSDF.bakeMs << " ms" << endl;
+	obstacleMesh = mesh;
+
+	if (!meshVAO) {
+		glGenVertexArrays(1, &meshVAO);
+		glGenBuffers(1, &meshVBO);
+		glGenBuffers(1, &meshEBO);
+	}
+	glBindVertexArray(meshVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+	glBufferData(GL_ARRAY_BUFFER, obstacleMesh.vertices.size() * sizeof(glm::vec3), obstacleMesh.vertices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, obstacleMesh.indices.size() * sizeof(GLuint), obstacleMesh.indices.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	obstacles.clear();
+	meshObstacle = true;
+	doObstacle = true;
+	return true;
 }
 
-void Parallel::moveObjectY(float deltaY)
+void Parallel::setObstacleTransform(const glm::mat4 &model)
 {
-	objectCenter.y += deltaY;
-	initObject();
+	obstacleModel = model;
 }
 
-bool near(float a, float b) { return fabs(a - b) < 0.001f; }
-
-
-
-void Parallel::loopObject()
+void Parallel::resolveMeshCollisions(GLuint groups)
 {
-	switch (currentDirection)
-	{
-	case LEFT:
-		moveObjectX(-0.02);
-		if (near(objectCenter.x, -1.0f))
-		{
-			objectCenter = glm::vec3(-1.0f, 1.0f, 0.0f);
-			currentDirection = DOWN;
-		}
-		break;
-
-	case DOWN:
-		moveObjectY(-0.02);
-		if (near(objectCenter.y, -0.5f))
-		{
-			objectCenter = glm::vec3(-1.0f, -0.5f, 0.0f);
-			currentDirection = RIGHT;
-		}
-
-		break;
-
-	case RIGHT:
-		moveObjectX(0.02);
-		if (near(objectCenter.x, 1.0f))
-		{
-			objectCenter = glm::vec3(1.0f, -0.5f, 0.0f);
-			currentDirection = UP;
-		}
-		break;
-
-	case UP:
-		moveObjectY(0.02);
-		if (near(objectCenter.y, 1.0f))
-		{
-			objectCenter = glm::vec3(1.0f, 1.0f, 0.0f);
-			currentDirection = LEFT;
-		}
-		break;
-	}
+	glm::vec3 size = glm::vec3(obstacleSDF.dims.x - 1, obstacleSDF.dims.y - 1, obstacleSDF.dims.z - 1) * obstacleSDF.spacing;
+	glm::mat4 worldToMesh = glm::inverse(obstacleModel);
+	glm::mat3 meshToWorld = glm::mat3(obstacleModel);
+
+	glUseProgram(progSDFCollisions);
+	glUniformMatrix4fv(glGetUniformLocation(progSDFCollisions, "worldToMesh"), 1, GL_FALSE, glm::value_ptr(worldToMesh));
+	glUniformMatrix3fv(glGetUniformLocation(progSDFCollisions, "meshToWorld"), 1, GL_FALSE, glm::value_ptr(meshToWorld));
+	glUniform3f(glGetUniformLocation(progSDFCollisions, "sdfOrigin"), obstacleSDF.origin.x, obstacleSDF.origin.y, obstacleSDF.origin.z);
+	glUniform3f(glGetUniformLocation(progSDFCollisions, "sdfSize"), size.x, size.y, size.z);
+	glUniform1f(glGetUniformLocation(progSDFCollisions, "margin"), obstacleMargin);
+	glUniform1f(glGetUniformLocation(progSDFCollisions, "bounce"), obstacleBounce);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, obstacleSDF.texture);
+	glDispatchCompute(groups, 1, 1);
+	glBindTexture(GL_TEXTURE_3D, 0);
 }
+
+} // namespace sph3d
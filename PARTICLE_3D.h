@@ -5,9 +5,31 @@
 
 #include "SETTINGS.h"
 #include "SHADER.h"
+#include "PRIMITIVES.h"
+#include "READBACK.h"
+#include "PROFILER.h"
+#include "TRAJECTORY.h"
+#include "SDF.h"
+#include "KINEMATIC.h"
 
 using namespace std;
 
+// both solvers name their class Parallel, the namespace lets the headless
+// runner link them into one binary
+namespace sph3d {
+
+// std140 mirror of the SimParams uniform block in compute3d/params.glsl
+struct SimParams {
+	glm::vec3 boundsMin;     float dt;
+	glm::vec3 boundsMax;     float gravity;
+	glm::vec3 gridMin;       float cellSize;
+	glm::ivec3 gridDims;     GLuint numParticles;
+	float restitution;       float eta;             float restDensity; float smoothingRadius;
+	float stiffness;         float delta;           float viscosityStrength; float densityCoeff;
+	float gradCoeff;         float viscosityCoeff;  float pad[2];
+};
+static_assert(sizeof(SimParams) == 112, "SimParams must match the std140 block");
+
 class Parallel {
 public:
 
@@ -18,6 +40,7 @@ public:
 	void initSimBounds();
 	void initParticleAndPrograms();
 	void initComputeShaders(vector<glm::vec4> positions, vector<glm::vec4> velocities);
+	void initNeighborGrid();
 	void initRenderer(const char* boundVertex, const char* boundFragment,
 										const char* fluidVertex, const char* fluidFragment);
 	
@@ -25,6 +48,74 @@ public:
 	void render();
 	void compute();
 	void resetParticles();
+	void readbackPositions(vector<glm::vec4> &out);
+	void readbackVelocities(vector<glm::vec4> &out);
+
+	// overwrite the particle state, xyz of every particle. False, with
+	// nothing written, if either vector doesn't hold numParticles.
+	bool writeParticles(const vector<glm::vec4> &positions, const vector<glm::vec4> &velocities);
+
+	// bytes per particle and the total size of the solver's buffers
+	void printMemoryReport();
+
+	// full state checkpoint, see CHECKPOINT.h. A checkpoint only loads into
+	// a simulation with the same particle count and smoothing radius.
+	bool saveCheckpoint(const char *path);
+	bool loadCheckpoint(const char *path);
+
+	// set a simulation parameter by name, false if the name is unknown.
+	// Call before init, the neighbor grid is sized from smoothingRadius.
+	bool setParameter(const string &name, float value);
+	void buildNeighborGrid();
+
+	float getDt() const { return dt; }
+
+	// PCISPH convergence check. SYNC reads the density error back every
+	// iteration, LAGGED reads it through a fenced copy and decides one
+	// iteration late, GPU_INDIRECT lets the GPU zero the remaining dispatches
+	enum CONVERGENCE { SYNC, LAGGED, GPU_INDIRECT };
+	CONVERGENCE convergenceMode = GPU_INDIRECT;
+	int getLastIterations() const { return lastIterations; }
+	float getAverageIterations() const { return iterationSteps ? (float)iterationTotal / iterationSteps : 0.0f; }
+	void resetConvergenceStats() { iterationTotal = 0; iterationSteps = 0; }
+	void printConvergenceStats();
+
+	// adaptive timestep. dt follows a CFL limit on the fastest particle, which
+	// is read back through a fence a step or two late, clamped to
+	// [dtMin, dtMax] and allowed to grow by at most dtGrowth per step.
+	// When off the fixed dt is used.
+	bool adaptiveDt = false;
+	float cflNumber = 0.4f;
+	float dtMin = 0.0005f;
+	float dtMax = 0.008f;
+	float dtGrowth = 1.2f;
+	double getSimTime() const { return simTime; }
+
+	// compile the neighbor kernels with the smoothing radius and kernel
+	// coefficients baked in as literals. Set before init; a specialized
+	// solver can't change smoothingRadius afterwards.
+	bool specializeKernels = true;
+
+	// per-stage GPU timings of compute() and render(), off until enabled
+	GPUProfiler profiler;
+
+	// trajectory export, writes pos and vel every Kth step
+	// from a background thread without stalling the step
+	TrajectoryWriter trajectory;
+	bool startTrajectory(const char *path, int every);
+	void stopTrajectory();
+
+	// run pressure and viscosity as one fused pass instead of two
+	bool fusePressureViscosity = true;
+
+	// 8 bytes per particle vector instead of 16: positions as 21-bit fixed
+	// point over the bounds, velocities as half floats (compute3d/storage.glsl).
+	// Set before init.
+	bool compactStorage = false;
+
+	// draw particles as ray cast sphere impostors, a 4 vertex quad each with
+	// per-pixel depth, instead of instanced sphere meshes
+	bool impostorSpheres = true;
 
 	// move camera
 	void rotateCamLeft();
@@ -32,14 +123,21 @@ public:
 
 	
 
-	// interaction
-	enum DIR { LEFT, DOWN, RIGHT, UP };
+	// obstacles. initObject uploads the cube geometry and adds the default
+	// box on a rectangular loop; more boxes and paths go through obstacles.
+	// doObstacle switches collisions and drawing for all of them.
 	bool doObstacle = false;
 	void initObject();
-	void setObject(glm::vec3 pos) { objectCenter = pos; currentDirection = DOWN; };
-	void moveObjectX(float deltaX);
-	void moveObjectY(float deltaY);
-	void loopObject();
+	KinematicObstacles obstacles;
+	void restartObstacles() { obstacles.restart(simTime); }
+
+	// triangle mesh obstacle (OBJ or STL) baked into a signed distance field
+	// with resolution samples along its longest axis. Replaces the boxes
+	// while loaded.
+	bool loadObstacleMesh(const char *path, int resolution = 64);
+	void setObstacleTransform(const glm::mat4 &model);	// rigid, no scale
+	float obstacleMargin = 0.02f;	// particle radius kept clear of the surface
+	float obstacleBounce = 0.3f;
 
 private:
 	// openGL screen
@@ -57,42 +155,115 @@ private:
 	vec3 boundsMin;
 	vec3 boundsMax;
 
-	// SSBOs
-	GLuint posSSBO, velSSBO;
-	GLuint predPosSSBO, predVelSSBO;
-	GLuint densitySSBO, pressureSSBO;
-	GLuint maxDensityError;
+	// SSBOs, see compute3d/storage.glsl for the layout. Density and pressure
+	// ride in pos.w and vel.w, they only get buffers of their own (0 otherwise)
+	// with compact storage, as does the position buffer the pressure passes
+	// write into.
+	GLuint posSSBO = 0, velSSBO = 0;
+	GLuint densitySSBO = 0, pressureSSBO = 0, nextPosSSBO = 0;
+	void swapPositions();
+	GLuint maxDensityError = 0;
+
+	// uniform grid for neighbor search, rebuilt every step and between
+	// iterations when they move the particles past the padding
+	GLuint cellCountSSBO = 0, cellStartSSBO = 0, cellEndSSBO = 0;
+	GLuint sortedIndexSSBO = 0;
+	// cells are padded to cover the particles' motion until the next rebuild,
+	// at most gridPad * smoothingRadius, the buffers are sized for the
+	// unpadded grid
+	glm::ivec3 gridDims;
+	GLuint numCells = 0;
+	float cellSize;
+	float gridPad = 0.2f;
+	int gridIterations = 1;		// iterations per rebuild
+	void fitNeighborGrid();
 
 	// compute shader programs (in order)
-	GLuint progApplyExtForces; 
-	GLuint progComputeDensities;
-	GLuint progApplyPressures;
-	GLuint progApplyViscosity;
-	GLuint progResolveCollisions;
+	GLuint progApplyExtForces = 0;
+	GLuint progComputeDensities = 0;
+	GLuint progApplyPressures = 0;
+	GLuint progApplyViscosity = 0;
+	GLuint progApplyPressureViscosity = 0;
+	GLuint progResolveCollisions = 0;
+	GLuint progGridHash = 0, progGridScatter = 0;
+
+	// scan, sort and reduction programs
+	GPUPrimitives prims;
 
 	// renderer
-	GLuint boundRenderer, fluidRenderer, objectRenderer;
-	GLuint boundVAO, boundVBO;
-	GLuint particleVAO, particleVBO;
+	GLuint boundRenderer = 0, fluidRenderer = 0, impostorRenderer = 0, objectRenderer = 0;
+	GLuint boundVAO = 0, boundVBO = 0, boundEBO = 0;
+	GLuint particleVAO = 0, sphereVBO = 0, sphereEBO = 0;
 	GLuint sphereIndexCount = 0;
-	GLuint objectVAO, objectVBO; 
+	GLuint objectVAO = 0, objectVBO = 0;	// unit cube, placed per box by the model matrix
 
-	// obstacle
-	float size = 0.75f;
-	glm::vec3 objectCenter = glm::vec3(-1.0f, 1.0f, 0.0f);
-	DIR currentDirection = DOWN;
+	// mesh obstacle
+	TriangleMesh obstacleMesh;
+	SignedDistanceField obstacleSDF;
+	glm::mat4 obstacleModel = glm::mat4(1.0f);
+	bool meshObstacle = false;
+	GLuint progSDFCollisions = 0;
+	GLuint meshVAO = 0, meshVBO = 0, meshEBO = 0;
+	void resolveMeshCollisions(GLuint groups);
 
 	// 3d sim parameters
 	int numParticles;
-	int maxIterations = 8;
-	float dt = 0.002;
+	// the error buffer was never allocated before, so the scene has only ever
+	// run one correction pass and the parameters below are tuned for that
+	int maxIterations = 1;
+	float fixedDt = 0.002;
+	float dt = fixedDt;
+	double simTime = 0.0;
 	float gravity = 60.0;
 	float restDensity = 9900;
 	float smoothingRadius = 0.12;
 	float stiffness = 0.0055;
 	float eta = 0.01;
 	float viscosityStrength = 0.00009;
+
+	// parameter uniform buffer, re-uploaded only when a value changes
+	GLuint paramsUBO = 0;
+	SimParams uploadedParams;
+	bool paramsUploaded = false;
+	void updateSimParams();
+
+	// threads per workgroup of the particle kernels, injected as LOCAL_SIZE_X
+	GLuint workgroupSize = 64;
+	glm::vec3 kernelCoefficients() const;
+	ShaderDefines shaderDefines(bool kernel) const;
+
+	// particle vectors in the layout the buffers hold
+	GLsizeiptr particleBytes() const { return compactStorage ? 8 : sizeof(glm::vec4); }
+	void storageBounds(glm::vec3 &lo, glm::vec3 &hi) const;
+	vector<GLuint> packParticles(const vector<glm::vec4> &values, bool positions) const;
+	void readbackParticles(GLuint buffer, bool positions, vector<glm::vec4> &out);
+
+	// startup: programs are queued while worker threads fill the particles
+	void queuePrograms();
+	// lift raises the block, the reset key drops it from higher up
+	void generateParticles(vector<glm::vec4> &positions, vector<glm::vec4> &velocities, float lift = 0.0f) const;
+
+	// convergence readback and GPU-driven dispatch sizes
+	AsyncReadback errorReadback, iterationReadback;
+	GLuint dispatchArgs = 0;
+	GLuint progConvergence = 0;
+	int lastIterations = 0;
+	long iterationTotal = 0;
+	long iterationSteps = 0;
+
+	void dispatchIteration(GLuint groups);
+	void recordIterations(int iterations);
+
+	// max particle speed for the adaptive timestep and the grid padding,
+	// negative until one has been read back for the current particles
+	GLuint maxSpeed = 0;
+	AsyncReadback speedReadback;
+	float lastMaxSpeed = -1.0f;
+	void queueMaxSpeed();
+	bool pollMaxSpeed();
+	void updateTimestep();
 };
 
+} // namespace sph3d
 
 #endif
\ No newline at end of file
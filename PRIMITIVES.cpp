@@ -0,0 +1,213 @@
+#include "PRIMITIVES.h"
+
+#include <algorithm>
+
+static const GLuint BLOCK = 256;
+static const GLuint MAX_REDUCE_GROUPS = 256;
+
+GPUPrimitives::~GPUPrimitives()
+{
+	for (GLuint level : scanLevels) glDeleteBuffers(1, &level);
+	glDeleteBuffers(1, &sortKeys);
+	glDeleteBuffers(1, &sortValues);
+	glDeleteBuffers(1, &sortHistogram);
+	glDeleteBuffers(1, &reducePartials);
+	glDeleteBuffers(1, &reduceResult);
+}
+
+void GPUPrimitives::init()
+{
+	// queued, the owner calls finishShaders() before the first dispatch
+	progScanBlocks   = queueComputeShader("primitives/scanBlocks.glsl");
+	progScanAdd      = queueComputeShader("primitives/scanAdd.glsl");
+	progRadixCount   = queueComputeShader("primitives/radixCount.glsl");
+	progRadixScatter = queueComputeShader("primitives/radixScatter.glsl");
+	progReduce       = queueComputeShader("primitives/reduce.glsl");
+}
+
+void GPUPrimitives::ensureBuffer(GLuint &buffer, GLsizeiptr &capacity, GLsizeiptr bytes)
+{
+	if (buffer != 0 && capacity >= bytes) return;
+
+	if (buffer == 0) glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	capacity = bytes;
+}
+
+///////////////////////////////////////////////////////////////////////
+// scan
+///////////////////////////////////////////////////////////////////////
+
+void GPUPrimitives::scanLevel(GLuint input, GLuint output, GLuint count, size_t level)
+{
+	GLuint groups = (count + BLOCK - 1) / BLOCK;
+
+	if (scanLevels.size() <= level) {
+		scanLevels.resize(level + 1, 0);
+		scanLevelSizes.resize(level + 1, 0);
+	}
+	ensureBuffer(scanLevels[level], scanLevelSizes[level], sizeof(GLuint) * groups);
+	GLuint blockSums = scanLevels[level];
+
+	// 1. scan each block, collect block totals
+	glUseProgram(progScanBlocks);
+	glUniform1ui(glGetUniformLocation(progScanBlocks, "count"), count);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, input);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, output);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, blockSums);
+
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	if (groups == 1) return;
+
+	// 2. scan the block totals in place, one level up
+	scanLevel(blockSums, blockSums, groups, level + 1);
+
+	// 3. offset every block by the scanned totals
+	glUseProgram(progScanAdd);
+	glUniform1ui(glGetUniformLocation(progScanAdd, "count"), count);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, output);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, blockSums);
+
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GPUPrimitives::exclusiveScan(GLuint input, GLuint output, GLuint count)
+{
+	if (count == 0) return;
+	scanLevel(input, output, count, 0);
+}
+
+///////////////////////////////////////////////////////////////////////
+// radix sort
+///////////////////////////////////////////////////////////////////////
+
+void GPUPrimitives::radixSort(GLuint keys, GLuint values, GLuint count, int keyBits)
+{
+	if (count == 0) return;
+
+	GLuint numBlocks = (count + BLOCK - 1) / BLOCK;
+	ensureBuffer(sortKeys, sortKeysSize, sizeof(GLuint) * count);
+	ensureBuffer(sortValues, sortValuesSize, sizeof(GLuint) * count);
+	ensureBuffer(sortHistogram, sortHistogramSize, sizeof(GLuint) * 16 * numBlocks);
+
+	GLuint srcKeys = keys, srcValues = values;
+	GLuint dstKeys = sortKeys, dstValues = sortValues;
+
+	int passes = (keyBits + 3) / 4;
+	for (int pass = 0; pass < passes; pass++) {
+		GLuint shift = 4 * pass;
+
+		// 1. per-block digit histogram
+		glUseProgram(progRadixCount);
+		glUniform1ui(glGetUniformLocation(progRadixCount, "count"), count);
+		glUniform1ui(glGetUniformLocation(progRadixCount, "shift"), shift);
+		glUniform1ui(glGetUniformLocation(progRadixCount, "numBlocks"), numBlocks);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, srcKeys);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, sortHistogram);
+
+		glDispatchCompute(numBlocks, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// 2. global scatter bases
+		exclusiveScan(sortHistogram, sortHistogram, 16 * numBlocks);
+
+		// 3. stable scatter into the other buffer pair
+		glUseProgram(progRadixScatter);
+		glUniform1ui(glGetUniformLocation(progRadixScatter, "count"), count);
+		glUniform1ui(glGetUniformLocation(progRadixScatter, "shift"), shift);
+		glUniform1ui(glGetUniformLocation(progRadixScatter, "numBlocks"), numBlocks);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, srcKeys);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, srcValues);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, sortHistogram);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, dstKeys);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, dstValues);
+
+		glDispatchCompute(numBlocks, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
+	}
+
+	// odd pass counts leave the result in the scratch pair
+	if (srcKeys != keys) {
+		glBindBuffer(GL_COPY_READ_BUFFER, srcKeys);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, keys);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint) * count);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, srcValues);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, values);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint) * count);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// reductions
+///////////////////////////////////////////////////////////////////////
+
+GLuint GPUPrimitives::reduceGroups(GLuint count)
+{
+	return std::max(1u, std::min((count + BLOCK - 1) / BLOCK, MAX_REDUCE_GROUPS));
+}
+
+void GPUPrimitives::reduce(GLuint input, GLuint count, REDUCE_OP op, GLuint result, GLuint resultIndex,
+						   GLuint stride, GLuint offset, float center, GLuint components,
+						   GLintptr indirectOffset)
+{
+	GLuint groups = reduceGroups(count);
+	ensureBuffer(reducePartials, reducePartialsSize, sizeof(float) * MAX_REDUCE_GROUPS);
+
+	glUseProgram(progReduce);
+	glUniform1i(glGetUniformLocation(progReduce, "op"), op);
+	glUniform1ui(glGetUniformLocation(progReduce, "stride"), stride);
+	glUniform1ui(glGetUniformLocation(progReduce, "offset"), offset);
+	glUniform1f(glGetUniformLocation(progReduce, "center"), center);
+	glUniform1ui(glGetUniformLocation(progReduce, "components"), components);
+	glUniform1ui(glGetUniformLocation(progReduce, "resultIndex"), resultIndex);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, input);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, reducePartials);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, result);
+
+	// 1. one partial per workgroup
+	glUniform1ui(glGetUniformLocation(progReduce, "count"), count);
+	glUniform1i(glGetUniformLocation(progReduce, "finalPass"), 0);
+
+	if (indirectOffset >= 0) glDispatchComputeIndirect(indirectOffset);
+	else glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// 2. fold the partials
+	glUniform1ui(glGetUniformLocation(progReduce, "count"), groups);
+	glUniform1i(glGetUniformLocation(progReduce, "finalPass"), 1);
+
+	if (indirectOffset >= 0) glDispatchComputeIndirect(indirectOffset + 3 * sizeof(GLuint));
+	else glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+float GPUPrimitives::reduceValue(GLuint input, GLuint count, REDUCE_OP op,
+								 GLuint stride, GLuint offset, float center, GLuint components)
+{
+	ensureBuffer(reduceResult, reduceResultSize, sizeof(float));
+	reduce(input, count, op, reduceResult, 0, stride, offset, center, components);
+
+	float value = 0.0f;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, reduceResult);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float), &value);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	return value;
+}
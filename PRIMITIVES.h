@@ -0,0 +1,66 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+// Reusable GPU building blocks (scan, radix sort, reductions) that operate
+// directly on SSBOs. Scan and reductions use SSBO bindings 12-14 and the
+// radix sort its own 15-19, past the solver's, so they can run between
+// simulation dispatches without disturbing the solver's bindings.
+
+#include <vector>
+
+#include "SHADER.h"
+
+class GPUPrimitives {
+public:
+	enum REDUCE_OP { SUM = 0, MIN = 1, MAX = 2, MAXABS = 3, MAXLENGTH = 4, MAXLENGTH_HALF = 5 };
+
+	GPUPrimitives() {};
+	~GPUPrimitives();
+
+	void init();
+
+	// exclusive prefix sum of count uints, input and output may alias
+	void exclusiveScan(GLuint input, GLuint output, GLuint count);
+
+	// stable LSD radix sort of uint keys with a uint payload, in place
+	void radixSort(GLuint keys, GLuint values, GLuint count, int keyBits = 32);
+
+	// reduces one float per element (element i is input[i * stride + offset])
+	// into result[resultIndex], stays on the GPU. MAXABS reduces |x - center|,
+	// MAXLENGTH reduces the length of the components floats starting there,
+	// MAXLENGTH_HALF the same for half floats packed two per float slot.
+	// With indirectOffset >= 0 both passes take their sizes from the bound
+	// GL_DISPATCH_INDIRECT_BUFFER, (reduceGroups(count), 1, 1) there and
+	// (1, 1, 1) 12 bytes on, so a shader can cancel the reduce by zeroing them.
+	void reduce(GLuint input, GLuint count, REDUCE_OP op, GLuint result, GLuint resultIndex = 0,
+				GLuint stride = 1, GLuint offset = 0, float center = 0.0f, GLuint components = 1,
+				GLintptr indirectOffset = -1);
+
+	// workgroups of the first reduce pass over count elements
+	static GLuint reduceGroups(GLuint count);
+
+	// same as above but reads the value back (synchronizes)
+	float reduceValue(GLuint input, GLuint count, REDUCE_OP op,
+					  GLuint stride = 1, GLuint offset = 0, float center = 0.0f, GLuint components = 1);
+
+private:
+	void ensureBuffer(GLuint &buffer, GLsizeiptr &capacity, GLsizeiptr bytes);
+
+	GLuint progScanBlocks = 0, progScanAdd = 0;
+	GLuint progRadixCount = 0, progRadixScatter = 0;
+	GLuint progReduce = 0;
+
+	// one block-sum buffer per scan level
+	std::vector<GLuint> scanLevels;
+	std::vector<GLsizeiptr> scanLevelSizes;
+
+	GLuint sortKeys = 0, sortValues = 0, sortHistogram = 0;
+	GLsizeiptr sortKeysSize = 0, sortValuesSize = 0, sortHistogramSize = 0;
+
+	GLuint reducePartials = 0, reduceResult = 0;
+	GLsizeiptr reducePartialsSize = 0, reduceResultSize = 0;
+
+	void scanLevel(GLuint input, GLuint output, GLuint count, size_t level);
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include "PROFILER.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+GPUProfiler::~GPUProfiler()
+{
+	for (size_t i = 0; i < slots.size(); i++)
+		if (!slots[i].queries.empty())
+			glDeleteQueries((GLsizei)slots[i].queries.size(), slots[i].queries.data());
+}
+
+void GPUProfiler::init(int numSlots)
+{
+	slots.resize(numSlots);
+}
+
+int GPUProfiler::stageIndex(const char *stage)
+{
+	for (size_t i = 0; i < stages.size(); i++)
+		if (stages[i].name == stage) return (int)i;
+
+	stages.push_back(Stats());
+	stages.back().name = stage;
+	return (int)stages.size() - 1;
+}
+
+GLuint GPUProfiler::nextQuery()
+{
+	Slot &slot = slots[current];
+	size_t used = slot.samples.size() * 2 + (openStage >= 0 ? 1 : 0);
+
+	if (used >= slot.queries.size()) {
+		GLuint query;
+		glGenQueries(1, &query);
+		slot.queries.push_back(query);
+	}
+	return slot.queries[used];
+}
+
+void GPUProfiler::push(deque<float> &values, float value)
+{
+	values.push_back(value);
+	while ((int)values.size() > window) values.pop_front();
+}
+
+void GPUProfiler::collect(Slot &slot)
+{
+	slot.pending = false;
+
+	vector<float> frameMs(stages.size(), -1.0f);
+	float total = 0.0f;
+
+	for (size_t i = 0; i < slot.samples.size(); i++) {
+		GLuint64 start, stop;
+		glGetQueryObjectui64v(slot.samples[i].start, GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(slot.samples[i].stop, GL_QUERY_RESULT, &stop);
+
+		float ms = (stop - start) * 1e-6f;
+		int stage = slot.samples[i].stage;
+		frameMs[stage] = max(frameMs[stage], 0.0f) + ms;
+		total += ms;
+	}
+
+	// stages that didn't run this frame (render on a substep) aren't counted as zero
+	for (size_t i = 0; i < stages.size(); i++)
+		if (frameMs[i] >= 0.0f) push(stages[i].ms, frameMs[i]);
+	push(totals, total);
+	if (slot.iterations >= 0) push(iterations, (float)slot.iterations);
+}
+
+void GPUProfiler::beginFrame()
+{
+	if (!enabled || slots.empty()) return;
+	if (openStage >= 0) end();
+
+	current = (current + 1) % (int)slots.size();
+	Slot &slot = slots[current];
+
+	// the slot's previous frame, read only if it has landed
+	if (slot.pending) {
+		GLuint last = slot.samples.back().stop;
+		GLint available = 0;
+		glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) collect(slot);
+		else dropped++;
+	}
+
+	slot.samples.clear();
+	slot.iterations = -1;
+	slot.pending = false;
+	frames++;
+
+	if (printEvery > 0 && frames % printEvery == 0) print();
+}
+
+void GPUProfiler::flush()
+{
+	if (slots.empty() || current < 0) return;
+	if (openStage >= 0) end();
+
+	// oldest first
+	for (size_t i = 1; i <= slots.size(); i++) {
+		Slot &slot = slots[(current + i) % slots.size()];
+		if (slot.pending) collect(slot);
+		slot.samples.clear();
+		slot.iterations = -1;
+	}
+}
+
+void GPUProfiler::begin(const char *stage)
+{
+	if (!enabled || current < 0) return;
+	if (openStage >= 0) end();
+
+	openQuery = nextQuery();
+	openStage = stageIndex(stage);
+	glQueryCounter(openQuery, GL_TIMESTAMP);
+}
+
+void GPUProfiler::end()
+{
+	if (!enabled || openStage < 0) return;
+
+	Slot &slot = slots[current];
+	GLuint stop = nextQuery();
+	glQueryCounter(stop, GL_TIMESTAMP);
+
+	Sample sample = { openStage, openQuery, stop };
+	slot.samples.push_back(sample);
+	slot.pending = true;
+	openStage = -1;
+}
+
+void GPUProfiler::recordIterations(int count)
+{
+	if (!enabled || current < 0) return;
+	slots[current].iterations = count;
+}
+
+void GPUProfiler::summarize(const deque<float> &values, float &lo, float &avg, float &p95) const
+{
+	lo = avg = p95 = 0.0f;
+	if (values.empty()) return;
+
+	vector<float> sorted(values.begin(), values.end());
+	sort(sorted.begin(), sorted.end());
+
+	float sum = 0.0f;
+	for (size_t i = 0; i < sorted.size(); i++) sum += sorted[i];
+
+	lo = sorted.front();
+	avg = sum / sorted.size();
+	p95 = sorted[min(sorted.size() - 1, (size_t)(0.95f * sorted.size()))];
+}
+
+void GPUProfiler::print()
+{
+	float lo, avg, p95;
+
+	printf("%-18s %9s %9s %9s %8s\n", "stage (ms)", "min", "avg", "p95", "frames");
+	for (size_t i = 0; i < stages.size(); i++) {
+		summarize(stages[i].ms, lo, avg, p95);
+		printf("%-18s %9.3f %9.3f %9.3f %8d\n", stages[i].name.c_str(), lo, avg, p95, (int)stages[i].ms.size());
+	}
+	summarize(totals, lo, avg, p95);
+	printf("%-18s %9.3f %9.3f %9.3f %8d\n", "total", lo, avg, p95, (int)totals.size());
+	summarize(iterations, lo, avg, p95);
+	printf("%-18s %9.1f %9.2f %9.1f %8d\n", "iterations", lo, avg, p95, (int)iterations.size());
+	if (dropped > 0) printf("(%ld frames dropped, queries still busy)\n", dropped);
+}
+
+bool GPUProfiler::writeCSV(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		cout << "could not open " << path << endl;
+		return false;
+	}
+
+	float lo, avg, p95;
+	fprintf(file, "stage,min_ms,avg_ms,p95_ms,frames\n");
+	for (size_t i = 0; i < stages.size(); i++) {
+		summarize(stages[i].ms, lo, avg, p95);
+		fprintf(file, "%s,%f,%f,%f,%d\n", stages[i].name.c_str(), lo, avg, p95, (int)stages[i].ms.size());
+	}
+	summarize(totals, lo, avg, p95);
+	fprintf(file, "total,%f,%f,%f,%d\n", lo, avg, p95, (int)totals.size());
+	summarize(iterations, lo, avg, p95);
+	fprintf(file, "iterations,%f,%f,%f,%d\n", lo, avg, p95, (int)iterations.size());
+
+	fclose(file);
+	return true;
+}
+
+void GPUProfiler::reset()
+{
+	for (size_t i = 0; i < stages.size(); i++) stages[i].ms.clear();
+	totals.clear();
+	iterations.clear();
+	dropped = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// memory report
+///////////////////////////////////////////////////////////////////////
+
+void MemoryReport::add(const char *name, GLuint buffer, bool perParticle)
+{
+	if (!buffer) return;
+
+	Entry entry;
+	entry.name = name;
+	entry.bytes = 0;
+	entry.perParticle = perParticle;
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &entry.bytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	entries.push_back(entry);
+}
+
+void MemoryReport::print(int numParticles) const
+{
+	GLint64 particleBytes = 0, totalBytes = 0;
+
+	printf("%-18s %12s %10s\n", "buffer", "bytes", "B/particle");
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry &entry = entries[i];
+		if (entry.perParticle) {
+			printf("%-18s %12lld %10.1f\n", entry.name.c_str(), (long long)entry.bytes, (double)entry.bytes / numParticles);
+			particleBytes += entry.bytes;
+		} else {
+			printf("%-18s %12lld %10s\n", entry.name.c_str(), (long long)entry.bytes, "-");
+		}
+		totalBytes += entry.bytes;
+	}
+	printf("%-18s %12lld %10.1f\n", "total", (long long)totalBytes, (double)particleBytes / numParticles);
+	printf("%d particles, %.2f MB of SSBOs\n", numParticles, totalBytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,88 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Per-stage GPU timing from GL_TIMESTAMP queries. Each frame gets its own set
+// of queries and results are only read once the driver reports them
+// available, a few frames later, so profiling never stalls the pipeline. A
+// frame whose queries are still busy when its slot comes around again is
+// dropped rather than waited on.
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "SHADER.h"
+
+class GPUProfiler {
+public:
+	GPUProfiler() {};
+	~GPUProfiler();
+
+	bool enabled = false;
+	int window = 300;		// frames kept for the rolling stats
+	int printEvery = 0;		// print the table every this many frames, 0 = never
+
+	void init(int numSlots = 4);
+
+	// closes the previous frame, collects whichever frames have landed
+	void beginFrame();
+
+	// time the GL work issued between begin and end under a stage name,
+	// repeated stages in one frame (PCISPH iterations) are summed
+	void begin(const char *stage);
+	void end();
+
+	// collects every outstanding frame, waiting on the GPU if needed; for the
+	// end of a run, not for use every frame
+	void flush();
+
+	// PCISPH iterations for the current frame
+	void recordIterations(int iterations);
+
+	void print();
+	bool writeCSV(const char *path);
+	void reset();
+
+private:
+	struct Sample { int stage; GLuint start, stop; };
+	struct Slot {
+		std::vector<GLuint> queries;
+		std::vector<Sample> samples;
+		int iterations = -1;
+		bool pending = false;
+	};
+	struct Stats {
+		std::string name;
+		std::deque<float> ms;
+	};
+
+	std::vector<Slot> slots;
+	int current = -1;
+	int openStage = -1;
+	GLuint openQuery = 0;
+	long frames = 0, dropped = 0;
+
+	std::vector<Stats> stages;
+	std::deque<float> totals, iterations;
+
+	int stageIndex(const char *stage);
+	GLuint nextQuery();
+	void collect(Slot &slot);
+	void push(std::deque<float> &values, float value);
+	void summarize(const std::deque<float> &values, float &lo, float &avg, float &p95) const;
+};
+
+// GPU memory footprint of a solver's buffers. Sizes are asked from GL, so
+// they are what was actually allocated; buffers that scale with the
+// particle count are summed into a bytes-per-particle figure.
+class MemoryReport {
+public:
+	void add(const char *name, GLuint buffer, bool perParticle = true);
+	void print(int numParticles) const;
+
+private:
+	struct Entry { std::string name; GLint64 bytes; bool perParticle; };
+	std::vector<Entry> entries;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "READBACK.h"
+
+AsyncReadback::~AsyncReadback()
+{
+	for (GLsync fence : fences)
+		if (fence) glDeleteSync(fence);
+
+	if (buffer == 0) return;
+	if (persistent) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+void AsyncReadback::init(GLsizeiptr bytes, int numSlots)
+{
+	slotBytes = bytes;
+	fences.assign(numSlots, 0);
+	flushed.assign(numSlots, 0);
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+	persistent = GLEW_ARB_buffer_storage;
+	if (persistent) {
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, slotBytes * numSlots, nullptr, flags);
+		mapped = (char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, slotBytes * numSlots, flags);
+		persistent = (mapped != nullptr);
+	}
+
+	// no persistent mapping, read the finished slot with glGetBufferSubData
+	if (!persistent) {
+		glBufferData(GL_COPY_WRITE_BUFFER, slotBytes * numSlots, nullptr, GL_STREAM_READ);
+		staging.resize(slotBytes);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void AsyncReadback::capture(int slot, GLuint src, GLintptr srcOffset, GLsizeiptr bytes)
+{
+	if (fences[slot]) glDeleteSync(fences[slot]);
+
+	// make shader writes to src visible to the copy
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, src);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, srcOffset, slot * slotBytes, bytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	flushed[slot] = 0;
+}
+
+bool AsyncReadback::ready(int slot)
+{
+	if (!fences[slot]) return false;
+
+	// an unflushed fence may never signal, so the first poll flushes it
+	GLbitfield flags = flushed[slot] ? 0 : GL_SYNC_FLUSH_COMMANDS_BIT;
+	flushed[slot] = 1;
+
+	GLenum status = glClientWaitSync(fences[slot], flags, 0);
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+const void *AsyncReadback::wait(int slot)
+{
+	if (fences[slot]) {
+		GLenum status = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		while (status == GL_TIMEOUT_EXPIRED)
+			status = glClientWaitSync(fences[slot], 0, 1000000000);
+
+		glDeleteSync(fences[slot]);
+		fences[slot] = 0;
+	}
+
+	if (persistent) return mapped + slot * slotBytes;
+
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, slot * slotBytes, slotBytes, staging.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	return staging.data();
+}
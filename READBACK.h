@@ -0,0 +1,43 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+// Small GPU->CPU readback ring. Each slot is filled with a buffer copy and
+// guarded by a fence, so the CPU only waits on work it queued earlier instead
+// of draining the whole pipeline like glGetBufferSubData on a live buffer.
+// Uses a persistently mapped buffer when ARB_buffer_storage is available.
+
+#include <vector>
+
+#include "SHADER.h"
+
+class AsyncReadback {
+public:
+	AsyncReadback() {};
+	~AsyncReadback();
+
+	void init(GLsizeiptr slotBytes, int numSlots);
+
+	// queue a copy of bytes from src into the slot, replacing what it held
+	void capture(int slot, GLuint src, GLintptr srcOffset, GLsizeiptr bytes);
+
+	// has the copy queued into the slot finished?
+	bool ready(int slot);
+
+	// blocks until the slot's copy is done, returns its contents
+	const void *wait(int slot);
+
+	bool pending(int slot) const { return fences[slot] != 0; }
+	int size() const { return (int)fences.size(); }
+
+private:
+	GLuint buffer = 0;
+	GLsizeiptr slotBytes = 0;
+	bool persistent = false;
+	char *mapped = nullptr;
+
+	std::vector<GLsync> fences;
+	std::vector<char> flushed;	// a poll has flushed the slot's fence
+	std::vector<char> staging;
+};
+
+#endif
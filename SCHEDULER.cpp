@@ -0,0 +1,65 @@
+#include "SCHEDULER.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+int FrameScheduler::beginFrame(float dt)
+{
+	Clock::time_point now = Clock::now();
+	if (!started) {
+		lastFrame = lastReport = now;
+		started = true;
+	}
+	double elapsed = chrono::duration<double>(now - lastFrame).count();
+	lastFrame = now;
+
+	int steps = substeps;
+	dropOwed = false;
+	if (mode == REALTIME) {
+		owed += elapsed * simRate;
+		steps = max(0, (int)floor(owed / dt));
+		if (steps > maxSubsteps) {
+			steps = maxSubsteps;
+			dropOwed = true;
+		}
+	}
+
+	stepsSinceReport += steps;
+	return steps;
+}
+
+void FrameScheduler::endFrame(double simAdvanced)
+{
+	// settle the debt with what the steps really covered, an overshoot is
+	// carried into the next frame
+	if (mode == REALTIME) owed = dropOwed ? 0.0 : owed - simAdvanced;
+	simSinceReport += simAdvanced;
+
+	if (shouldRender()) framesDrawn++;
+	frame++;
+}
+
+void FrameScheduler::printStats()
+{
+	Clock::time_point now = Clock::now();
+	double wall = started ? chrono::duration<double>(now - lastReport).count() : 0.0;
+
+	const char *names[] = {"substeps", "realtime"};
+	cout << "scheduler " << names[mode];
+	if (mode == SUBSTEPS) cout << " x" << substeps;
+	else cout << " x" << simRate;
+	cout << ", render every " << renderEvery << ": ";
+	if (wall > 0.0)
+		cout << simSinceReport / wall << " sim s/wall s, "
+			 << stepsSinceReport / wall << " steps/s, "
+			 << framesDrawn / wall << " fps";
+	cout << endl;
+
+	lastReport = now;
+	stepsSinceReport = 0;
+	framesDrawn = 0;
+	simSinceReport = 0.0;
+}
@@ -0,0 +1,47 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Decides how many simulation steps run per rendered frame. SUBSTEPS runs a
+// fixed count each frame, REALTIME runs however many fixed dt steps it takes
+// to keep simulated time advancing at simRate seconds per wall second.
+// renderEvery > 1 is the sim-only turbo mode: frames in between only step.
+
+#include <chrono>
+
+class FrameScheduler {
+public:
+	enum MODE { SUBSTEPS, REALTIME };
+	MODE mode = SUBSTEPS;
+
+	int substeps = 1;
+	float simRate = 1.0f;
+	int maxSubsteps = 16;	// REALTIME cap, drops time instead of falling behind forever
+	int renderEvery = 1;
+
+	// steps to run this frame, estimated from the current timestep dt
+	int beginFrame(float dt);
+
+	// should this frame be drawn and swapped?
+	bool shouldRender() const { return renderEvery <= 1 || (frame % renderEvery) == 0; }
+
+	// simAdvanced is the simulated time the frame's steps actually covered,
+	// which differs from steps * dt once an adaptive dt changes mid-frame
+	void endFrame(double simAdvanced);
+
+	// simulated seconds per wall second since the last report
+	void printStats();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point lastFrame, lastReport;
+	bool started = false;
+	double owed = 0.0;
+	bool dropOwed = false;	// the frame hit maxSubsteps
+
+	long frame = 0;
+	long stepsSinceReport = 0, framesDrawn = 0;
+	double simSinceReport = 0.0;
+};
+
+#endif
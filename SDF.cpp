@@ -0,0 +1,403 @@
+#include "SDF.h"
+#include "THREADS.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////
+// mesh loading
+///////////////////////////////////////////////////////////////////////
+
+static bool hasExtension(const string &path, const char *extension)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot == string::npos) return false;
+	string ext = path.substr(dot + 1);
+	for (char &c : ext) c = (char)tolower(c);
+	return ext == extension;
+}
+
+static bool loadOBJ(const char *path, TriangleMesh &mesh)
+{
+	ifstream file(path);
+	if (!file.is_open()) return false;
+
+	string line;
+	while (getline(file, line)) {
+		istringstream record(line);
+		string type;
+		record >> type;
+
+		if (type == "v") {
+			glm::vec3 v;
+			record >> v.x >> v.y >> v.z;
+			mesh.vertices.push_back(v);
+		} else if (type == "f") {
+			// "f 1 2 3", "f 1/1/1 2/2/2 3/3/3", negative indices count back
+			vector<GLuint> face;
+			string corner;
+			while (record >> corner) {
+				int index = atoi(corner.c_str());
+				if (index < 0) index += (int)mesh.vertices.size() + 1;
+				if (index < 1 || index > (int)mesh.vertices.size()) return false;
+				face.push_back((GLuint)index - 1);
+			}
+			for (size_t i = 2; i < face.size(); i++) {
+				mesh.indices.push_back(face[0]);
+				mesh.indices.push_back(face[i - 1]);
+				mesh.indices.push_back(face[i]);
+			}
+		}
+	}
+	return true;
+}
+
+static bool loadSTL(const char *path, TriangleMesh &mesh)
+{
+	ifstream file(path, ios::binary);
+	if (!file.is_open()) return false;
+	string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+	// binary: 80 byte header, a triangle count, 50 bytes per triangle.
+	// Some binary files start with "solid" too, so go by the size.
+	uint32_t count = 0;
+	if (data.size() >= 84) memcpy(&count, data.data() + 80, sizeof(count));
+	if (data.size() >= 84 && data.size() == 84 + 50 * (size_t)count) {
+		for (uint32_t t = 0; t < count; t++) {
+			const char *record = data.data() + 84 + 50 * (size_t)t;
+			for (int corner = 0; corner < 3; corner++) {
+				float v[3];
+				memcpy(v, record + 12 + 12 * corner, sizeof(v));
+				mesh.indices.push_back((GLuint)mesh.vertices.size());
+				mesh.vertices.push_back(glm::vec3(v[0], v[1], v[2]));
+			}
+		}
+		return true;
+	}
+
+	// ASCII: every "vertex x y z" line, three to a facet
+	istringstream text(data);
+	string word;
+	while (text >> word) {
+		if (word != "vertex") continue;
+		glm::vec3 v;
+		text >> v.x >> v.y >> v.z;
+		mesh.indices.push_back((GLuint)mesh.vertices.size());
+		mesh.vertices.push_back(v);
+	}
+	return mesh.indices.size() % 3 == 0;
+}
+
+bool TriangleMesh::load(const char *path)
+{
+	vertices.clear();
+	indices.clear();
+
+	bool ok = hasExtension(path, "stl") ? loadSTL(path, *this) : loadOBJ(path, *this);
+	if (!ok || indices.empty()) {
+		printf("could not load a triangle mesh from %s\n", path);
+		vertices.clear();
+		indices.clear();
+		return false;
+	}
+	return true;
+}
+
+void TriangleMesh::bounds(glm::vec3 &lo, glm::vec3 &hi) const
+{
+	lo = hi = vertices.empty() ? glm::vec3(0.0f) : vertices[0];
+	for (size_t i = 1; i < vertices.size(); i++) {
+		lo = glm::min(lo, vertices[i]);
+		hi = glm::max(hi, vertices[i]);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// bounding volume hierarchy, only needed while baking
+///////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Triangle { glm::vec3 a, b, c; };
+
+// an inner node has count 0 and its children at first and first + 1, a
+// leaf holds triangles [first, first + count)
+struct BVHNode {
+	glm::vec3 lo, hi;
+	int first = 0, count = 0;
+};
+
+class TriangleBVH {
+public:
+	// false if the mesh has no triangle with an area
+	bool build(const TriangleMesh &mesh);
+
+	// distance from p to the closest point on the mesh
+	float distance(glm::vec3 p) const;
+
+	// x of every crossing of the ray start + t * (1, 0, 0), t > 0
+	void crossingsX(glm::vec3 start, vector<float> &xs) const;
+
+private:
+	vector<Triangle> triangles;
+	vector<BVHNode> nodes;
+
+	void split(int node, int first, int count);
+};
+
+glm::vec3 closestPointOnTriangle(glm::vec3 p, const Triangle &t)
+{
+	// Ericson, Real-Time Collision Detection 5.1.5
+	glm::vec3 ab = t.b - t.a, ac = t.c - t.a, ap = p - t.a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return t.a;
+
+	glm::vec3 bp = p - t.b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return t.b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return t.a + ab * (d1 / (d1 - d3));
+
+	glm::vec3 cp = p - t.c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return t.c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return t.a + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return t.b + (t.c - t.b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1.0f / (va + vb + vc);
+	return t.a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+float boxDistance2(glm::vec3 p, const BVHNode &node)
+{
+	glm::vec3 d = glm::max(glm::max(node.lo - p, p - node.hi), glm::vec3(0.0f));
+	return glm::dot(d, d);
+}
+
+glm::vec3 centroid(const Triangle &t)
+{
+	return (t.a + t.b + t.c) / 3.0f;
+}
+
+bool TriangleBVH::build(const TriangleMesh &mesh)
+{
+	// degenerate triangles have no closest point formula, and no area to hit
+	triangles.clear();
+	for (int t = 0; t < mesh.numTriangles(); t++) {
+		Triangle tri = { mesh.vertices[mesh.indices[3 * t]],
+						 mesh.vertices[mesh.indices[3 * t + 1]],
+						 mesh.vertices[mesh.indices[3 * t + 2]] };
+		if (glm::length(glm::cross(tri.b - tri.a, tri.c - tri.a)) > 0.0f)
+			triangles.push_back(tri);
+	}
+
+	nodes.clear();
+	if (triangles.empty()) return false;
+	nodes.reserve(2 * triangles.size());
+	nodes.push_back(BVHNode());
+	split(0, 0, (int)triangles.size());
+	return true;
+}
+
+void TriangleBVH::split(int node, int first, int count)
+{
+	glm::vec3 lo = triangles[first].a, hi = lo;
+	glm::vec3 centerLo = centroid(triangles[first]), centerHi = centerLo;
+	for (int t = first; t < first + count; t++) {
+		lo = glm::min(lo, glm::min(triangles[t].a, glm::min(triangles[t].b, triangles[t].c)));
+		hi = glm::max(hi, glm::max(triangles[t].a, glm::max(triangles[t].b, triangles[t].c)));
+		centerLo = glm::min(centerLo, centroid(triangles[t]));
+		centerHi = glm::max(centerHi, centroid(triangles[t]));
+	}
+	nodes[node].lo = lo;
+	nodes[node].hi = hi;
+	nodes[node].first = first;
+	nodes[node].count = count;
+	if (count <= 4) return;
+
+	// median split along the widest spread of centroids
+	glm::vec3 spread = centerHi - centerLo;
+	int axis = (spread.x > spread.y && spread.x > spread.z) ? 0 : (spread.y > spread.z ? 1 : 2);
+	int mid = first + count / 2;
+	nth_element(triangles.begin() + first, triangles.begin() + mid, triangles.begin() + first + count,
+				[axis](const Triangle &l, const Triangle &r) { return centroid(l)[axis] < centroid(r)[axis]; });
+
+	int left = (int)nodes.size();
+	nodes.push_back(BVHNode());
+	nodes.push_back(BVHNode());
+	nodes[node].first = left;
+	nodes[node].count = 0;
+	split(left, first, mid - first);
+	split(left + 1, mid, first + count - mid);
+}
+
+float TriangleBVH::distance(glm::vec3 p) const
+{
+	float best = 3.402823466e+38f;
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		const BVHNode &node = nodes[stack[--top]];
+		if (boxDistance2(p, node) >= best) continue;
+
+		if (node.count > 0) {
+			for (int t = node.first; t < node.first + node.count; t++) {
+				glm::vec3 d = p - closestPointOnTriangle(p, triangles[t]);
+				best = min(best, glm::dot(d, d));
+			}
+			continue;
+		}
+
+		// nearer child on top so it tightens the bound first
+		int nearChild = node.first, farChild = node.first + 1;
+		if (boxDistance2(p, nodes[farChild]) < boxDistance2(p, nodes[nearChild])) swap(nearChild, farChild);
+		stack[top++] = farChild;
+		stack[top++] = nearChild;
+	}
+	return sqrt(best);
+}
+
+void TriangleBVH::crossingsX(glm::vec3 start, vector<float> &xs) const
+{
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		const BVHNode &node = nodes[stack[--top]];
+		if (start.y < node.lo.y || start.y > node.hi.y || start.z < node.lo.z || start.z > node.hi.z) continue;
+		if (node.hi.x < start.x) continue;
+
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+
+		// barycentric coordinates of the ray in the triangle's yz projection
+		for (int t = node.first; t < node.first + node.count; t++) {
+			const Triangle &tri = triangles[t];
+			glm::vec3 ab = tri.b - tri.a, ac = tri.c - tri.a, ap = start - tri.a;
+			float det = ab.y * ac.z - ac.y * ab.z;
+			if (det == 0.0f) continue;
+			float u = (ap.y * ac.z - ac.y * ap.z) / det;
+			float v = (ab.y * ap.z - ap.y * ab.z) / det;
+			if (u < 0.0f || v < 0.0f || u + v > 1.0f) continue;
+			float x = tri.a.x + u * ab.x + v * ac.x;
+			if (x > start.x) xs.push_back(x);
+		}
+	}
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////
+// signed distance field
+///////////////////////////////////////////////////////////////////////
+
+SignedDistanceField::~SignedDistanceField()
+{
+	if (texture) glDeleteTextures(1, &texture);
+}
+
+bool SignedDistanceField::bake(const TriangleMesh &mesh, int resolution, float padding)
+{
+	if (mesh.numTriangles() == 0 || resolution < 2) return false;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	glm::vec3 lo, hi;
+	mesh.bounds(lo, hi);
+	lo = lo - glm::vec3(padding);
+	hi = hi + glm::vec3(padding);
+	glm::vec3 extent = hi - lo;
+
+	spacing = max(extent.x, max(extent.y, extent.z)) / (resolution - 1);
+	dims = glm::ivec3((int)ceil(extent.x / spacing) + 1,
+					  (int)ceil(extent.y / spacing) + 1,
+					  (int)ceil(extent.z / spacing) + 1);
+	origin = lo;
+
+	TriangleBVH bvh;
+	if (!bvh.build(mesh)) return false;
+	samples.assign((size_t)dims.x * dims.y * dims.z, glm::vec4(0.0f));
+
+	// one ray per row of samples decides inside (odd crossings before the
+	// sample) for the whole row. The rows are nudged off the sample grid so
+	// they don't run exactly through the shared edges of a regular mesh.
+	glm::vec3 nudge(0.0f, 0.000618f * spacing, 0.000414f * spacing);
+	parallelFor(dims.z, [&](int begin, int end) {
+		vector<float> xs;
+		for (int k = begin; k < end; k++)
+		for (int j = 0; j < dims.y; j++) {
+			glm::vec3 row = origin + glm::vec3(-spacing, j * spacing, k * spacing) + nudge;
+			xs.clear();
+			bvh.crossingsX(row, xs);
+			sort(xs.begin(), xs.end());
+
+			size_t crossed = 0;
+			for (int i = 0; i < dims.x; i++) {
+				glm::vec3 p = origin + glm::vec3(i * spacing, j * spacing, k * spacing);
+				while (crossed < xs.size() && xs[crossed] < p.x) crossed++;
+				float d = bvh.distance(p);
+				samples[((size_t)k * dims.y + j) * dims.x + i].w = (crossed % 2) ? -d : d;
+			}
+		}
+	}, 1);
+
+	// normals from central differences of the distances, one-sided at the
+	// border
+	int size[3] = { dims.x, dims.y, dims.z };
+	parallelFor(dims.z, [&](int begin, int end) {
+		for (int k = begin; k < end; k++)
+		for (int j = 0; j < dims.y; j++)
+		for (int i = 0; i < dims.x; i++) {
+			int c[3] = { i, j, k };
+			glm::vec3 gradient;
+			for (int axis = 0; axis < 3; axis++) {
+				int below[3] = { i, j, k }, above[3] = { i, j, k };
+				below[axis] = max(c[axis] - 1, 0);
+				above[axis] = min(c[axis] + 1, size[axis] - 1);
+				float dBelow = samples[((size_t)below[2] * dims.y + below[1]) * dims.x + below[0]].w;
+				float dAbove = samples[((size_t)above[2] * dims.y + above[1]) * dims.x + above[0]].w;
+				gradient[axis] = (dAbove - dBelow) / ((above[axis] - below[axis]) * spacing);
+			}
+			float length = glm::length(gradient);
+			glm::vec4 &sample = samples[((size_t)k * dims.y + j) * dims.x + i];
+			if (length > 0.0f) gradient = gradient / length;
+			sample.x = gradient.x;
+			sample.y = gradient.y;
+			sample.z = gradient.z;
+		}
+	}, 1);
+
+	bakeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+void SignedDistanceField::upload()
+{
+	if (!texture) glGenTextures(1, &texture);
+
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, dims.x, dims.y, dims.z, 0, GL_RGBA, GL_FLOAT, samples.data());
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
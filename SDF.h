@@ -0,0 +1,47 @@
+#ifndef SDF_H
+#define SDF_H
+
+// Triangle mesh obstacles. A mesh is baked once on the CPU into a signed
+// distance field on a regular grid (negative inside), and uploaded as a 3D
+// texture holding the surface normal next to the distance, so a collision
+// pass costs one texture fetch per particle whatever the triangle count.
+
+#include <vector>
+
+#include "SETTINGS.h"
+
+struct TriangleMesh {
+	std::vector<glm::vec3> vertices;
+	std::vector<GLuint> indices;	// three per triangle
+
+	// OBJ (v and f records, polygons are fanned into triangles) or STL
+	// (binary or ASCII), picked by the file extension
+	bool load(const char *path);
+
+	int numTriangles() const { return (int)indices.size() / 3; }
+	void bounds(glm::vec3 &lo, glm::vec3 &hi) const;
+};
+
+class SignedDistanceField {
+public:
+	SignedDistanceField() {};
+	~SignedDistanceField();
+
+	// samples the mesh's distance on a grid with resolution samples along
+	// its longest axis, padded by padding on every side. The sign comes
+	// from ray parity, so the mesh should be closed.
+	bool bake(const TriangleMesh &mesh, int resolution, float padding);
+
+	// RGBA32F 3D texture, the normalized distance gradient in rgb and the
+	// distance in a. Samples sit at texel centers.
+	void upload();
+
+	GLuint texture = 0;
+	glm::ivec3 dims;
+	glm::vec3 origin;		// mesh space position of sample (0, 0, 0)
+	float spacing = 0.0f;
+	std::vector<glm::vec4> samples;
+	double bakeMs = 0.0;
+};
+
+#endif
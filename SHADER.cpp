@@ -1,121 +1,422 @@
 #include "SHADER.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
+#include <map>
+#include <iterator>
 #include <sstream>
 #include <iostream>
 
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
 using namespace std;
 
-GLuint createComputeShader(const char* filepath)
+///////////////////////////////////////////////////////////////////////
+// program binary cache
+///////////////////////////////////////////////////////////////////////
+
+static std::string binaryCacheDir = "shadercache";
+static ShaderStats stats;
+
+typedef std::chrono::steady_clock Clock;
+
+void setProgramBinaryCache(const char* dir)
 {
-    // 1. read the shader source from file
-    std::ifstream file(filepath);
+    binaryCacheDir = dir ? dir : "";
+}
+
+ShaderStats shaderStats()
+{
+    return stats;
+}
+
+void printShaderStats()
+{
+    std::cout << "shaders: " << stats.fromBinary + stats.compiled << " programs in "
+              << stats.ms << " ms, " << stats.fromBinary << " from the binary cache, "
+              << stats.compiled << " compiled";
+    if (stats.rejected) std::cout << " (" << stats.rejected << " cached binaries rejected)";
+    std::cout << std::endl;
+}
+
+static bool binaryCacheEnabled()
+{
+    if (binaryCacheDir.empty() || !GLEW_ARB_get_program_binary) return false;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// 64-bit FNV-1a over the driver and every source that goes into the program
+static std::string binaryCachePath(const std::vector<std::string>& sources)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const char* text) {
+        for (const char* c = text ? text : ""; ; c++) {
+            hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+            if (!*c) break;
+        }
+    };
+
+    mix((const char*)glGetString(GL_VENDOR));
+    mix((const char*)glGetString(GL_RENDERER));
+    mix((const char*)glGetString(GL_VERSION));
+    for (const std::string& source : sources) mix(source.c_str());
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+    return binaryCacheDir + "/" + name;
+}
+
+// file layout: binary format, then the bytes glGetProgramBinary returned
+static bool loadProgramBinary(GLuint program, const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    GLenum format = 0;
+    if (!file.read((char*)&format, sizeof(format))) return false;
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) return false;
+
+    glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+
+    // a driver update or a different GPU rejects it, compile instead
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) stats.rejected++;
+    return success == GL_TRUE;
+}
+
+static void storeProgramBinary(GLuint program, const std::string& path)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+#ifdef _WIN32
+    _mkdir(binaryCacheDir.c_str());
+#else
+    mkdir(binaryCacheDir.c_str(), 0755);
+#endif
+
+    // write then rename, so another launch never sees half a file
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary);
+        if (!file.is_open()) return;
+        file.write((const char*)&format, sizeof(format));
+        file.write(binary.data(), binary.size());
+        if (!file.good()) return;
+    }
+    std::rename(temp.c_str(), path.c_str());
+}
+
+// looks the sources up in the binary cache, a program that comes back
+// nonzero is linked and ready
+static GLuint programFromCache(const std::vector<std::string>& sources, std::string& cachePath)
+{
+    cachePath.clear();
+    if (!binaryCacheEnabled()) return 0;
+
+    cachePath = binaryCachePath(sources);
+    GLuint program = glCreateProgram();
+    if (loadProgramBinary(program, cachePath)) {
+        stats.fromBinary++;
+        return program;
+    }
+    glDeleteProgram(program);
+    return 0;
+}
+
+ShaderDefines &ShaderDefines::set(const char* name, int value)
+{
+    return set(name, std::to_string(value).c_str());
+}
+
+ShaderDefines &ShaderDefines::set(const char* name, float value)
+{
+    // enough digits to round trip, and always a float literal
+    char literal[32];
+    snprintf(literal, sizeof(literal), "%.9g", value);
+    std::string text = literal;
+    if (text.find_first_of(".en") == std::string::npos) text += ".0";
+    return set(name, text.c_str());
+}
+
+ShaderDefines &ShaderDefines::set(const char* name, const char* value)
+{
+    for (auto &define : defines) {
+        if (define.first == name) {
+            define.second = value;
+            return *this;
+        }
+    }
+    defines.push_back(std::make_pair(std::string(name), std::string(value)));
+    return *this;
+}
+
+std::string ShaderDefines::preamble() const
+{
+    std::string text;
+    for (const auto &define : defines)
+        text += "#define " + define.first + " " + define.second + "\n";
+    return text;
+}
+
+///////////////////////////////////////////////////////////////////////
+// deferred compiles
+///////////////////////////////////////////////////////////////////////
+
+// a program whose compile and link were submitted but not checked yet
+struct PendingProgram {
+    std::string label;
+    std::string cachePath;
+    std::vector<GLuint> shaders;
+};
+
+static std::map<GLuint, PendingProgram> pendingPrograms;
+
+static void enableParallelCompile()
+{
+    static bool enabled = false;
+    if (enabled) return;
+    enabled = true;
+
+    // let the driver compile on as many threads as it likes
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+}
+
+// reads a shader and expands #include "file" lines, resolved relative to
+// the including file. #line directives keep compiler errors pointing at the
+// right line (of the including file at least, GLSL has no file names).
+static std::string readFile(const char* path, int depth = 0)
+{
+    std::ifstream file(path);
     if (!file.is_open()) {
-        std::cerr << "Failed to open shader file: " << filepath << std::endl;
-        return 0;
+        std::cerr << "Failed to open shader file: " << path << std::endl;
+        return "";
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string sourceStr = buffer.str();
-    const char* source = sourceStr.c_str();
 
-    // 2. create the compute shader object
-    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
-    glShaderSource(shader, 1, &source, NULL);
-    glCompileShader(shader);
+    std::string dir(path);
+    size_t slash = dir.find_last_of("/\\");
+    dir = (slash == std::string::npos) ? "" : dir.substr(0, slash + 1);
 
-    // 3. check for compilation errors
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        std::cerr << "ERROR::COMPUTE_SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
+    std::string text, line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t directive = line.find_first_not_of(" \t");
+        if (directive != std::string::npos && line.compare(directive, 8, "#include") == 0) {
+            size_t open = line.find('"', directive);
+            size_t close = (open == std::string::npos) ? open : line.find('"', open + 1);
+            if (close == std::string::npos || depth >= 8) {
+                std::cerr << "Bad #include in " << path << ":" << lineNumber << std::endl;
+                return "";
+            }
+            std::string included = readFile((dir + line.substr(open + 1, close - open - 1)).c_str(), depth + 1);
+            if (included.empty()) return "";
+            text += "#line 1\n" + included + "#line " + std::to_string(lineNumber + 1) + "\n";
+            continue;
+        }
+        text += line + "\n";
     }
+    return text;
+}
 
-    // 4. create program and link shader
-    GLuint program = glCreateProgram();
-    glAttachShader(program, shader);
+// the defines go after the #version line, GLSL wants that first
+static void injectDefines(std::string& source, const std::string& preamble)
+{
+    if (preamble.empty()) return;
+    size_t version = source.find("#version");
+    size_t insert = (version == std::string::npos) ? 0 : source.find('\n', version);
+    insert = (insert == std::string::npos) ? source.size() : insert + 1;
+    // keep compiler line numbers matching the file
+    source.insert(insert, preamble + "#line " + std::to_string(std::count(source.begin(), source.begin() + insert, '\n') + 1) + "\n");
+}
+
+// submits the compiles and the link without asking for their status
+static GLuint queueProgram(const std::string& label, const std::vector<std::pair<GLenum, std::string> >& stages)
+{
+    Clock::time_point start = Clock::now();
+    enableParallelCompile();
+
+    std::vector<std::string> sources;
+    for (const auto& stage : stages) sources.push_back(stage.second);
+
+    std::string cachePath;
+    GLuint program = programFromCache(sources, cachePath);
+    if (program) {
+        stats.ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        return program;
+    }
+
+    PendingProgram pending;
+    pending.label = label;
+    pending.cachePath = cachePath;
+
+    program = glCreateProgram();
+    for (const auto& stage : stages) {
+        const char* source = stage.second.c_str();
+        GLuint shader = glCreateShader(stage.first);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        pending.shaders.push_back(shader);
+    }
+    if (!cachePath.empty()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
 
-    // 5. check linking errors
+    pendingPrograms[program] = pending;
+    stats.ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return program;
+}
+
+// the first status queries, these block until the driver is done
+static bool finishProgram(GLuint program, const PendingProgram& pending)
+{
+    bool ok = true;
+    GLint success;
+    for (GLuint shader : pending.shaders) {
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            char infoLog[512];
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            std::cerr << "ERROR::SHADER::COMPILATION_FAILED " << pending.label << "\n" << infoLog << std::endl;
+            ok = false;
+        }
+    }
+
     glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
         char infoLog[512];
         glGetProgramInfoLog(program, 512, NULL, infoLog);
-        std::cerr << "ERROR::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        std::cerr << "ERROR::PROGRAM::LINKING_FAILED " << pending.label << "\n" << infoLog << std::endl;
+        ok = false;
+    } else if (!pending.cachePath.empty()) {
+        storeProgramBinary(program, pending.cachePath);
     }
 
-    glDeleteShader(shader);
+    for (GLuint shader : pending.shaders) glDeleteShader(shader);
+
+    stats.compiled++;
+    return ok;
+}
+
+static bool finishShader(GLuint program)
+{
+    auto pending = pendingPrograms.find(program);
+    if (pending == pendingPrograms.end()) return true;
+
+    Clock::time_point start = Clock::now();
+    bool ok = finishProgram(program, pending->second);
+    pendingPrograms.erase(pending);
+    stats.ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return ok;
+}
+
+bool finishShaders()
+{
+    if (pendingPrograms.empty()) return true;
+
+    Clock::time_point start = Clock::now();
+    bool ok = true;
+    for (const auto& pending : pendingPrograms)
+        ok = finishProgram(pending.first, pending.second) && ok;
+    pendingPrograms.clear();
+    stats.ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// compute and render programs
+///////////////////////////////////////////////////////////////////////
+
+static std::map<std::string, GLuint> shaderCache;
+
+GLuint queueComputeShader(const char* filepath, const ShaderDefines& defines)
+{
+    std::string preamble = defines.preamble();
+    std::string key = std::string(filepath) + "\n" + preamble;
+
+    auto cached = shaderCache.find(key);
+    if (cached != shaderCache.end()) return cached->second;
+
+    // 1. read the shader source from file
+    std::string sourceStr = readFile(filepath);
+    if (sourceStr.empty()) return 0;
+
+    // 2. inject the defines after the #version line
+    injectDefines(sourceStr, preamble);
 
+    // 3. compile and link in the background
+    GLuint program = queueProgram(filepath, { std::make_pair((GLenum)GL_COMPUTE_SHADER, sourceStr) });
+    shaderCache[key] = program;
     return program;
 }
 
-GLuint createRenderProgram(const char* vertexPath, const char* fragmentPath)
+GLuint createComputeShader(const char* filepath)
 {
-    // Helper function to read a file into a string
-    auto readFile = [](const char* path) -> std::string {
-        std::ifstream file(path);
-        if (!file.is_open()) {
-            std::cerr << "Failed to open shader file: " << path << std::endl;
-            return "";
-        }
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
-    };
+    return createComputeShader(filepath, ShaderDefines());
+}
+
+GLuint createComputeShader(const char* filepath, const ShaderDefines& defines)
+{
+    GLuint program = queueComputeShader(filepath, defines);
+    finishShader(program);
+    return program;
+}
 
-    // 1. read shader sources
+void clearShaderCache()
+{
+    finishShaders();
+    for (auto &entry : shaderCache)
+        glDeleteProgram(entry.second);
+    shaderCache.clear();
+}
+
+GLuint queueRenderProgram(const char* vertexPath, const char* fragmentPath)
+{
+    return queueRenderProgram(vertexPath, fragmentPath, ShaderDefines());
+}
+
+GLuint queueRenderProgram(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines)
+{
     std::string vertexSourceStr = readFile(vertexPath);
     std::string fragmentSourceStr = readFile(fragmentPath);
-    const char* vertexSource = vertexSourceStr.c_str();
-    const char* fragmentSource = fragmentSourceStr.c_str();
 
     if (vertexSourceStr.empty() || fragmentSourceStr.empty()) {
         std::cerr << "Shader source missing." << std::endl;
         return 0;
     }
 
-    // 2. compile vertex shader
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexSource, NULL);
-    glCompileShader(vertexShader);
-
-    GLint success;
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cerr << "ERROR::VERTEX_SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-    // 3. compile fragment shader
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-    glCompileShader(fragmentShader);
-
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cerr << "ERROR::FRAGMENT_SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-    // 4. link shaders into a program
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER_PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-    }
+    // both stages see the same defines
+    std::string preamble = defines.preamble();
+    injectDefines(vertexSourceStr, preamble);
+    injectDefines(fragmentSourceStr, preamble);
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    return queueProgram(std::string(vertexPath) + " + " + fragmentPath,
+                        { std::make_pair((GLenum)GL_VERTEX_SHADER, vertexSourceStr),
+                          std::make_pair((GLenum)GL_FRAGMENT_SHADER, fragmentSourceStr) });
+}
 
-    return shaderProgram;
-}
\ No newline at end of file
+GLuint createRenderProgram(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines)
+{
+    GLuint program = queueRenderProgram(vertexPath, fragmentPath, defines);
+    finishShader(program);
+    return program;
+}
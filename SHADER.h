@@ -10,5 +10,58 @@
 #include <GL/freeglut.h>
 #endif
 
+#include <string>
+#include <utility>
+#include <vector>
+
+// #defines injected right after a shader's #version line (GLSL wants
+// #version first), so one source file compiles into variants with
+// constants baked in as literals the compiler can fold.
+// Shader files may also #include "file" relative to their own directory.
+class ShaderDefines {
+public:
+    ShaderDefines &set(const char* name, int value);
+    ShaderDefines &set(const char* name, float value);
+    ShaderDefines &set(const char* name, const char* value = "");
+
+    std::string preamble() const;
+
+private:
+    std::vector<std::pair<std::string, std::string> > defines;
+};
+
 GLuint createComputeShader(const char* filepath);
-GLuint createRenderProgram(const char* vertexPath, const char* fragmentPath);
+
+// compiles a variant of the file with the defines injected. Variants are
+// cached by path and defines, asking for one that was built before returns
+// the same program, so callers must not delete it
+GLuint createComputeShader(const char* filepath, const ShaderDefines& defines);
+void clearShaderCache();
+
+// Queued compiles hand back a program right away while the driver compiles
+// in the background, on several threads with KHR_parallel_shader_compile.
+// finishShaders() makes the first status queries, reports errors and fills
+// the binary cache; call it before the queued programs are first used.
+// createComputeShader and createRenderProgram queue and finish in one go.
+GLuint queueComputeShader(const char* filepath, const ShaderDefines& defines = ShaderDefines());
+GLuint queueRenderProgram(const char* vertexPath, const char* fragmentPath);
+GLuint queueRenderProgram(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines);
+bool finishShaders();
+GLuint createRenderProgram(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines = ShaderDefines());
+
+// on-disk cache of linked program binaries, keyed by a hash of the driver
+// strings and the final sources (defines included). A binary the driver
+// rejects is recompiled from source and replaced. An empty dir turns the
+// cache off; the default is "shadercache".
+void setProgramBinaryCache(const char* dir);
+
+// programs created so far and the time the caller spent blocked creating
+// them, to compare cold and warm starts
+struct ShaderStats {
+    int fromBinary = 0;
+    int compiled = 0;
+    int rejected = 0;
+    double ms = 0.0;
+};
+ShaderStats shaderStats();
+void printShaderStats();
@@ -0,0 +1,68 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Host SIMD support for the CPU solver: which vector ISA the running CPU has,
+// and 64-byte aligned float arrays with room for one full packet past the
+// end. The packet types themselves live in SIMD_PACKETS.h, which is only
+// included by the translation units built for each ISA.
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace simd {
+
+enum ISA { SCALAR, AVX2, AVX512 };
+
+inline const char *isaName(ISA isa)
+{
+	const char *names[] = {"scalar", "avx2", "avx512"};
+	return names[isa];
+}
+
+// widest ISA the running CPU supports
+inline ISA detectISA()
+{
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return AVX2;
+#endif
+	return SCALAR;
+}
+
+// widest packet, in floats; arrays keep this many spare floats at the end
+const int maxWidth = 16;
+const size_t alignment = 64;
+
+template <class T>
+struct AlignedAllocator {
+	typedef T value_type;
+	AlignedAllocator() {}
+	template <class U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+	T *allocate(size_t n)
+	{
+		size_t bytes = (n * sizeof(T) + alignment - 1) / alignment * alignment;
+		void *p = aligned_alloc(alignment, bytes);
+		if (!p) throw std::bad_alloc();
+		return static_cast<T *>(p);
+	}
+	void deallocate(T *p, size_t) { free(p); }
+
+	template <class U> bool operator==(const AlignedAllocator<U> &) const { return true; }
+	template <class U> bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+
+typedef std::vector<float, AlignedAllocator<float> > FloatArray;
+
+// n floats plus zeroed padding, so a packet load that starts at any of the
+// first n floats stays inside the array
+inline void resizePadded(FloatArray &array, size_t n)
+{
+	array.assign(n + maxWidth, 0.0f);
+}
+
+} // namespace simd
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef SIMD_PACKETS_H
+#define SIMD_PACKETS_H
+
+// Float packets for the CPU solver's neighbor loops. Each type holds width
+// floats and a lane mask, with the handful of operations the kernels use.
+// Only the packet types the translation unit is compiled for exist: Scalar
+// always, Avx2 with -mavx2 -mfma and Avx512 with -mavx512f. Everything is in
+// an unnamed namespace so the ISA-specific builds never share a symbol.
+
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+// GCC 12 flags its own _mm512_undefined_ps placeholders once inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+namespace simd {
+namespace {
+
+// one lane, the fallback every build has
+struct Scalar {
+	static const int width = 1;
+	typedef bool Mask;
+	float v;
+
+	static Scalar set1(float x) { Scalar p; p.v = x; return p; }
+	static Scalar load(const float *src) { return set1(*src); }
+	static Scalar gather(const float *base, const int *index) { return set1(base[*index]); }
+	// lanes [0, n) of a packet
+	static Mask lanes(int n) { return n > 0; }
+
+	friend Scalar operator+(Scalar a, Scalar b) { return set1(a.v + b.v); }
+	friend Scalar operator-(Scalar a, Scalar b) { return set1(a.v - b.v); }
+	friend Scalar operator*(Scalar a, Scalar b) { return set1(a.v * b.v); }
+	friend Scalar operator/(Scalar a, Scalar b) { return set1(a.v / b.v); }
+	friend Mask operator<(Scalar a, Scalar b) { return a.v < b.v; }
+	friend Mask operator>(Scalar a, Scalar b) { return a.v > b.v; }
+};
+inline Scalar sqrt(Scalar a) { return Scalar::set1(std::sqrt(a.v)); }
+inline Scalar fmadd(Scalar a, Scalar b, Scalar c) { return Scalar::set1(a.v * b.v + c.v); }
+// a where the mask is set, 0 elsewhere
+inline Scalar select(bool m, Scalar a) { return Scalar::set1(m ? a.v : 0.0f); }
+inline bool maskAnd(bool a, bool b) { return a && b; }
+inline bool any(bool m) { return m; }
+// j + k for each lane k set in the mask, packed to the front of out, and
+// how many there were. Writes a full packet's worth of ints.
+inline int storeIndices(int *out, bool m, int j)
+{
+	*out = j;
+	return m;
+}
+// base[index[k]] -= a[k] for each lane k set in the mask; the indices of
+// the set lanes must differ
+inline void scatterSub(float *base, const int *index, bool m, Scalar a)
+{
+	if (m) base[*index] -= a.v;
+}
+inline float sum(Scalar a) { return a.v; }
+
+#ifdef __AVX2__
+struct Avx2 {
+	static const int width = 8;
+	typedef __m256 Mask;
+	__m256 v;
+
+	static Avx2 make(__m256 x) { Avx2 p; p.v = x; return p; }
+	static Avx2 set1(float x) { return make(_mm256_set1_ps(x)); }
+	static Avx2 load(const float *src) { return make(_mm256_loadu_ps(src)); }
+	static Avx2 gather(const float *base, const int *index)
+	{
+		return make(_mm256_i32gather_ps(base, _mm256_loadu_si256((const __m256i *)index), 4));
+	}
+	static Mask lanes(int n)
+	{
+		const __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		return _mm256_cmp_ps(index, _mm256_set1_ps((float)n), _CMP_LT_OQ);
+	}
+
+	friend Avx2 operator+(Avx2 a, Avx2 b) { return make(_mm256_add_ps(a.v, b.v)); }
+	friend Avx2 operator-(Avx2 a, Avx2 b) { return make(_mm256_sub_ps(a.v, b.v)); }
+	friend Avx2 operator*(Avx2 a, Avx2 b) { return make(_mm256_mul_ps(a.v, b.v)); }
+	friend Avx2 operator/(Avx2 a, Avx2 b) { return make(_mm256_div_ps(a.v, b.v)); }
+	friend Mask operator<(Avx2 a, Avx2 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	friend Mask operator>(Avx2 a, Avx2 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+};
+inline __m256 maskAnd(__m256 a, __m256 b) { return _mm256_and_ps(a, b); }
+inline Avx2 sqrt(Avx2 a) { return Avx2::make(_mm256_sqrt_ps(a.v)); }
+inline Avx2 fmadd(Avx2 a, Avx2 b, Avx2 c) { return Avx2::make(_mm256_fmadd_ps(a.v, b.v, c.v)); }
+inline Avx2 select(__m256 m, Avx2 a) { return Avx2::make(_mm256_and_ps(m, a.v)); }
+inline bool any(__m256 m) { return _mm256_movemask_ps(m) != 0; }
+inline int storeIndices(int *out, __m256 m, int j)
+{
+	// branch free, every lane writes and only the set ones advance
+	unsigned bits = _mm256_movemask_ps(m);
+	int count = 0;
+	for (int k = 0; k < 8; k++) {
+		out[count] = j + k;
+		count += (bits >> k) & 1;
+	}
+	return count;
+}
+inline void scatterSub(float *base, const int *index, __m256 m, Avx2 a)
+{
+	// AVX2 has no scatter
+	alignas(32) float values[8];
+	_mm256_store_ps(values, a.v);
+	for (unsigned bits = _mm256_movemask_ps(m); bits; bits &= bits - 1) {
+		int k = __builtin_ctz(bits);
+		base[index[k]] -= values[k];
+	}
+}
+inline float sum(Avx2 a)
+{
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_movehdup_ps(s));
+	return _mm_cvtss_f32(s);
+}
+#endif
+
+#ifdef __AVX512F__
+struct Avx512 {
+	static const int width = 16;
+	typedef __mmask16 Mask;
+	__m512 v;
+
+	static Avx512 make(__m512 x) { Avx512 p; p.v = x; return p; }
+	static Avx512 set1(float x) { return make(_mm512_set1_ps(x)); }
+	static Avx512 load(const float *src) { return make(_mm512_loadu_ps(src)); }
+	static Avx512 gather(const float *base, const int *index)
+	{
+		return make(_mm512_i32gather_ps(_mm512_loadu_si512(index), base, 4));
+	}
+	static Mask lanes(int n) { return n >= 16 ? (Mask)0xFFFF : (Mask)((1u << (n > 0 ? n : 0)) - 1); }
+
+	friend Avx512 operator+(Avx512 a, Avx512 b) { return make(_mm512_add_ps(a.v, b.v)); }
+	friend Avx512 operator-(Avx512 a, Avx512 b) { return make(_mm512_sub_ps(a.v, b.v)); }
+	friend Avx512 operator*(Avx512 a, Avx512 b) { return make(_mm512_mul_ps(a.v, b.v)); }
+	friend Avx512 operator/(Avx512 a, Avx512 b) { return make(_mm512_div_ps(a.v, b.v)); }
+	friend Mask operator<(Avx512 a, Avx512 b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+	friend Mask operator>(Avx512 a, Avx512 b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ); }
+};
+inline Avx512 sqrt(Avx512 a) { return Avx512::make(_mm512_sqrt_ps(a.v)); }
+inline Avx512 fmadd(Avx512 a, Avx512 b, Avx512 c) { return Avx512::make(_mm512_fmadd_ps(a.v, b.v, c.v)); }
+inline __mmask16 maskAnd(__mmask16 a, __mmask16 b) { return a & b; }
+inline Avx512 select(__mmask16 m, Avx512 a) { return Avx512::make(_mm512_maskz_mov_ps(m, a.v)); }
+inline bool any(__mmask16 m) { return m != 0; }
+inline int storeIndices(int *out, __mmask16 m, int j)
+{
+	// register compress and a plain store, the compressing store is slow on some CPUs
+	const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m512i index = _mm512_add_epi32(_mm512_set1_epi32(j), lane);
+	_mm512_storeu_si512(out, _mm512_maskz_compress_epi32(m, index));
+	return __builtin_popcount(m);
+}
+inline void scatterSub(float *base, const int *index, __mmask16 m, Avx512 a)
+{
+	__m512i slots = _mm512_loadu_si512(index);
+	__m512 old = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, slots, base, 4);
+	_mm512_mask_i32scatter_ps(base, m, slots, _mm512_sub_ps(old, a.v), 4);
+}
+inline float sum(Avx512 a) { return _mm512_reduce_add_ps(a.v); }
+#endif
+
+} // namespace
+} // namespace simd
+
+#endif
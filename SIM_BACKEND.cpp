@@ -0,0 +1,90 @@
+#include "SIM_BACKEND.h"
+#include "CPU_SPH.h"
+
+using namespace std;
+
+namespace {
+
+template <int DIM>
+class CPUBackend : public SimBackend {
+public:
+	typedef typename cpusph::Solver<DIM>::vec vec;
+
+	CPUBackend(int numParticles, int threads, simd::ISA maxISA, bool neighborLists, bool symmetricForces)
+		: sim(numParticles, threads, maxISA)
+	{
+		sim.neighborLists = neighborLists || symmetricForces;
+		sim.symmetricForces = symmetricForces;
+	}
+
+	const char *name() const { return "cpu"; }
+	int dim() const { return DIM; }
+	int getNumParticles() const { return sim.getNumParticles(); }
+
+	bool setParameter(const string &name, float value) { return sim.setParameter(name, value); }
+	void setAdaptiveDt(bool on) { sim.adaptiveDt = on; }
+
+	void init() { sim.init(); }
+	void step() { sim.step(); }
+
+	void download(vector<glm::vec4> &positions, vector<glm::vec4> *velocities)
+	{
+		vector<vec> values;
+		sim.readbackPositions(values);
+		widen(values, positions);
+		if (!velocities) return;
+		sim.readbackVelocities(values);
+		widen(values, *velocities);
+	}
+	bool upload(const vector<glm::vec4> &positions, const vector<glm::vec4> &velocities)
+	{
+		vector<vec> pos(positions.size()), vel(velocities.size());
+		for (size_t i = 0; i < pos.size(); i++)
+			for (int d = 0; d < DIM; d++) pos[i][d] = positions[i][d];
+		for (size_t i = 0; i < vel.size(); i++)
+			for (int d = 0; d < DIM; d++) vel[i][d] = velocities[i][d];
+		return sim.writeParticles(pos, vel);
+	}
+
+	double getSimTime() const { return sim.getSimTime(); }
+	float getDt() const { return sim.getDt(); }
+	int getLastIterations() const { return sim.getLastIterations(); }
+	float getAverageIterations() const { return sim.getAverageIterations(); }
+	void resetConvergenceStats() { sim.resetConvergenceStats(); }
+	void printConvergenceStats()
+	{
+		cout << "convergence cpu: " << getAverageIterations() << " iterations/step, "
+			 << sim.getThreads() << " threads (last " << getLastIterations() << ")";
+		if (sim.neighborLists)
+			cout << ", " << sim.getListBuilds() << " neighbor list builds (" << sim.getAverageListBuilds() << "/step)";
+		cout << endl;
+	}
+	void printSetupStats()
+	{
+		cout << "cpu: " << sim.getThreads() << " threads, " << simd::isaName(sim.getISA())
+			 << " kernels, " << sim.getSIMDWidth() << " wide"
+			 << (sim.neighborLists ? ", neighbor lists" : "")
+			 << (sim.symmetricForces ? ", symmetric forces" : "") << endl;
+	}
+
+private:
+	static void widen(const vector<vec> &in, vector<glm::vec4> &out)
+	{
+		out.resize(in.size());
+		for (size_t i = 0; i < in.size(); i++) {
+			out[i] = glm::vec4(0.0f);
+			for (int d = 0; d < DIM; d++) out[i][d] = in[i][d];
+		}
+	}
+
+	cpusph::Solver<DIM> sim;
+};
+
+} // namespace
+
+SimBackend *createCPUBackend(int dim, int numParticles, int threads, simd::ISA maxISA, bool neighborLists,
+							 bool symmetricForces)
+{
+	if (dim == 2) return new CPUBackend<2>(numParticles, threads, maxISA, neighborLists, symmetricForces);
+	return new CPUBackend<3>(numParticles, threads, maxISA, neighborLists, symmetricForces);
+}
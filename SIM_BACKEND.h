@@ -0,0 +1,69 @@
+#ifndef SIM_BACKEND_H
+#define SIM_BACKEND_H
+
+// Solver-only view of a simulation: parameters, init, step, state transfer
+// and stats, without rendering or input. The GL compute solvers and the CPU
+// solvers both sit behind it, so one scenario runs on either and is timed
+// the same way. GL-only features (obstacles, compact storage, checkpoints)
+// stay on the solver a GL backend wraps.
+
+#include <string>
+#include <vector>
+
+#include "SETTINGS.h"
+#include "SIMD.h"
+
+class GPUProfiler;
+
+class SimBackend {
+public:
+	virtual ~SimBackend() {}
+
+	// "gl" or "cpu"
+	virtual const char *name() const = 0;
+	virtual int dim() const = 0;
+	virtual int getNumParticles() const = 0;
+
+	// set before init; false if the name is unknown
+	virtual bool setParameter(const std::string &name, float value) = 0;
+	virtual void setAdaptiveDt(bool on) = 0;
+
+	// the apps' starting block of particles
+	virtual void init() = 0;
+	virtual void step() = 0;
+	// blocks until every queued step has finished
+	virtual void finish() {}
+
+	// particle state by id, xyz in a vec4 (z = 0 in 2D, w unused). upload
+	// writes nothing and returns false unless both hold getNumParticles().
+	virtual void download(std::vector<glm::vec4> &positions, std::vector<glm::vec4> *velocities = nullptr) = 0;
+	virtual bool upload(const std::vector<glm::vec4> &positions, const std::vector<glm::vec4> &velocities) = 0;
+
+	// stats
+	virtual double getSimTime() const = 0;
+	virtual float getDt() const = 0;
+	virtual int getLastIterations() const = 0;
+	virtual float getAverageIterations() const = 0;
+	virtual void resetConvergenceStats() = 0;
+	virtual void printConvergenceStats() = 0;
+	// one-time setup costs, like shader compiles
+	virtual void printSetupStats() {}
+
+	// per-stage timings, null when the backend has none
+	virtual GPUProfiler *getProfiler() { return nullptr; }
+
+	// trajectory export (TRAJECTORY.h), false when unsupported
+	virtual bool startTrajectory(const char *, int) { return false; }
+	virtual void stopTrajectory() {}
+};
+
+// The GL backends are sph2d::GLBackend and sph3d::GLBackend in
+// SIM_BACKEND_GL2D.h and SIM_BACKEND_GL3D.h, one per translation unit since
+// both solvers are named Parallel. threads = 0 uses every hardware thread,
+// and the CPU kernels are the widest up to maxISA the host has;
+// neighborLists switches the CPU solver to Verlet lists, and
+// symmetricForces to half lists with each force pair evaluated once.
+SimBackend *createCPUBackend(int dim, int numParticles, int threads = 0, simd::ISA maxISA = simd::AVX512,
+							 bool neighborLists = false, bool symmetricForces = false);
+
+#endif
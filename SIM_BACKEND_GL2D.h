@@ -0,0 +1,80 @@
+#ifndef SIM_BACKEND_GL2D_H
+#define SIM_BACKEND_GL2D_H
+
+// SimBackend over the 2D GL compute solver
+
+#include "PARTICLE_2D.h"
+#include "SIM_BACKEND.h"
+
+namespace sph2d {
+
+class GLBackend : public SimBackend {
+public:
+	// the GL objects are released with the backend, the context must still
+	// be current
+	explicit GLBackend(int numParticles) : sim(new Parallel(numParticles)), numParticles(numParticles) {}
+	~GLBackend() { delete sim; }
+	GLBackend(const GLBackend &) = delete;
+	GLBackend &operator=(const GLBackend &) = delete;
+
+	// GL-only setup: reordering, obstacles, convergence mode, checkpoints
+	Parallel &solver() { return *sim; }
+
+	const char *name() const { return "gl"; }
+	int dim() const { return 2; }
+	int getNumParticles() const { return numParticles; }
+
+	bool setParameter(const std::string &name, float value) { return sim->setParameter(name, value); }
+	void setAdaptiveDt(bool on) { sim->adaptiveDt = on; }
+
+	void init()
+	{
+		sim->initParticlesAndProgram();
+		sim->initObject();
+	}
+	void step() { sim->compute(); }
+	void finish() { glFinish(); }
+
+	void download(std::vector<glm::vec4> &positions, std::vector<glm::vec4> *velocities)
+	{
+		std::vector<vec2> values;
+		sim->readbackPositions(values);
+		widen(values, positions);
+		if (!velocities) return;
+		sim->readbackVelocities(values);
+		widen(values, *velocities);
+	}
+	bool upload(const std::vector<glm::vec4> &positions, const std::vector<glm::vec4> &velocities)
+	{
+		std::vector<vec2> pos(positions.size()), vel(velocities.size());
+		for (size_t i = 0; i < pos.size(); i++) pos[i] = vec2(positions[i].x, positions[i].y);
+		for (size_t i = 0; i < vel.size(); i++) vel[i] = vec2(velocities[i].x, velocities[i].y);
+		return sim->writeParticles(pos, vel);
+	}
+
+	double getSimTime() const { return sim->getSimTime(); }
+	float getDt() const { return sim->getDt(); }
+	int getLastIterations() const { return sim->getLastIterations(); }
+	float getAverageIterations() const { return sim->getAverageIterations(); }
+	void resetConvergenceStats() { sim->resetConvergenceStats(); }
+	void printConvergenceStats() { sim->printConvergenceStats(); }
+	void printSetupStats() { printShaderStats(); }
+
+	GPUProfiler *getProfiler() { return &sim->profiler; }
+	bool startTrajectory(const char *path, int every) { return sim->startTrajectory(path, every); }
+	void stopTrajectory() { sim->stopTrajectory(); }
+
+private:
+	static void widen(const std::vector<vec2> &in, std::vector<glm::vec4> &out)
+	{
+		out.resize(in.size());
+		for (size_t i = 0; i < in.size(); i++) out[i] = glm::vec4(in[i].x, in[i].y, 0.0f, 0.0f);
+	}
+
+	Parallel *sim;
+	int numParticles;
+};
+
+} // namespace sph2d
+
+#endif
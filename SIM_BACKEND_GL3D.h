@@ -0,0 +1,68 @@
+#ifndef SIM_BACKEND_GL3D_H
+#define SIM_BACKEND_GL3D_H
+
+// SimBackend over the 3D GL compute solver
+
+#include "PARTICLE_3D.h"
+#include "SIM_BACKEND.h"
+
+namespace sph3d {
+
+class GLBackend : public SimBackend {
+public:
+	// the GL objects are released with the backend, the context must still
+	// be current
+	explicit GLBackend(int numParticles) : sim(new Parallel(numParticles)), numParticles(numParticles) {}
+	~GLBackend() { delete sim; }
+	GLBackend(const GLBackend &) = delete;
+	GLBackend &operator=(const GLBackend &) = delete;
+
+	// GL-only setup: storage, obstacles, convergence mode, checkpoints
+	Parallel &solver() { return *sim; }
+
+	const char *name() const { return "gl"; }
+	int dim() const { return 3; }
+	int getNumParticles() const { return numParticles; }
+
+	bool setParameter(const std::string &name, float value) { return sim->setParameter(name, value); }
+	void setAdaptiveDt(bool on) { sim->adaptiveDt = on; }
+
+	void init()
+	{
+		sim->initSimBounds();
+		sim->initObject();
+		sim->initParticleAndPrograms();
+	}
+	void step() { sim->compute(); }
+	void finish() { glFinish(); }
+
+	void download(std::vector<glm::vec4> &positions, std::vector<glm::vec4> *velocities)
+	{
+		sim->readbackPositions(positions);
+		if (velocities) sim->readbackVelocities(*velocities);
+	}
+	bool upload(const std::vector<glm::vec4> &positions, const std::vector<glm::vec4> &velocities)
+	{
+		return sim->writeParticles(positions, velocities);
+	}
+
+	double getSimTime() const { return sim->getSimTime(); }
+	float getDt() const { return sim->getDt(); }
+	int getLastIterations() const { return sim->getLastIterations(); }
+	float getAverageIterations() const { return sim->getAverageIterations(); }
+	void resetConvergenceStats() { sim->resetConvergenceStats(); }
+	void printConvergenceStats() { sim->printConvergenceStats(); }
+	void printSetupStats() { printShaderStats(); }
+
+	GPUProfiler *getProfiler() { return &sim->profiler; }
+	bool startTrajectory(const char *path, int every) { return sim->startTrajectory(path, every); }
+	void stopTrajectory() { sim->stopTrajectory(); }
+
+private:
+	Parallel *sim;
+	int numParticles;
+};
+
+} // namespace sph3d
+
+#endif
@@ -0,0 +1,327 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "SPH_RUN.h"
+#include "CHECKPOINT.h"
+#include "PROFILER.h"
+
+using namespace std;
+
+// Headless batch runner: no window, no GLUT. Creates a surfaceless GL 4.3
+// core context through EGL (works with Mesa's llvmpipe on GPU-less nodes)
+// and runs the solver's compute path only, or the CPU solver with --cpu.
+
+///////////////////////////////////////////////////////////////////////
+// offscreen context
+///////////////////////////////////////////////////////////////////////
+bool createContext()
+{
+  EGLDisplay display = EGL_NO_DISPLAY;
+
+  // prefer Mesa's surfaceless platform, it needs no X server or DRM device
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  if (getPlatformDisplay)
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+    fprintf(stderr, "Failed to initialize EGL\n");
+    return false;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    fprintf(stderr, "EGL has no desktop OpenGL\n");
+    return false;
+  }
+
+  EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+  EGLConfig config = 0;
+  EGLint numConfigs = 0;
+  eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+  // request OpenGL 4.3 and core profile
+  EGLint contextAttribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 4,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  EGLContext context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0,
+                                        EGL_NO_CONTEXT, contextAttribs);
+  if (context == EGL_NO_CONTEXT) {
+    fprintf(stderr, "Failed to create a GL 4.3 core context\n");
+    return false;
+  }
+
+  // compute only, no default framebuffer needed
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    fprintf(stderr, "Failed to make the surfaceless context current\n");
+    return false;
+  }
+
+  // GLEW built for GLX reports a missing X display after it has already
+  // loaded the core entry points, that is fine here
+  glewExperimental = GL_TRUE;
+  GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  if (err == GLEW_ERROR_NO_GLX_DISPLAY) err = GLEW_OK;
+#endif
+  if (err != GLEW_OK) {
+    fprintf(stderr, "Failed to initialize GLEW\n");
+    return false;
+  }
+
+  printf("GL %s, %s\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// stepping
+///////////////////////////////////////////////////////////////////////
+void runSteps(SimBackend &sim, const RunOptions &options)
+{
+  typedef chrono::steady_clock Clock;
+
+  sim.setAdaptiveDt(options.adaptiveDt);
+  GPUProfiler *profiler = sim.getProfiler();
+  if (profiler) {
+    profiler->enabled = options.profile;
+    profiler->window = options.steps;
+    profiler->printEvery = options.reportEvery;
+  }
+
+  // the first step pays for shader and buffer warmup, keep it out of the timing
+  sim.step();
+  sim.finish();
+  printf("time_to_first_step_ms=%.1f\n",
+         chrono::duration<double, milli>(Clock::now() - options.launched).count());
+  sim.printSetupStats();
+  double simStart = sim.getSimTime();
+  sim.resetConvergenceStats();
+  if (profiler) profiler->reset();
+  if (!options.trajectoryPath.empty() &&
+      !sim.startTrajectory(options.trajectoryPath.c_str(), options.trajectoryEvery))
+    fprintf(stderr, "no trajectory export from the %s backend\n", sim.name());
+
+  Clock::time_point start = Clock::now();
+  for (int step = 1; step < options.steps; step++) {
+    sim.step();
+
+    if (options.reportEvery > 0 && step % options.reportEvery == 0) {
+      sim.finish();
+      double wall = chrono::duration<double>(Clock::now() - start).count();
+      printf("step %d sim_time=%.4f dt=%.6f wall_s=%.3f\n", step, sim.getSimTime(), sim.getDt(), wall);
+      fflush(stdout);
+    }
+  }
+  sim.finish();
+
+  double wall = chrono::duration<double>(Clock::now() - start).count();
+  double simSeconds = sim.getSimTime() - simStart;
+  int timed = options.steps - 1;
+
+  printf("steps=%d wall_s=%.3f ms_per_step=%.3f steps_per_s=%.2f sim_s=%.4f sim_s_per_wall_s=%.4f\n",
+         options.steps, wall, timed > 0 ? 1000.0 * wall / timed : 0.0,
+         wall > 0.0 ? timed / wall : 0.0, sim.getSimTime(), wall > 0.0 ? simSeconds / wall : 0.0);
+  sim.printConvergenceStats();
+
+  // waits for the writer to drain, outside the timing
+  sim.stopTrajectory();
+
+  if (profiler && options.profile) {
+    profiler->flush();
+    profiler->print();
+    if (!options.profileCSV.empty()) profiler->writeCSV(options.profileCSV.c_str());
+  }
+}
+
+void printPositionSummary(SimBackend &sim)
+{
+  vector<glm::vec4> positions;
+  sim.download(positions);
+
+  glm::vec3 mean(0.0f);
+  glm::vec3 lo = glm::vec3(positions[0]), hi = lo;
+  for (size_t i = 0; i < positions.size(); i++) {
+    glm::vec3 p = glm::vec3(positions[i]);
+    mean += p;
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+  mean /= (float)positions.size();
+
+  if (sim.dim() == 2)
+    printf("mean=(%.4f %.4f) min=(%.4f %.4f) max=(%.4f %.4f)\n",
+           mean.x, mean.y, lo.x, lo.y, hi.x, hi.y);
+  else
+    printf("mean=(%.4f %.4f %.4f) min=(%.4f %.4f %.4f) max=(%.4f %.4f %.4f)\n",
+           mean.x, mean.y, mean.z, lo.x, lo.y, lo.z, hi.x, hi.y, hi.z);
+}
+
+///////////////////////////////////////////////////////////////////////
+// command line
+///////////////////////////////////////////////////////////////////////
+void usage(const char *name)
+{
+  printf("usage: %s [options]\n", name);
+  printf("  --dim 2|3             which solver (default 3)\n");
+  printf("  --particles N         particle count (default: same as the app)\n");
+  printf("  --steps N             steps to run (default 1000)\n");
+  printf("  --report N            print progress every N steps\n");
+  printf("  --convergence MODE    sync, lagged or gpu\n");
+  printf("  --adaptive            adaptive CFL timestep\n");
+  printf("  --cpu                 multithreaded CPU solver instead of the GPU\n");
+  printf("  --threads N           CPU solver threads (default: all hardware threads)\n");
+  printf("  --isa ISA             widest CPU kernels to use: scalar, avx2 or avx512 (default)\n");
+  printf("  --neighbor-lists      CPU: Verlet neighbor lists, --set neighborSkin=F sets the skin\n");
+  printf("                        as a fraction of the smoothing radius (default 0.1)\n");
+  printf("  --symmetric           CPU: each force pair once from half lists, implies --neighbor-lists\n");
+  printf("  --shader-cache DIR    program binary cache (default shadercache, \"\" = off)\n");
+  printf("  --no-specialize       read kernel constants from the uniform block\n");
+  printf("  --compact             3D: fixed point positions, half float velocities\n");
+  printf("  --box                 turn on the default box obstacle (moving in 3D)\n");
+  printf("  --obstacle FILE       3D: OBJ or STL mesh obstacle, baked to a distance field\n");
+  printf("  --obstacle-res N      distance field samples along the mesh's longest axis (default 64)\n");
+  printf("  --memory              print bytes per particle and the buffer footprint\n");
+  printf("  --profile             per-stage GPU timings (every --report steps and at the end)\n");
+  printf("  --profile-csv FILE    also write the timing table as CSV\n");
+  printf("  --load FILE           start from a checkpoint, its dim and particle count win\n");
+  printf("  --save FILE           write a checkpoint after the last step\n");
+  printf("  --trajectory FILE     export positions and velocities while running\n");
+  printf("  --trajectory-every K  record every Kth step (default 1)\n");
+  printf("  --set name=value      simulation parameter, e.g. --set stiffness=0.004\n");
+  printf("                        (dt gravity restDensity smoothingRadius stiffness eta\n");
+  printf("                         viscosityStrength maxIterations cflNumber dtMin dtMax)\n");
+}
+
+bool parseArgs(int argc, char **argv, RunOptions &options)
+{
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if (arg == "--help" || arg == "-h") {
+      return false;
+    } else if (arg == "--adaptive") {
+      options.adaptiveDt = true;
+    } else if (arg == "--no-specialize") {
+      options.specializeKernels = false;
+    } else if (arg == "--compact") {
+      options.compactStorage = true;
+    } else if (arg == "--profile") {
+      options.profile = true;
+    } else if (arg == "--box") {
+      options.boxObstacle = true;
+    } else if (arg == "--cpu") {
+      options.cpu = true;
+    } else if (arg == "--memory") {
+      options.memoryReport = true;
+    } else if (arg == "--neighbor-lists") {
+      options.neighborLists = true;
+    } else if (arg == "--symmetric") {
+      options.symmetricForces = true;
+    } else if (!hasValue) {
+      fprintf(stderr, "missing value for %s\n", arg.c_str());
+      return false;
+    } else if (arg == "--dim") {
+      options.dim = atoi(argv[++i]);
+    } else if (arg == "--particles") {
+      options.numParticles = atoi(argv[++i]);
+    } else if (arg == "--steps") {
+      options.steps = atoi(argv[++i]);
+    } else if (arg == "--profile-csv") {
+      options.profile = true;
+      options.profileCSV = argv[++i];
+    } else if (arg == "--load") {
+      options.loadPath = argv[++i];
+    } else if (arg == "--save") {
+      options.savePath = argv[++i];
+    } else if (arg == "--trajectory") {
+      options.trajectoryPath = argv[++i];
+    } else if (arg == "--trajectory-every") {
+      options.trajectoryEvery = atoi(argv[++i]);
+    } else if (arg == "--obstacle") {
+      options.obstaclePath = argv[++i];
+    } else if (arg == "--obstacle-res") {
+      options.obstacleResolution = atoi(argv[++i]);
+    } else if (arg == "--threads") {
+      options.threads = atoi(argv[++i]);
+    } else if (arg == "--isa") {
+      string isa = argv[++i];
+      if (isa == "scalar") options.maxISA = simd::SCALAR;
+      else if (isa == "avx2") options.maxISA = simd::AVX2;
+      else if (isa == "avx512") options.maxISA = simd::AVX512;
+      else {
+        fprintf(stderr, "unknown ISA %s\n", isa.c_str());
+        return false;
+      }
+    } else if (arg == "--shader-cache") {
+      options.shaderCache = argv[++i];
+    } else if (arg == "--report") {
+      options.reportEvery = atoi(argv[++i]);
+    } else if (arg == "--convergence") {
+      string mode = argv[++i];
+      if (mode == "sync") options.convergence = 0;
+      else if (mode == "lagged") options.convergence = 1;
+      else if (mode == "gpu") options.convergence = 2;
+      else {
+        fprintf(stderr, "unknown convergence mode %s\n", mode.c_str());
+        return false;
+      }
+    } else if (arg == "--set") {
+      string assignment = argv[++i];
+      size_t eq = assignment.find('=');
+      if (eq == string::npos) {
+        fprintf(stderr, "expected name=value, got %s\n", assignment.c_str());
+        return false;
+      }
+      options.params.push_back(make_pair(assignment.substr(0, eq), (float)atof(assignment.c_str() + eq + 1)));
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg.c_str());
+      return false;
+    }
+  }
+
+  // the solver has to be built to the checkpoint's size
+  if (!options.loadPath.empty() &&
+      !CheckpointReader::peek(options.loadPath.c_str(), options.dim, options.numParticles))
+    return false;
+
+  if (options.dim != 2 && options.dim != 3) {
+    fprintf(stderr, "--dim must be 2 or 3\n");
+    return false;
+  }
+  if (options.steps < 1) {
+    fprintf(stderr, "--steps must be at least 1\n");
+    return false;
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////// 
+/////////////////////////////////////////////////////////////////////// 
+int main(int argc, char **argv)
+{
+  RunOptions options;
+  if (!parseArgs(argc, argv, options)) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (options.cpu)
+    return runHeadlessCPU(options);
+
+  if (!createContext())
+    return EXIT_FAILURE;
+
+  setProgramBinaryCache(options.shaderCache.c_str());
+  return options.dim == 2 ? runHeadless2D(options) : runHeadless3D(options);
+}
@@ -0,0 +1,95 @@
+#ifndef SPH_RUN_H
+#define SPH_RUN_H
+
+// Headless batch runner shared pieces. SPH_RUN.cpp makes the offscreen
+// context, parses the command line and steps a SimBackend; SPH_RUN_2D.cpp
+// and SPH_RUN_3D.cpp set up the GL backends and SPH_RUN_CPU.cpp the CPU ones.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SHADER.h"
+#include "SIM_BACKEND.h"
+
+struct RunOptions {
+  std::chrono::steady_clock::time_point launched = std::chrono::steady_clock::now();
+  int dim = 3;
+  int numParticles = 0;     // 0 keeps the interactive app's count
+  int steps = 1000;
+  int reportEvery = 0;      // print progress every this many steps, 0 = never
+  int convergence = -1;     // Parallel::CONVERGENCE, -1 keeps the default
+  bool adaptiveDt = false;
+  bool specializeKernels = true;
+  bool compactStorage = false;  // 3D only, 8-byte particle vectors
+  bool boxObstacle = false;    // the app's default box obstacle
+  std::string obstaclePath;   // 3D only, OBJ/STL mesh obstacle
+  int obstacleResolution = 64;
+  bool cpu = false;          // multithreaded CPU solver, no GL context
+  int threads = 0;          // CPU solver threads, 0 = all hardware threads
+  int maxISA = 2;           // simd::ISA cap for the CPU kernels, 2 = widest
+  bool neighborLists = false;  // CPU solver Verlet lists instead of grid rows
+  bool symmetricForces = false;  // CPU solver force pairs once, implies neighborLists
+  std::string shaderCache = "shadercache";  // program binaries, empty = off
+  bool profile = false;     // per-stage GPU timings
+  bool memoryReport = false;  // print the buffer footprint after init
+  std::string profileCSV;   // also write the timing table here
+  std::string loadPath;     // start from this checkpoint
+  std::string savePath;     // write a checkpoint after the last step
+  std::string trajectoryPath;  // export pos/vel while running
+  int trajectoryEvery = 1;
+  std::vector<std::pair<std::string, float> > params;
+};
+
+int runHeadless2D(const RunOptions &options);
+int runHeadless3D(const RunOptions &options);
+int runHeadlessCPU(const RunOptions &options);
+
+// named parameters go in before init, the grids are sized from them
+template <class SIM>
+bool applyParameters(SIM &sim, const RunOptions &options)
+{
+  for (size_t i = 0; i < options.params.size(); i++) {
+    if (!sim.setParameter(options.params[i].first, options.params[i].second)) {
+      fprintf(stderr, "unknown parameter %s\n", options.params[i].first.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// restores the checkpoint after init, then re-applies --set so the command
+// line still wins over the saved parameters
+template <class SIM>
+bool loadCheckpoint(SIM &sim, const RunOptions &options)
+{
+  if (options.loadPath.empty()) return true;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  if (!sim.loadCheckpoint(options.loadPath.c_str())) return false;
+  glFinish();
+  double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+  printf("loaded %s at sim_time=%.4f in %.2f ms\n", options.loadPath.c_str(), sim.getSimTime(), ms);
+  return applyParameters(sim, options);
+}
+
+template <class SIM>
+bool saveCheckpoint(SIM &sim, const RunOptions &options)
+{
+  if (options.savePath.empty()) return true;
+  if (!sim.saveCheckpoint(options.savePath.c_str())) return false;
+  printf("saved %s at sim_time=%.4f\n", options.savePath.c_str(), sim.getSimTime());
+  return true;
+}
+
+// runs the steps with no rendering and prints throughput
+void runSteps(SimBackend &sim, const RunOptions &options);
+
+// mean and bounds of the positions, for regression checks
+void printPositionSummary(SimBackend &sim);
+
+#endif
@@ -0,0 +1,29 @@
+#include "SIM_BACKEND_GL2D.h"
+#include "SPH_RUN.h"
+
+int runHeadless2D(const RunOptions &options)
+{
+  // same particle count as 2D_SPH
+  int numParticles = options.numParticles > 0 ? options.numParticles : 10000;
+
+  sph2d::GLBackend backend(numParticles);
+  sph2d::Parallel &sim = backend.solver();
+  if (!applyParameters(sim, options)) return EXIT_FAILURE;
+  sim.specializeKernels = options.specializeKernels;
+  if (options.compactStorage) fprintf(stderr, "--compact only applies to 3D, ignored\n");
+  if (!options.obstaclePath.empty()) fprintf(stderr, "--obstacle only applies to 3D, ignored\n");
+
+  backend.init();
+  sim.showObstacle = options.boxObstacle;
+  if (options.convergence >= 0)
+    sim.convergenceMode = (sph2d::Parallel::CONVERGENCE)options.convergence;
+  if (!loadCheckpoint(sim, options)) return EXIT_FAILURE;
+
+  printf("dim=2 particles=%d\n", numParticles);
+  if (options.memoryReport) sim.printMemoryReport();
+  runSteps(backend, options);
+  if (!saveCheckpoint(sim, options)) return EXIT_FAILURE;
+  printPositionSummary(backend);
+
+  return glGetError() == GL_NO_ERROR ? EXIT_SUCCESS : EXIT_FAILURE;
+}
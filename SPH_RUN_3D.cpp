@@ -0,0 +1,31 @@
+#include "SIM_BACKEND_GL3D.h"
+#include "SPH_RUN.h"
+
+int runHeadless3D(const RunOptions &options)
+{
+  // same particle count as 3D_SPH
+  int numParticles = options.numParticles > 0 ? options.numParticles : 48841;
+
+  sph3d::GLBackend backend(numParticles);
+  sph3d::Parallel &sim = backend.solver();
+  if (!applyParameters(sim, options)) return EXIT_FAILURE;
+  sim.specializeKernels = options.specializeKernels;
+  sim.compactStorage = options.compactStorage;
+
+  backend.init();
+  sim.doObstacle = options.boxObstacle;
+  if (options.convergence >= 0)
+    sim.convergenceMode = (sph3d::Parallel::CONVERGENCE)options.convergence;
+  if (!loadCheckpoint(sim, options)) return EXIT_FAILURE;
+  if (!options.obstaclePath.empty() &&
+      !sim.loadObstacleMesh(options.obstaclePath.c_str(), options.obstacleResolution))
+    return EXIT_FAILURE;
+
+  printf("dim=3 particles=%d\n", numParticles);
+  if (options.memoryReport) sim.printMemoryReport();
+  runSteps(backend, options);
+  if (!saveCheckpoint(sim, options)) return EXIT_FAILURE;
+  printPositionSummary(backend);
+
+  return glGetError() == GL_NO_ERROR ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,36 @@
+#include "SPH_RUN.h"
+
+int runHeadlessCPU(const RunOptions &options)
+{
+  // the GL-only features have no CPU counterpart, running without them would
+  // quietly give a different run than the one asked for
+  const char *unsupported = nullptr;
+  if (!options.loadPath.empty()) unsupported = "--load";
+  else if (!options.savePath.empty()) unsupported = "--save";
+  else if (!options.trajectoryPath.empty()) unsupported = "--trajectory";
+  else if (options.boxObstacle) unsupported = "--box";
+  else if (!options.obstaclePath.empty()) unsupported = "--obstacle";
+  else if (options.compactStorage) unsupported = "--compact";
+  else if (options.convergence >= 0) unsupported = "--convergence";
+  else if (options.profile || !options.profileCSV.empty()) unsupported = "--profile";
+  else if (options.memoryReport) unsupported = "--memory";
+  if (unsupported) {
+    fprintf(stderr, "%s is not supported with --cpu\n", unsupported);
+    return EXIT_FAILURE;
+  }
+
+  // same particle counts as the apps
+  int numParticles = options.numParticles > 0 ? options.numParticles : (options.dim == 2 ? 10000 : 48841);
+
+  SimBackend *backend = createCPUBackend(options.dim, numParticles, options.threads, (simd::ISA)options.maxISA,
+                                         options.neighborLists, options.symmetricForces);
+  if (!applyParameters(*backend, options)) return EXIT_FAILURE;
+  backend->init();
+
+  printf("dim=%d particles=%d\n", options.dim, numParticles);
+  runSteps(*backend, options);
+  printPositionSummary(*backend);
+
+  delete backend;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+// Splits [0, count) into one contiguous range per hardware thread and runs
+// fn(begin, end) on each, the calling thread takes the first range. Returns
+// once every range is done.
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template <class F>
+void parallelFor(int count, F fn, int minPerThread = 4096)
+{
+	int threads = std::max(1, (int)std::thread::hardware_concurrency());
+	threads = std::min(threads, std::max(1, count / minPerThread));
+	if (threads == 1) {
+		fn(0, count);
+		return;
+	}
+
+	int chunk = (count + threads - 1) / threads;
+	std::vector<std::thread> workers;
+	for (int begin = chunk; begin < count; begin += chunk)
+		workers.emplace_back(fn, begin, std::min(begin + chunk, count));
+	fn(0, chunk);
+
+	for (std::thread &worker : workers) worker.join();
+}
+
+// Persistent workers for code that splits a range many times per step, where
+// starting threads on every call would cost more than the work. run() hands
+// out parts [0, parts) one per thread, the calling thread takes part 0, and
+// returns once every part is done. Not reentrant.
+class ThreadPool {
+public:
+	// 0 = one thread per hardware thread
+	explicit ThreadPool(int threads = 0)
+	{
+		if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int i = 1; i < threads; i++)
+			workers.emplace_back(&ThreadPool::work, this, i);
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread &worker : workers) worker.join();
+	}
+
+	int size() const { return (int)workers.size() + 1; }
+
+	void run(int parts, const std::function<void(int)> &fn)
+	{
+		parts = std::min(parts, size());
+		if (parts <= 1) {
+			if (parts == 1) fn(0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			jobParts = parts;
+			pending = parts - 1;
+			generation++;
+		}
+		wake.notify_all();
+		fn(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return pending == 0; });
+		job = nullptr;
+	}
+
+	// contiguous ranges of [0, count) like parallelFor, at least
+	// minPerThread items each
+	template <class F>
+	void parallelFor(int count, F fn, int minPerThread = 1024)
+	{
+		int parts = std::min(size(), std::max(1, count / minPerThread));
+		int chunk = (count + parts - 1) / parts;
+		run(parts, [&](int part) {
+			int begin = part * chunk;
+			if (begin < count) fn(begin, std::min(begin + chunk, count));
+		});
+	}
+
+private:
+	void work(int index)
+	{
+		unsigned seen = 0;
+		for (;;) {
+			const std::function<void(int)> *fn;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+				if (index >= jobParts) continue;
+				fn = job;
+			}
+			(*fn)(index);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0) done.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	const std::function<void(int)> *job = nullptr;
+	int jobParts = 0;
+	int pending = 0;
+	unsigned generation = 0;
+	bool stopping = false;
+};
+
+#endif
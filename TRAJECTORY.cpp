@@ -0,0 +1,212 @@
+#include "TRAJECTORY.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+	close();
+}
+
+void TrajectoryWriter::addStream(const char *name, GLsizeiptr bytes, const float *rangeMin,
+								 const float *rangeMax)
+{
+	TrajectoryStream stream;
+	memset(&stream, 0, sizeof(stream));
+	strncpy(stream.name, name, sizeof(stream.name) - 1);
+	stream.bytes = bytes;
+	if (rangeMin) memcpy(stream.rangeMin, rangeMin, sizeof(stream.rangeMin));
+	if (rangeMax) memcpy(stream.rangeMax, rangeMax, sizeof(stream.rangeMax));
+	streams.push_back(stream);
+	frameBytes += bytes;
+}
+
+bool TrajectoryWriter::open(const char *path, int dim, int numParticles, int numSlots)
+{
+	if (file) return false;
+
+	file = fopen(path, "wb");
+	if (!file) {
+		cout << "could not open " << path << " for writing" << endl;
+		streams.clear();
+		frameBytes = 0;
+		return false;
+	}
+
+	memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+	header.version = TRAJECTORY_VERSION;
+	header.dim = dim;
+	header.numParticles = numParticles;
+	header.numStreams = streams.size();
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(streams.data(), sizeof(TrajectoryStream), streams.size(), file);
+
+	// one slot holds every stream of a frame back to back
+	slots.assign(numSlots, Slot());
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+	persistent = GLEW_ARB_buffer_storage;
+	if (persistent) {
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, frameBytes * numSlots, nullptr, flags);
+		mapped = (char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameBytes * numSlots, flags);
+		persistent = (mapped != nullptr);
+	}
+
+	// no persistent mapping, finished slots are read into host memory on the
+	// GL thread and the writer works from that copy
+	if (!persistent) {
+		glBufferData(GL_COPY_WRITE_BUFFER, frameBytes * numSlots, nullptr, GL_STREAM_READ);
+		for (Slot &slot : slots) slot.host.resize(frameBytes);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	steps = framesWritten = framesDropped = 0;
+	bytesWritten = 0.0;
+	stopping = writeFailed = false;
+	writer = thread(&TrajectoryWriter::writerLoop, this);
+	return true;
+}
+
+void TrajectoryWriter::step(double time, const GLuint *buffers)
+{
+	if (!file) return;
+
+	poll(false);
+	if (steps++ % every == 0) capture(time, buffers);
+}
+
+void TrajectoryWriter::capture(double time, const GLuint *buffers)
+{
+	int index = -1;
+	{
+		lock_guard<mutex> guard(lock);
+		for (size_t i = 0; i < slots.size() && index < 0; i++)
+			if (slots[i].state == FREE) index = i;
+	}
+	if (index < 0) {
+		framesDropped++;
+		return;
+	}
+
+	// make shader writes visible to the copies
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	GLintptr offset = index * frameBytes;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	for (size_t i = 0; i < streams.size(); i++) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffers[i]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, streams[i].bytes);
+		offset += streams[i].bytes;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	Slot &slot = slots[index];
+	slot.frame.frame = steps - 1;
+	slot.frame.time = time;
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state = IN_FLIGHT;
+	inFlight.push_back(index);
+}
+
+void TrajectoryWriter::poll(bool block)
+{
+	while (!inFlight.empty()) {
+		Slot &slot = slots[inFlight.front()];
+
+		GLenum status = glClientWaitSync(slot.fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, block ? 1000000000 : 0);
+		while (block && status == GL_TIMEOUT_EXPIRED)
+			status = glClientWaitSync(slot.fence, 0, 1000000000);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		if (!persistent) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, inFlight.front() * frameBytes, frameBytes, slot.host.data());
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+
+		{
+			lock_guard<mutex> guard(lock);
+			slot.state = QUEUED;
+			queued.push_back(inFlight.front());
+		}
+		wake.notify_one();
+		inFlight.pop_front();
+	}
+}
+
+const char *TrajectoryWriter::slotData(int slot)
+{
+	return persistent ? mapped + slot * frameBytes : slots[slot].host.data();
+}
+
+void TrajectoryWriter::writerLoop()
+{
+	unique_lock<mutex> guard(lock);
+	while (true) {
+		wake.wait(guard, [this] { return stopping || !queued.empty(); });
+		if (queued.empty()) break;
+
+		int index = queued.front();
+		queued.pop_front();
+		TrajectoryFrame frame = slots[index].frame;
+
+		// the slot is ours until it is marked free, write without the lock
+		guard.unlock();
+		bool ok = fwrite(&frame, sizeof(frame), 1, file) == 1
+			&& fwrite(slotData(index), frameBytes, 1, file) == 1;
+		guard.lock();
+
+		slots[index].state = FREE;
+		if (ok) {
+			framesWritten++;
+			bytesWritten += sizeof(frame) + frameBytes;
+		} else {
+			writeFailed = true;
+		}
+	}
+}
+
+void TrajectoryWriter::close()
+{
+	if (!file) return;
+
+	poll(true);
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+
+	if (fclose(file) != 0) writeFailed = true;
+	file = nullptr;
+	if (writeFailed) cout << "trajectory: some frames failed to write" << endl;
+
+	if (persistent) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	mapped = nullptr;
+	streams.clear();
+	frameBytes = 0;
+}
+
+void TrajectoryWriter::printStats()
+{
+	lock_guard<mutex> guard(lock);
+	printf("trajectory: %ld frames written (%.1f MB), %ld dropped, every %d of %ld steps\n",
+		   framesWritten, bytesWritten / (1024.0 * 1024.0), framesDropped, every, steps);
+	fflush(stdout);
+}
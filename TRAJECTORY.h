@@ -0,0 +1,109 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+// Streams particle buffers to disk every Kth step without stalling the
+// simulation. Each recorded step is copied on the GPU into a free slot of a
+// persistently mapped ring and fenced. Once the fence has passed the slot is
+// handed to a writer thread, which writes it straight from the mapping and
+// then frees it. If the writer falls behind and no slot is free, the frame is
+// dropped and counted rather than waited on.
+//
+// File layout: a header, a table of stream names, sizes and value ranges, then
+// per frame a {frame, time} record followed by each stream's bytes in table
+// order.
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SHADER.h"
+
+static const char TRAJECTORY_MAGIC[8] = { 'S', 'P', 'H', 'T', 'R', 'A', 'J', 0 };
+static const uint32_t TRAJECTORY_VERSION = 2;
+
+struct TrajectoryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t dim;
+	uint32_t numParticles;
+	uint32_t numStreams;
+};
+
+struct TrajectoryStream {
+	char name[24];
+	uint64_t bytes;
+	float rangeMin[3];	// what fixed point values map to, zero for floats
+	float rangeMax[3];
+};
+
+struct TrajectoryFrame {
+	uint64_t frame;
+	double time;
+};
+
+class TrajectoryWriter {
+public:
+	TrajectoryWriter() {};
+	~TrajectoryWriter();
+
+	int every = 1;		// record every this many steps
+
+	// streams are fixed for the life of the file, add them before open;
+	// close forgets them. Fixed point streams pass the range they decode to.
+	void addStream(const char *name, GLsizeiptr bytes, const float *rangeMin = nullptr,
+				   const float *rangeMax = nullptr);
+	bool open(const char *path, int dim, int numParticles, int numSlots = 4);
+	bool isOpen() const { return file != nullptr; }
+
+	// call once per step with the current buffer for each stream, in the
+	// order they were added. Also passes finished slots to the writer.
+	void step(double time, const GLuint *buffers);
+
+	// waits for every queued frame to reach the disk and closes the file
+	void close();
+
+	void printStats();
+
+private:
+	enum STATE { FREE, IN_FLIGHT, QUEUED };
+	struct Slot {
+		STATE state = FREE;
+		GLsync fence = 0;
+		TrajectoryFrame frame;
+		std::vector<char> host;		// copy when there is no persistent mapping
+	};
+
+	std::vector<TrajectoryStream> streams;
+	GLsizeiptr frameBytes = 0;
+	TrajectoryHeader header;
+
+	FILE *file = nullptr;
+	GLuint buffer = 0;
+	bool persistent = false;
+	char *mapped = nullptr;
+
+	std::vector<Slot> slots;
+	std::deque<int> inFlight;	// capture order, fences are checked front first
+
+	// shared with the writer thread
+	std::thread writer;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<int> queued;
+	bool stopping = false;
+	bool writeFailed = false;
+
+	long steps = 0, framesWritten = 0, framesDropped = 0;
+	double bytesWritten = 0.0;
+
+	void capture(double time, const GLuint *buffers);
+	void poll(bool block);
+	const char *slotData(int slot);
+	void writerLoop();
+};
+
+#endif
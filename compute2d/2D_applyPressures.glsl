@@ -1,20 +1,22 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
 layout(std430, binding = 0) buffer Pos { vec2 positions[]; };
 layout(std430, binding = 1) buffer Vel { vec2 velocities[]; };
 layout(std430, binding = 2) buffer Pressures { float pressures[]; };
 
-uniform float smoothingRadius;
-uniform float restDensity;
-uniform float stiffness;
-uniform float dt;
-uniform uint numParticles;
+#include "params.glsl"
+
+// kernel constants, literals when the solver specializes this shader
+#ifndef KERNEL_H
+#define KERNEL_H   smoothingRadius
+#define GRAD_COEFF gradCoeff
+#endif
 
-const float PI = 3.14159265359;
-vec2 boundsMin = vec2(0.0, 0.0);
-vec2 boundsMax = vec2(1024.0, 768.0);
 const float damping = 1.0;
 
 // Gradient of smoothing kernel
@@ -23,9 +25,7 @@ vec2 smoothingKernelGradient(vec2 r, float radius)
     float dst = length(r);
     if (dst >= radius || dst == 0.0) return vec2(0.0);
 
-    float volume = (PI * pow(radius, 4.0)) / 6.0;
-    float coeff = -2.0 * (radius - dst) / volume;
-    return coeff * normalize(r);
+    return GRAD_COEFF * (radius - dst) * (r / dst);
 }
 
 
@@ -34,7 +34,7 @@ void checkBoundary(uint i)
     vec2 pos = positions[i];
     vec2 vel = velocities[i];
 
-    for (int j = 0; j < 3; j++) {
+    for (int j = 0; j < 2; j++) {
         if (pos[j] < boundsMin[j]) {
             pos[j] = boundsMin[j];
             vel[j] *= -damping;
@@ -67,7 +67,7 @@ void main()
         float pj = pressures[j];
 
         vec2 r = xi - xj;
-        vec2 gradW = smoothingKernelGradient(r, smoothingRadius);
+        vec2 gradW = smoothingKernelGradient(r, KERNEL_H);
 
         // equation 4 from paper
         pressureForce += -(pi + pj) / (restDensity * restDensity) * gradW * stiffness;
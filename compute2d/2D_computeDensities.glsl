@@ -1,31 +1,30 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
 layout(std430, binding = 0) buffer Pos { vec2 positions[]; };
 layout(std430, binding = 1) buffer Vel { vec2 velocities[]; };
-layout(std430, binding = 2) buffer PredPos { vec2 predPos[]; };
-layout(std430, binding = 3) buffer PredVel { vec2 predVel[]; };
 layout(std430, binding = 4) buffer Pressures { float pressures[]; };
 layout(std430, binding = 5) buffer Density { float densities[]; };
-layout(std430, binding = 10) buffer MaxDensityError { uint maxDensityError; };
 
-uniform float dt;
-uniform float restDensity;
-uniform float smoothingRadius;
-uniform float delta;
-uniform uint numParticles;
+#include "params.glsl"
 
-const float PI = 3.14159265359;
+// kernel constants, literals when the solver specializes this shader
+#ifndef KERNEL_H
+#define KERNEL_H      smoothingRadius
+#define DENSITY_COEFF densityCoeff
+#endif
 
 // smoothing kernel
 float smoothingKernel(float dst, float radius){
     if (dst >= radius)
         return 0.0;
 
-    float volume = (PI * pow(radius, 4.0)) / 6.0;
     float diff = (radius - dst);
-    return (diff * diff) / volume;
+    return DENSITY_COEFF * diff * diff;
 }
 
 void main()
@@ -33,29 +32,23 @@ void main()
     uint i = gl_GlobalInvocationID.x;
     if (i >= numParticles) return;
 
-    // 1. predict vel and position in time
-    predVel[i] = velocities[i];
-    predPos[i] = positions[i] + dt * predVel[i];
+    // 1. predict the position in time, neighbors are predicted the same
+    // way on the fly instead of through a stored copy
+    vec2 xi = positions[i] + dt * velocities[i];
 
     // 2. predict density
     float predDensity = 0.0;
     for (uint j = 0; j < numParticles; j++) {
         // if (i == j) continue;
 
-        float r = length(predPos[i] - predPos[j]);
-        predDensity += smoothingKernel(r, smoothingRadius); // assuming mass is 1
+        float r = length(xi - (positions[j] + dt * velocities[j]));
+        predDensity += smoothingKernel(r, KERNEL_H); // assuming mass is 1
     }
 
     // save predicted density for pressure force
     densities[i] = predDensity;
 
-    // 3. calculate density error
-    float densityError = abs(predDensity - restDensity);
-
-    // update the max density error for eta
-    uint densityErrorBits = floatBitsToUint(densityError);
-    atomicMax(maxDensityError, densityErrorBits);
-
-    // 4. update pressure
+    // 3. update pressure, the max density error is reduced over
+    // densities afterwards
     pressures[i] += delta * (predDensity - restDensity);
 }
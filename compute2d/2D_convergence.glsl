@@ -0,0 +1,34 @@
+#version 430
+
+// end-of-iteration check for GPU-driven convergence: once the density error
+// is below eta the dispatch sizes drop to zero, so the remaining iterations
+// the CPU queued, density error reduce included, run as empty dispatches
+layout(local_size_x = 1) in;
+
+layout(std430, binding = 10) buffer MaxDensityError { float maxDensityError; };
+layout(std430, binding = 11) buffer DispatchArgs {
+    uint groupsX;
+    uint groupsY;
+    uint groupsZ;
+    uint iterations;
+    uint reduceGroupsX;     // the density error reduce, both passes
+    uint reduceGroupsY;
+    uint reduceGroupsZ;
+    uint foldGroupsX;
+    uint foldGroupsY;
+    uint foldGroupsZ;
+};
+
+#include "params.glsl"
+
+void main()
+{
+    if (groupsX == 0) return;
+
+    iterations++;
+    if (maxDensityError <= eta) {
+        groupsX = 0;
+        reduceGroupsX = 0;
+        foldGroupsX = 0;
+    }
+}
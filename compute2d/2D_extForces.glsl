@@ -1,29 +1,24 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
 layout(std430, binding = 0) buffer Pos { vec2 positions[]; };
 layout(std430, binding = 1) buffer Vel { vec2 velocities[]; };
 
-uniform float dt;
-uniform float gravity;
-
-uniform float mouseX;
-uniform float mouseY;
-uniform float mouseStrength;
-uniform float mouseRadius;
-uniform int isDown;
-uniform int forceType;
+#include "params.glsl"
 
 void main()
 {
     uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
 
     // apply gravity
     velocities[i].y -= gravity * dt;
 
     if (isDown == 1) {
-        vec2 mousePos = vec2(mouseX, mouseY);
         vec2 dir = positions[i] - mousePos;
         float dist = length(dir);
 
@@ -0,0 +1,34 @@
+#version 430
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
+
+layout(std430, binding = 0) buffer Pos { vec2 positions[]; };
+layout(std430, binding = 1) buffer Keys { uint keys[]; };
+layout(std430, binding = 2) buffer KeyCount { uint keyCount[]; };
+
+#include "params.glsl"
+
+// interleave the low 16 bits of x with zeros
+uint spreadBits(uint x) {
+    x &= 0x0000ffffu;
+    x = (x | (x << 8)) & 0x00ff00ffu;
+    x = (x | (x << 4)) & 0x0f0f0f0fu;
+    x = (x | (x << 2)) & 0x33333333u;
+    x = (x | (x << 1)) & 0x55555555u;
+    return x;
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
+
+    ivec2 c = clamp(ivec2(floor((positions[i] - boundsMin) / cellSize)), ivec2(0), gridDims - 1);
+    uint key = spreadBits(uint(c.x)) | (spreadBits(uint(c.y)) << 1);
+
+    keys[i] = key;
+    atomicAdd(keyCount[key], 1u);
+}
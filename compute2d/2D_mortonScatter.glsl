@@ -0,0 +1,27 @@
+#version 430
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
+
+layout(std430, binding = 0) buffer Keys { uint keys[]; };
+layout(std430, binding = 1) buffer KeyOffset { uint keyOffset[]; };
+layout(std430, binding = 2) buffer Permutation { uint permutation[]; };
+layout(std430, binding = 3) buffer ParticleIds { uint particleIds[]; };
+layout(std430, binding = 4) buffer ParticleSlots { uint particleSlots[]; };
+
+#include "params.glsl"
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
+
+    // new slot of the particle currently stored at i
+    uint slot = atomicAdd(keyOffset[keys[i]], 1u);
+    permutation[slot] = i;
+
+    // keep the id -> slot lookup current for rendering and readback
+    particleSlots[particleIds[i]] = slot;
+}
@@ -0,0 +1,27 @@
+#version 430
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
+
+// raw 32-bit copy, so the same program gathers vec2, float and uint buffers
+layout(std430, binding = 0) buffer Permutation { uint permutation[]; };
+layout(std430, binding = 1) buffer Src { uint src[]; };
+layout(std430, binding = 2) buffer Dst { uint dst[]; };
+
+#include "params.glsl"
+
+// per-call, not part of SimParams
+uniform uint components;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
+
+    uint from = permutation[i] * components;
+    uint to = i * components;
+    for (uint c = 0; c < components; c++)
+        dst[to + c] = src[from + c];
+}
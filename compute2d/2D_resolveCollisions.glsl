@@ -1,14 +1,19 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
 layout(std430, binding = 0) buffer Pos { vec2 positions[]; };
 layout(std430, binding = 1) buffer Vel { vec2 velocities[]; };
 
-uniform vec2 boxMin;
-uniform vec2 boxMax;
-uniform float restitution;  // e.g., 0.2 = loses 80% of energy
-uniform uint numParticles;
+#include "params.glsl"
+
+// kinematic boxes (KINEMATIC.h GPUBox), only xy is used
+struct Box { vec4 lo; vec4 hi; vec4 velocity; };
+layout(std430, binding = 6) readonly buffer Boxes { Box boxes[]; };
+uniform uint numBoxes;
 
 void main() {
     uint i = gl_GlobalInvocationID.x;
@@ -16,12 +21,20 @@ void main() {
 
     vec2 pos = positions[i];
     vec2 vel = velocities[i];
+    bool hit = false;
 
-    bool inside = all(greaterThanEqual(pos, boxMin)) && all(lessThanEqual(pos, boxMax));
+    for (uint b = 0; b < numBoxes; b++) {
+        vec2 boxMin = boxes[b].lo.xy;
+        vec2 boxMax = boxes[b].hi.xy;
+        bool inside = all(greaterThanEqual(pos, boxMin)) && all(lessThanEqual(pos, boxMax));
+        if (!inside) continue;
+        hit = true;
 
-    if (inside) {
+        // bounce off the box in its own frame
+        vec2 boxVel = boxes[b].velocity.xy;
+        vel -= boxVel;
         vec2 boxCenter = 0.5 * (boxMin + boxMax);
-        
+
         // Find closest wall
         float dx = min(abs(pos.x - boxMin.x), abs(pos.x - boxMax.x));
         float dy = min(abs(pos.y - boxMin.y), abs(pos.y - boxMax.y));
@@ -43,7 +56,10 @@ void main() {
                 vel.y = -abs(vel.y) * restitution;
             }
         }
+        vel += boxVel;
+    }
 
+    if (hit) {
         positions[i] = pos;
         velocities[i] = vel;
     }
@@ -1,20 +1,24 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
 layout(std430, binding = 0) buffer Pos { vec2 positions[]; };
 layout(std430, binding = 1) buffer Vel { vec2 velocities[]; };
 
-uniform float viscosityStrength;
-uniform float smoothingRadius;
-uniform uint numParticles;
+#include "params.glsl"
 
-const float PI = 3.14159265359;
+// kernel constants, literals when the solver specializes this shader
+#ifndef KERNEL_H
+#define KERNEL_H        smoothingRadius
+#define VISCOSITY_COEFF viscosityCoeff
+#endif
 
 float viscosityKernel(float dst, float radius) {
     float diff = max(0.0, radius * radius - dst * dst);
-    float volume = PI * pow(radius, 8.0) / 4.0;
-    return (diff * diff * diff) / volume;
+    return VISCOSITY_COEFF * diff * diff * diff;
 }
 
 void main()
@@ -34,7 +38,7 @@ void main()
         vec2 vj = velocities[j];
 
         float dst = length(xi - xj);
-        float influence = viscosityKernel(dst, smoothingRadius);
+        float influence = viscosityKernel(dst, KERNEL_H);
         viscosityForce += (vj - vi) * influence;
     }
 
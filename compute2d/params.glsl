@@ -0,0 +1,12 @@
+// Simulation parameters shared by the compute2d kernels, a std140 uniform block
+// uploaded once per step. Must match SimParams in PARTICLE_2D.h.
+
+layout(std140, binding = 0) uniform SimParams {
+    vec2 boundsMin;          vec2 boundsMax;
+    vec2 mousePos;           float mouseStrength;   float mouseRadius;
+    ivec2 gridDims;          float cellSize;        uint numParticles;
+    float dt;                float gravity;         float restDensity;    float smoothingRadius;
+    float stiffness;         float delta;           float viscosityStrength; float eta;
+    float densityCoeff;      float gradCoeff;       float viscosityCoeff; float restitution;
+    int isDown;              int forceType;
+};
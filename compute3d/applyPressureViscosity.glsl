@@ -0,0 +1,100 @@
+#version 430
+
+// pressure correction and viscosity in one neighbor traversal. Does the work
+// of applyPressures.glsl followed by viscosity.glsl, but each pair is read
+// and measured once and the particle's state is written once; the viscosity
+// term sees neighbor velocities from before this iteration's pressure update
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
+
+#include "storage.glsl"
+layout(std430, binding = 7) buffer CellStart { uint cellStart[]; };
+layout(std430, binding = 8) buffer CellEnd { uint cellEnd[]; };
+layout(std430, binding = 9) buffer SortedIndices { uint sortedIndices[]; };
+
+#include "params.glsl"
+
+// kernel constants, literals when the solver specializes this shader
+#ifndef KERNEL_H
+#define KERNEL_H        smoothingRadius
+#define GRAD_COEFF      gradCoeff
+#define VISCOSITY_COEFF viscosityCoeff
+#endif
+
+const float damping = 1.0;
+
+float viscosityKernel(float r, float h) {
+    if (r >= h) return 0.0;
+
+    float diff = h - r;
+    return VISCOSITY_COEFF * diff;
+}
+
+ivec3 cellCoord(vec3 p) {
+    return clamp(ivec3(floor((p - gridMin) / cellSize)), ivec3(0), gridDims - 1);
+}
+
+void checkBoundary(inout vec3 pos, inout vec3 vel) {
+    for (int j = 0; j < 3; j++) {
+        if (pos[j] < boundsMin[j]) {
+            pos[j] = boundsMin[j];
+            vel[j] *= -damping;
+        }
+        if (pos[j] > boundsMax[j]) {
+            pos[j] = boundsMax[j];
+            vel[j] *= -damping;
+        }
+    }
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
+
+    vec3 xi = loadPos(i);
+    vec3 vi = loadVel(i);
+    float pi = loadPressure(i);
+
+    vec3 pressureForce = vec3(0.0);
+    vec3 viscosityForce = vec3(0.0);
+
+    ivec3 ci = cellCoord(xi);
+
+    for (int dz = -1; dz <= 1; dz++)
+    for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++) {
+        ivec3 c = ci + ivec3(dx, dy, dz);
+        if (any(lessThan(c, ivec3(0))) || any(greaterThanEqual(c, gridDims))) continue;
+
+        uint cell = uint((c.z * gridDims.y + c.y) * gridDims.x + c.x);
+        for (uint k = cellStart[cell]; k < cellEnd[cell]; k++) {
+            uint j = sortedIndices[k];
+            if (i == j) continue;
+
+            vec3 r = xi - loadPos(j);
+            float r_len = length(r);
+            if (r_len >= KERNEL_H) continue;
+
+            // equation 4 from paper
+            if (r_len > 0.0) {
+                float diff = KERNEL_H - r_len;
+                vec3 gradW = GRAD_COEFF * diff * diff * (r / r_len);
+                pressureForce += -(pi + loadPressure(j)) / (restDensity * restDensity) * gradW * stiffness;
+            }
+
+            viscosityForce += (loadVel(j) - vi) * viscosityKernel(r_len, KERNEL_H);
+        }
+    }
+
+    // pressure update moves the particle, viscosity only changes velocity
+    vec3 vel = vi + dt * pressureForce;
+    vec3 pos = xi + vel * dt;
+    checkBoundary(pos, vel);
+
+    storeNextPos(i, pos);
+    storeVel(i, vel + viscosityStrength * viscosityForce);
+}
@@ -1,35 +1,39 @@
 #version 430
 
-layout(local_size_x = 64) in;
-
-layout(std430, binding = 0) buffer Pos { vec4 positions[]; };
-layout(std430, binding = 1) buffer Vel { vec4 velocities[]; };
-layout(std430, binding = 5) buffer Pressures { float pressures[]; };
-
-uniform float dt;
-uniform float restDensity;
-uniform float smoothingRadius;
-uniform float stiffness;
-uniform uint numParticles;
-uniform vec3 boundsMin;
-uniform vec3 boundsMax;
-const float damping = 1.0;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
+
+#include "storage.glsl"
+layout(std430, binding = 7) buffer CellStart { uint cellStart[]; };
+layout(std430, binding = 8) buffer CellEnd { uint cellEnd[]; };
+layout(std430, binding = 9) buffer SortedIndices { uint sortedIndices[]; };
+
+#include "params.glsl"
 
-const float PI = 3.14159265359;
+// kernel constants, literals when the solver specializes this shader
+#ifndef KERNEL_H
+#define KERNEL_H   smoothingRadius
+#define GRAD_COEFF gradCoeff
+#endif
+
+const float damping = 1.0;
 
 // Gradient of smoothing kernel
 vec3 smoothingKernelGradient(vec3 r, float h) {
     float r_len = length(r);
     if (r_len >= h || r_len == 0.0) return vec3(0.0);
 
-    float coeff = -45.0 / (PI * pow(h, 6.0));
-    return coeff * pow(h - r_len, 2.0) * normalize(r);
+    float diff = h - r_len;
+    return GRAD_COEFF * diff * diff * (r / r_len);
 }
 
-void checkBoundary(uint i) {
-    vec3 pos = positions[i].xyz;
-    vec3 vel = velocities[i].xyz;
+ivec3 cellCoord(vec3 p) {
+    return clamp(ivec3(floor((p - gridMin) / cellSize)), ivec3(0), gridDims - 1);
+}
 
+void checkBoundary(inout vec3 pos, inout vec3 vel) {
     for (int j = 0; j < 3; j++) {
         if (pos[j] < boundsMin[j]) {
             pos[j] = boundsMin[j];
@@ -40,9 +44,6 @@ void checkBoundary(uint i) {
             vel[j] *= -damping;
         }
     }
-
-    positions[i].xyz = pos;
-    velocities[i].xyz = vel;
 }
 
 void main()
@@ -50,28 +51,40 @@ void main()
     uint i = gl_GlobalInvocationID.x;
     if (i >= numParticles) return;
 
-    vec3 xi = positions[i].xyz;
-    float pi = pressures[i];
+    vec3 xi = loadPos(i);
+    float pi = loadPressure(i);
 
     vec3 pressureForce = vec3(0.0);
 
-    for (uint j = 0; j < numParticles; ++j)
-    {
-        if (i == j) continue;
+    ivec3 ci = cellCoord(xi);
+
+    for (int dz = -1; dz <= 1; dz++)
+    for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++) {
+        ivec3 c = ci + ivec3(dx, dy, dz);
+        if (any(lessThan(c, ivec3(0))) || any(greaterThanEqual(c, gridDims))) continue;
 
-        vec3 xj = positions[j].xyz;
-        float pj = pressures[j];
+        uint cell = uint((c.z * gridDims.y + c.y) * gridDims.x + c.x);
+        for (uint k = cellStart[cell]; k < cellEnd[cell]; k++) {
+            uint j = sortedIndices[k];
+            if (i == j) continue;
 
-        vec3 r = xi - xj;
-        vec3 gradW = smoothingKernelGradient(r, smoothingRadius);
+            vec3 xj = loadPos(j);
+            float pj = loadPressure(j);
 
-        // equation 4 from paper
-        pressureForce += -(pi + pj) / (restDensity * restDensity) * gradW * stiffness;
+            vec3 r = xi - xj;
+            vec3 gradW = smoothingKernelGradient(r, KERNEL_H);
+
+            // equation 4 from paper
+            pressureForce += -(pi + pj) / (restDensity * restDensity) * gradW * stiffness;
+        }
     }
 
     // update velocity and positions
-    velocities[i].xyz += dt * pressureForce;
-    positions[i].xyz  += velocities[i].xyz * dt;
+    vec3 vel = loadVel(i) + dt * pressureForce;
+    vec3 pos = xi + vel * dt;
+    checkBoundary(pos, vel);
 
-    checkBoundary(i);
+    storeNextPos(i, pos);
+    storeVel(i, vel);
 }
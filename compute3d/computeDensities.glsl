@@ -1,30 +1,33 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
-layout(std430, binding = 0) buffer Pos { vec4 positions[]; };
-layout(std430, binding = 1) buffer Vel { vec4 velocities[]; };
-layout(std430, binding = 2) buffer PredPos { vec4 predPos[]; };
-layout(std430, binding = 3) buffer PredVel { vec4 predVel[]; };
-layout(std430, binding = 4) buffer Density { float densities[]; };
-layout(std430, binding = 5) buffer Pressures { float pressures[]; };
-layout(std430, binding = 10) buffer MaxDensityError { uint maxDensityError; };
+#include "storage.glsl"
+layout(std430, binding = 7) buffer CellStart { uint cellStart[]; };
+layout(std430, binding = 8) buffer CellEnd { uint cellEnd[]; };
+layout(std430, binding = 9) buffer SortedIndices { uint sortedIndices[]; };
 
-uniform float dt;
-uniform float restDensity;
-uniform float smoothingRadius;
-uniform float delta;
-uniform uint numParticles;
+#include "params.glsl"
 
-const float PI = 3.14159265359;
+// kernel constants, literals when the solver specializes this shader
+#ifndef KERNEL_H
+#define KERNEL_H      smoothingRadius
+#define DENSITY_COEFF densityCoeff
+#endif
 
 // smoothing kernel, 3d poly6
 float smoothingKernel(float r, float h){
     if (r >= h) return 0.0;
 
     float hr2 = h * h - r * r;
-    float coeff = 315.0 / (64.0 * PI * pow(h, 9.0));
-    return coeff * pow(hr2, 3.0);
+    return DENSITY_COEFF * hr2 * hr2 * hr2;
+}
+
+ivec3 cellCoord(vec3 p) {
+    return clamp(ivec3(floor((p - gridMin) / cellSize)), ivec3(0), gridDims - 1);
 }
 
 void main()
@@ -32,29 +35,34 @@ void main()
     uint i = gl_GlobalInvocationID.x;
     if (i >= numParticles) return;
 
-    // 1. predict vel and position in time
-    predVel[i].xyz = velocities[i].xyz;
-    predPos[i].xyz = positions[i].xyz + dt * predVel[i].xyz;
+    // 1. predict the position in time, x + dt * v. Neighbors are predicted
+    // the same way on the fly instead of through a stored copy, which also
+    // never reads a neighbor's prediction before it was written
+    vec3 xi = loadPos(i) + dt * loadVel(i);
 
     // 2. predict density
     float predDensity = 0.0;
-    for (uint j = 0; j < numParticles; j++) {
-        // if (i == j) continue;
+    ivec3 ci = cellCoord(xi);
 
-        float r = length(predPos[i].xyz - predPos[j].xyz);
-        predDensity += smoothingKernel(r, smoothingRadius); // assuming mass is 1
-    }
+    for (int dz = -1; dz <= 1; dz++)
+    for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++) {
+        ivec3 c = ci + ivec3(dx, dy, dz);
+        if (any(lessThan(c, ivec3(0))) || any(greaterThanEqual(c, gridDims))) continue;
 
-    // save predicted density for pressure force
-    densities[i] = predDensity;
+        uint cell = uint((c.z * gridDims.y + c.y) * gridDims.x + c.x);
+        for (uint k = cellStart[cell]; k < cellEnd[cell]; k++) {
+            uint j = sortedIndices[k];
 
-    // 3. calculate density error
-    float densityError = abs(predDensity - restDensity);
+            float r = length(xi - (loadPos(j) + dt * loadVel(j)));
+            predDensity += smoothingKernel(r, KERNEL_H); // assuming mass is 1
+        }
+    }
 
-    // update the max density error for eta
-    uint densityErrorBits = floatBitsToUint(densityError);
-    atomicMax(maxDensityError, densityErrorBits);
+    // save predicted density for pressure force
+    storeDensity(i, predDensity);
 
-    // 4. update pressure
-    pressures[i] += delta * (predDensity - restDensity);
+    // 3. update pressure, the max density error is reduced over
+    // densities afterwards
+    storePressure(i, loadPressure(i) + delta * (predDensity - restDensity));
 }
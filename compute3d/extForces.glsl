@@ -1,20 +1,19 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
-layout(std430, binding = 0) buffer Pos { vec4 positions[]; };
-layout(std430, binding = 1) buffer Vel { vec4 velocities[]; };
+#include "storage.glsl"
 
-uniform float dt;
-uniform float gravity;
+#include "params.glsl"
 
-uniform vec3 boundsMin;
-uniform vec3 boundsMax;
 const float damping = 1.0;
 
 void checkBoundary(uint i) {
-    vec3 pos = positions[i].xyz;
-    vec3 vel = velocities[i].xyz;
+    vec3 pos = loadPos(i);
+    vec3 vel = loadVel(i);
 
     for (int j = 0; j < 3; j++) {
         if (pos[j] < boundsMin[j]) {
@@ -27,18 +26,24 @@ void checkBoundary(uint i) {
         }
     }
 
-    positions[i].xyz = pos;
-    velocities[i].xyz = vel;
+    storePos(i, pos);
+    storeVel(i, vel);
 }
 
 void main()
 {
     uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
 
     // apply gravity
-    velocities[i].y -= gravity * dt;    
+    vec3 vel = loadVel(i);
+    vel.y -= gravity * dt;
+    storeVel(i, vel);
 
-    positions[i].xyz += velocities[i].xyz * dt;
+    storePos(i, loadPos(i) + vel * dt);
 
     checkBoundary(i);
+
+    // the pressure iterations start from zero each step
+    storePressure(i, 0.0);
 }
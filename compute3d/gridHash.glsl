@@ -0,0 +1,25 @@
+#version 430
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
+
+#include "storage.glsl"
+layout(std430, binding = 6) buffer CellCount { uint cellCount[]; };
+
+#include "params.glsl"
+
+// particles that escape the bounds are clamped into the edge cells
+uint cellIndex(vec3 p) {
+    ivec3 c = clamp(ivec3(floor((p - gridMin) / cellSize)), ivec3(0), gridDims - 1);
+    return uint((c.z * gridDims.y + c.y) * gridDims.x + c.x);
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
+
+    atomicAdd(cellCount[cellIndex(loadPos(i))], 1u);
+}
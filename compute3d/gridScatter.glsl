@@ -0,0 +1,26 @@
+#version 430
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
+
+#include "storage.glsl"
+layout(std430, binding = 8) buffer CellEnd { uint cellEnd[]; };
+layout(std430, binding = 9) buffer SortedIndices { uint sortedIndices[]; };
+
+#include "params.glsl"
+
+uint cellIndex(vec3 p) {
+    ivec3 c = clamp(ivec3(floor((p - gridMin) / cellSize)), ivec3(0), gridDims - 1);
+    return uint((c.z * gridDims.y + c.y) * gridDims.x + c.x);
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
+
+    uint slot = atomicAdd(cellEnd[cellIndex(loadPos(i))], 1u);
+    sortedIndices[slot] = i;
+}
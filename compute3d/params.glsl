@@ -0,0 +1,12 @@
+// Simulation parameters shared by the compute3d kernels, a std140 uniform block
+// uploaded once per step. Must match SimParams in PARTICLE_3D.h.
+
+layout(std140, binding = 0) uniform SimParams {
+    vec3 boundsMin;          float dt;
+    vec3 boundsMax;          float gravity;
+    vec3 gridMin;            float cellSize;
+    ivec3 gridDims;          uint numParticles;
+    float restitution;       float eta;             float restDensity; float smoothingRadius;
+    float stiffness;         float delta;           float viscosityStrength; float densityCoeff;
+    float gradCoeff;         float viscosityCoeff;
+};
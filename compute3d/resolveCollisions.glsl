@@ -1,27 +1,38 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
-layout(std430, binding = 0) buffer Pos { vec4 positions[]; };
-layout(std430, binding = 1) buffer Vel { vec4 velocities[]; };
+#include "storage.glsl"
 
-uniform vec3 cubeMin;
-uniform vec3 cubeMax;
-uniform float restitution;  // e.g., 0.2 = loses 80% of energy
-uniform uint numParticles;
+#include "params.glsl"
+
+// kinematic boxes (KINEMATIC.h GPUBox), velocity in world units per second
+struct Box { vec4 lo; vec4 hi; vec4 velocity; };
+layout(std430, binding = 2) readonly buffer Boxes { Box boxes[]; };
+uniform uint numBoxes;
 
 void main() {
     uint i = gl_GlobalInvocationID.x;
     if (i >= numParticles) return;
 
-    vec3 pos = positions[i].xyz;
-    vec3 vel = velocities[i].xyz;
+    vec3 pos = loadPos(i);
+    vec3 vel = loadVel(i);
+    bool hit = false;
 
-    bool inside = all(greaterThanEqual(pos, cubeMin)) && all(lessThanEqual(pos, cubeMax));
+    for (uint b = 0; b < numBoxes; b++) {
+        vec3 cubeMin = boxes[b].lo.xyz;
+        vec3 cubeMax = boxes[b].hi.xyz;
+        bool inside = all(greaterThanEqual(pos, cubeMin)) && all(lessThanEqual(pos, cubeMax));
+        if (!inside) continue;
+        hit = true;
 
-    if (inside) {
+        // bounce off the box in its own frame
+        vec3 boxVel = boxes[b].velocity.xyz;
+        vel -= boxVel;
         vec3 cubeCenter = 0.5 * (cubeMin + cubeMax);
-        vec3 dir = normalize(pos - cubeCenter);
 
         // Resolve by pushing out along the closest face
         float dx = min(abs(pos.x - cubeMin.x), abs(pos.x - cubeMax.x));
@@ -53,8 +64,11 @@ void main() {
                 vel.z = -abs(vel.z) * restitution;
             }
         }
+        vel += boxVel;
+    }
 
-        positions[i].xyz = pos;
-        velocities[i].xyz = vel;
+    if (hit) {
+        storePos(i, pos);
+        storeVel(i, vel);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,52 @@
+#version 430
+
+// pushes particles out of a triangle mesh obstacle through its baked signed
+// distance field (SDF.h), one texture fetch per particle
+
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
+
+#include "storage.glsl"
+
+#include "params.glsl"
+
+// normal in rgb, signed distance in a
+layout(binding = 0) uniform sampler3D sdf;
+
+uniform mat4 worldToMesh;   // inverse of the obstacle's rigid transform
+uniform mat3 meshToWorld;   // its rotation, for the normals
+uniform vec3 sdfOrigin;     // mesh space position of the first sample
+uniform vec3 sdfSize;       // mesh space size of the sampled box
+uniform float margin;       // particles are kept this far outside
+uniform float bounce;       // share of the inward normal velocity reflected
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= numParticles) return;
+
+    vec3 pos = loadPos(i);
+    vec3 t = ((worldToMesh * vec4(pos, 1.0)).xyz - sdfOrigin) / sdfSize;
+    if (any(lessThan(t, vec3(0.0))) || any(greaterThan(t, vec3(1.0)))) return;
+
+    // samples sit at texel centers
+    vec3 dims = vec3(textureSize(sdf, 0));
+    vec4 s = texture(sdf, (t * (dims - 1.0) + 0.5) / dims);
+    if (s.a >= margin) return;
+
+    vec3 n = meshToWorld * s.rgb;
+    float len = length(n);
+    if (len == 0.0) return;
+    n /= len;
+
+    // onto the surface plus the margin, and reflect the velocity if it
+    // still points in
+    pos += (margin - s.a) * n;
+    vec3 vel = loadVel(i);
+    float vn = dot(vel, n);
+    if (vn < 0.0) vel -= (1.0 + bounce) * vn * n;
+
+    storePos(i, pos);
+    storeVel(i, vel);
+}
@@ -0,0 +1,73 @@
+// Particle storage shared by the compute3d kernels and the sphere renderer.
+// The default is a vec4 per particle with the density in positions[i].w and
+// the pressure in velocities[i].w. COMPACT_STORAGE packs positions as 21-bit
+// fixed point over [STORAGE_MIN, STORAGE_MAX] and velocities as half floats,
+// 8 bytes each instead of 16, with density and pressure in float buffers of
+// their own. Kernels only touch the buffers through the helpers below.
+// Predicted positions aren't stored, they are x + dt * v.
+//
+// A packed position spans both words, so a neighbor read racing an in-place
+// store could see half of each. The neighbor passes store through
+// storeNextPos, which in compact storage writes a second position buffer
+// that the solver swaps in afterwards.
+
+#ifdef COMPACT_STORAGE
+#define PARTICLE_VEC uvec2
+#else
+#define PARTICLE_VEC vec4
+#endif
+
+layout(std430, binding = 0) buffer Pos { PARTICLE_VEC positions[]; };
+layout(std430, binding = 1) buffer Vel { PARTICLE_VEC velocities[]; };
+
+#ifdef COMPACT_STORAGE
+
+layout(std430, binding = 4) buffer Density { float densities[]; };
+layout(std430, binding = 5) buffer Pressures { float pressures[]; };
+
+const float FIXED_MAX = 2097151.0; // 2^21 - 1
+
+// x in bits 0-20 of the first word, y split over bits 21-31 and the second
+// word's bits 0-9, z in bits 10-30 of the second word
+PARTICLE_VEC packPosition(vec3 p) {
+    vec3 t = clamp((p - STORAGE_MIN) / (STORAGE_MAX - STORAGE_MIN), 0.0, 1.0);
+    uvec3 q = uvec3(round(t * FIXED_MAX));
+    return uvec2(q.x | (q.y << 21), (q.y >> 11) | (q.z << 10));
+}
+
+vec3 unpackPosition(PARTICLE_VEC w) {
+    uvec3 q = uvec3(w.x & 0x1FFFFFu, (w.x >> 21) | ((w.y & 0x3FFu) << 11), w.y >> 10);
+    return STORAGE_MIN + vec3(q) / FIXED_MAX * (STORAGE_MAX - STORAGE_MIN);
+}
+
+PARTICLE_VEC packVelocity(vec3 v) { return uvec2(packHalf2x16(v.xy), packHalf2x16(vec2(v.z, 0.0))); }
+vec3 unpackVelocity(PARTICLE_VEC w) { return vec3(unpackHalf2x16(w.x), unpackHalf2x16(w.y).x); }
+
+vec3 loadPos(uint i) { return unpackPosition(positions[i]); }
+vec3 loadVel(uint i) { return unpackVelocity(velocities[i]); }
+void storePos(uint i, vec3 p) { positions[i] = packPosition(p); }
+void storeVel(uint i, vec3 v) { velocities[i] = packVelocity(v); }
+
+layout(std430, binding = 3) writeonly buffer NextPos { PARTICLE_VEC nextPositions[]; };
+void storeNextPos(uint i, vec3 p) { nextPositions[i] = packPosition(p); }
+
+float loadDensity(uint i) { return densities[i]; }
+float loadPressure(uint i) { return pressures[i]; }
+void storeDensity(uint i, float d) { densities[i] = d; }
+void storePressure(uint i, float p) { pressures[i] = p; }
+
+#else
+
+// the stores leave .w alone, it belongs to the density and pressure
+vec3 loadPos(uint i) { return positions[i].xyz; }
+vec3 loadVel(uint i) { return velocities[i].xyz; }
+void storePos(uint i, vec3 p) { positions[i].xyz = p; }
+void storeVel(uint i, vec3 v) { velocities[i].xyz = v; }
+void storeNextPos(uint i, vec3 p) { storePos(i, p); }
+
+float loadDensity(uint i) { return positions[i].w; }
+float loadPressure(uint i) { return velocities[i].w; }
+void storeDensity(uint i, float d) { positions[i].w = d; }
+void storePressure(uint i, float p) { velocities[i].w = p; }
+
+#endif
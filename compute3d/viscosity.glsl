@@ -1,22 +1,32 @@
 #version 430
 
-layout(local_size_x = 64) in;
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+layout(local_size_x = LOCAL_SIZE_X) in;
 
-layout(std430, binding = 0) buffer Pos { vec4 positions[]; };
-layout(std430, binding = 1) buffer Vel { vec4 velocities[]; };
+#include "storage.glsl"
+layout(std430, binding = 7) buffer CellStart { uint cellStart[]; };
+layout(std430, binding = 8) buffer CellEnd { uint cellEnd[]; };
+layout(std430, binding = 9) buffer SortedIndices { uint sortedIndices[]; };
 
-uniform float viscosityStrength;
-uniform float smoothingRadius;
-uniform uint numParticles;
+#include "params.glsl"
 
-const float PI = 3.14159265359;
+// kernel constants, literals when the solver specializes this shader
+#ifndef KERNEL_H
+#define KERNEL_H        smoothingRadius
+#define VISCOSITY_COEFF viscosityCoeff
+#endif
 
 float viscosityKernel(float r, float h) {
     if (r >= h) return 0.0;
     
     float diff = h - r;
-    float coeff = 15.0 / (2.0 * PI * pow(h, 3.0)); // Poly6-style normalizing factor
-    return coeff * diff;
+    return VISCOSITY_COEFF * diff;
+}
+
+ivec3 cellCoord(vec3 p) {
+    return clamp(ivec3(floor((p - gridMin) / cellSize)), ivec3(0), gridDims - 1);
 }
 
 void main()
@@ -24,21 +34,32 @@ void main()
     uint i = gl_GlobalInvocationID.x;
     if (i >= numParticles) return;
 
-    vec3 xi = positions[i].xyz;
-    vec3 vi = velocities[i].xyz;
+    vec3 xi = loadPos(i);
+    vec3 vi = loadVel(i);
 
     vec3 viscosityForce = vec3(0.0);
 
-    for (uint j = 0; j < numParticles; j++) {
-        if (i == j) continue;
+    ivec3 ci = cellCoord(xi);
+
+    for (int dz = -1; dz <= 1; dz++)
+    for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++) {
+        ivec3 c = ci + ivec3(dx, dy, dz);
+        if (any(lessThan(c, ivec3(0))) || any(greaterThanEqual(c, gridDims))) continue;
+
+        uint cell = uint((c.z * gridDims.y + c.y) * gridDims.x + c.x);
+        for (uint k = cellStart[cell]; k < cellEnd[cell]; k++) {
+            uint j = sortedIndices[k];
+            if (i == j) continue;
 
-        vec3 xj = positions[j].xyz;
-        vec3 vj = velocities[j].xyz;
+            vec3 xj = loadPos(j);
+            vec3 vj = loadVel(j);
 
-        float dst = length(xi - xj);
-        float influence = viscosityKernel(dst, smoothingRadius);
-        viscosityForce += (vj - vi) * influence;
+            float dst = length(xi - xj);
+            float influence = viscosityKernel(dst, KERNEL_H);
+            viscosityForce += (vj - vi) * influence;
+        }
     }
 
-    velocities[i].xyz += viscosityStrength * viscosityForce;
+    storeVel(i, vi + viscosityStrength * viscosityForce);
 }
\ No newline at end of file
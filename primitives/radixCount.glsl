@@ -0,0 +1,28 @@
+#version 430
+
+// per-block histogram of one 4-bit digit, stored digit-major so a single
+// exclusive scan over it yields every block's scatter base
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 15) buffer Keys { uint keys[]; };
+layout(std430, binding = 17) buffer Histogram { uint histogram[]; };
+
+uniform uint count;
+uniform uint shift;
+uniform uint numBlocks;
+
+shared uint bins[16];
+
+void main()
+{
+    uint t = gl_LocalInvocationID.x;
+    uint i = gl_GlobalInvocationID.x;
+
+    if (t < 16) bins[t] = 0;
+    barrier();
+
+    if (i < count) atomicAdd(bins[(keys[i] >> shift) & 0xfu], 1u);
+    barrier();
+
+    if (t < 16) histogram[t * numBlocks + gl_WorkGroupID.x] = bins[t];
+}
@@ -0,0 +1,66 @@
+#version 430
+
+// stable scatter of one 256-element block, the rank of each key among the
+// keys with the same digit comes from a scan of per-digit flags packed as
+// 16-bit counters, eight digits per uvec4
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 15) buffer Keys { uint keys[]; };
+layout(std430, binding = 16) buffer Values { uint values[]; };
+layout(std430, binding = 17) buffer Histogram { uint histogram[]; };
+layout(std430, binding = 18) buffer KeysOut { uint keysOut[]; };
+layout(std430, binding = 19) buffer ValuesOut { uint valuesOut[]; };
+
+uniform uint count;
+uniform uint shift;
+uniform uint numBlocks;
+
+shared uvec4 flags[256];
+
+uvec4 digitFlag(uint digit) {
+    uvec4 f = uvec4(0);
+    f[(digit >> 1) & 3u] = 1u << ((digit & 1u) * 16u);
+    return f;
+}
+
+uint digitCount(uvec4 f, uint digit) {
+    return (f[(digit >> 1) & 3u] >> ((digit & 1u) * 16u)) & 0xffffu;
+}
+
+// exclusive rank of this invocation among the block's keys with the same digit,
+// counting only digits in [8 * upper, 8 * upper + 8)
+uint scanFlags(uint t, bool valid, uint digit, uint upper) {
+    bool mine = valid && (digit >> 3) == upper;
+    uvec4 f = mine ? digitFlag(digit) : uvec4(0);
+    flags[t] = f;
+    barrier();
+
+    for (uint offset = 1; offset < 256; offset <<= 1) {
+        uvec4 v = (t >= offset) ? flags[t - offset] : uvec4(0);
+        barrier();
+        flags[t] += v;
+        barrier();
+    }
+
+    uint rank = mine ? digitCount(flags[t] - f, digit) : 0;
+    barrier();
+    return rank;
+}
+
+void main()
+{
+    uint t = gl_LocalInvocationID.x;
+    uint i = gl_GlobalInvocationID.x;
+    bool valid = i < count;
+
+    uint key = valid ? keys[i] : 0;
+    uint value = valid ? values[i] : 0;
+    uint digit = (key >> shift) & 0xfu;
+
+    uint rank = scanFlags(t, valid, digit, 0u) + scanFlags(t, valid, digit, 1u);
+    if (!valid) return;
+
+    uint dst = histogram[digit * numBlocks + gl_WorkGroupID.x] + rank;
+    keysOut[dst] = key;
+    valuesOut[dst] = value;
+}
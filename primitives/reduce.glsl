@@ -0,0 +1,87 @@
+#version 430
+
+// two-level reduction: a grid-stride pass leaves one partial per workgroup,
+// then a single workgroup folds the partials into result[resultIndex]
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 12) buffer Input { float inputs[]; };
+layout(std430, binding = 12) buffer InputBits { uint inputBits[]; }; // same buffer, for packed halves
+layout(std430, binding = 13) buffer Partials { float partials[]; };
+layout(std430, binding = 14) buffer Result { float result[]; };
+
+const int OP_SUM = 0;
+const int OP_MIN = 1;
+const int OP_MAX = 2;
+const int OP_MAXABS = 3;
+const int OP_MAXLENGTH = 4;
+const int OP_MAXLENGTH_HALF = 5;
+
+uniform int op;
+uniform uint count;
+uniform uint stride;       // floats per element
+uniform uint offset;       // which float of the element
+uniform float center;      // OP_MAXABS reduces |x - center|
+uniform uint components;   // OP_MAXLENGTH reduces the length of this many floats
+                           // (half floats packed two per word for OP_MAXLENGTH_HALF)
+uniform int finalPass;
+uniform uint resultIndex;
+
+shared float temp[256];
+
+float identity() {
+    if (op == OP_MIN) return 3.402823466e+38;
+    if (op == OP_MAX) return -3.402823466e+38;
+    return 0.0;
+}
+
+float combine(float a, float b) {
+    if (op == OP_SUM) return a + b;
+    if (op == OP_MIN) return min(a, b);
+    return max(a, b);
+}
+
+void main()
+{
+    uint t = gl_LocalInvocationID.x;
+    float acc = identity();
+
+    if (finalPass == 1) {
+        for (uint i = t; i < count; i += 256)
+            acc = combine(acc, partials[i]);
+    } else {
+        uint step = gl_NumWorkGroups.x * 256;
+        for (uint i = gl_GlobalInvocationID.x; i < count; i += step) {
+            float x = inputs[i * stride + offset];
+            if (op == OP_MAXABS) x = abs(x - center);
+            if (op == OP_MAXLENGTH) {
+                float sq = 0.0;
+                for (uint c = 0; c < components; c++) {
+                    float v = inputs[i * stride + offset + c];
+                    sq += v * v;
+                }
+                x = sqrt(sq);
+            }
+            if (op == OP_MAXLENGTH_HALF) {
+                float sq = 0.0;
+                for (uint c = 0; c < components; c++) {
+                    float v = unpackHalf2x16(inputBits[i * stride + offset + c / 2])[c % 2];
+                    sq += v * v;
+                }
+                x = sqrt(sq);
+            }
+            acc = combine(acc, x);
+        }
+    }
+
+    temp[t] = acc;
+    barrier();
+
+    for (uint s = 128; s > 0; s >>= 1) {
+        if (t < s) temp[t] = combine(temp[t], temp[t + s]);
+        barrier();
+    }
+
+    if (t != 0) return;
+    if (finalPass == 1) result[resultIndex] = temp[0];
+    else partials[gl_WorkGroupID.x] = temp[0];
+}
@@ -0,0 +1,16 @@
+#version 430
+
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 13) buffer Output { uint outputs[]; };
+layout(std430, binding = 14) buffer BlockOffsets { uint blockOffsets[]; };
+
+uniform uint count;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= count) return;
+
+    outputs[i] += blockOffsets[gl_WorkGroupID.x];
+}
@@ -0,0 +1,34 @@
+#version 430
+
+// exclusive scan of one 256-element block per workgroup, the block total
+// goes to blockSums so the next level can offset the blocks
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 12) buffer Input { uint inputs[]; };
+layout(std430, binding = 13) buffer Output { uint outputs[]; };
+layout(std430, binding = 14) buffer BlockSums { uint blockSums[]; };
+
+uniform uint count;
+
+shared uint temp[256];
+
+void main()
+{
+    uint t = gl_LocalInvocationID.x;
+    uint i = gl_GlobalInvocationID.x;
+
+    uint value = (i < count) ? inputs[i] : 0;
+    temp[t] = value;
+    barrier();
+
+    // Hillis-Steele inclusive scan
+    for (uint offset = 1; offset < 256; offset <<= 1) {
+        uint v = (t >= offset) ? temp[t - offset] : 0;
+        barrier();
+        temp[t] += v;
+        barrier();
+    }
+
+    if (i < count) outputs[i] = temp[t] - value;
+    if (t == 255) blockSums[gl_WorkGroupID.x] = temp[255];
+}
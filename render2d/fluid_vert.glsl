@@ -2,6 +2,7 @@
 
 layout(std430, binding = 0) buffer PosBuffer { vec2 positions[]; };
 layout(std430, binding = 1) buffer VelBuffer { vec2 velocities[]; };
+layout(std430, binding = 2) buffer SlotBuffer { uint particleSlots[]; };
 
 uniform mat4 uProjection;
 
@@ -9,8 +10,10 @@ out vec2 fragVel;
 
 void main()
 {
-    vec2 pos = positions[gl_VertexID];
-    vec2 vel = velocities[gl_VertexID];
+    // vertex id is the stable particle id, look up where it is stored now
+    uint slot = particleSlots[gl_VertexID];
+    vec2 pos = positions[slot];
+    vec2 vel = velocities[slot];
 
     gl_Position = uProjection * vec4(pos, 0.0, 1.0);
     gl_PointSize = 6.0;
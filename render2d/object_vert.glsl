@@ -3,8 +3,9 @@
 layout(location = 0) in vec2 aPos;
 
 uniform mat4 uProjection;
+uniform mat4 uModel;
 
 void main()
 {
-    gl_Position = uProjection * vec4(aPos, 0.0, 1.0);
+    gl_Position = uProjection * uModel * vec4(aPos, 0.0, 1.0);
 }
@@ -0,0 +1,25 @@
+#version 430 core
+
+in vec3 rayDir;
+flat in vec3 sphereCenter;
+flat in vec3 color;
+out vec4 FragColor;
+
+uniform mat4 projection;
+
+const float radius = 0.02;
+
+void main() {
+    // nearest hit of the eye ray with the sphere, all in view space
+    vec3 dir = normalize(rayDir);
+    float b = dot(dir, sphereCenter);
+    float c = dot(sphereCenter, sphereCenter) - radius * radius;
+    float disc = b * b - c;
+    if (disc < 0.0) discard;
+    vec3 hit = (b - sqrt(disc)) * dir;
+
+    vec4 clip = projection * vec4(hit, 1.0);
+    gl_FragDepth = 0.5 * (clip.z / clip.w) + 0.5;
+
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,40 @@
+#version 430 core
+
+// one camera-facing quad per particle (a 4 vertex strip per instance), just
+// big enough to cover the sphere's silhouette under perspective.
+// impostor_frag.glsl ray casts the sphere inside it.
+#include "../compute3d/storage.glsl" // particle positions
+
+uniform mat4 view;
+uniform mat4 projection;
+
+const float radius = 0.02;
+
+out vec3 rayDir;            // view space, from the eye through the quad
+flat out vec3 sphereCenter; // view space
+flat out vec3 color;
+
+void main() {
+    uint i = uint(gl_InstanceID);
+    vec3 center = (view * vec4(loadPos(i), 1.0)).xyz;
+
+    // the cone from the eye tangent to the sphere cuts the plane through the
+    // center at radius r * d / sqrt(d^2 - r^2)
+    float d = length(center);
+    vec3 axis = center / d;
+    vec3 side = normalize(cross(axis, abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 top = cross(side, axis);
+    float extent = radius * d / sqrt(max(d * d - radius * radius, 1e-8));
+
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec3 viewPos = center + extent * (corner.x * side + corner.y * top);
+
+    rayDir = viewPos;
+    sphereCenter = center;
+
+    // speed color once per particle instead of once per fragment
+    float speedNormalized = clamp(length(loadVel(i)) / 6.0, 0.0, 1.0);
+    color = mix(vec3(0.1, 0.2, 1.0), vec3(0.5, 0.8, 1.0), speedNormalized);
+
+    gl_Position = projection * vec4(viewPos, 1.0);
+}
@@ -4,13 +4,13 @@ in vec3 fragWorldPos;
 flat in int fragIndex;
 out vec4 FragColor;
 
-layout(std430, binding = 1) buffer Vel { vec4 velocities[]; };
+#include "../compute3d/storage.glsl"
 
 uniform vec3 cameraPos;
 uniform vec3 lightPos;
 
 void main() {
-    vec3 velocity = velocities[fragIndex].xyz;
+    vec3 velocity = loadVel(uint(fragIndex));
     float speed = length(velocity);
 
     float speedNormalized = clamp(speed / 6.0, 0.0, 1.0); // Adjust divisor for your scale
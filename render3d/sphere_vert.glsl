@@ -1,7 +1,7 @@
 #version 430 core
 
 layout(location = 0) in vec3 vertexPosition; // vertex of the sphere mesh
-layout(std430, binding = 0) buffer Pos { vec4 positions[]; }; // position of particle
+#include "../compute3d/storage.glsl" // particle positions
 
 uniform mat4 model;
 uniform mat4 view;
@@ -11,7 +11,7 @@ out vec3 fragWorldPos;
 flat out int fragIndex;
 
 void main() {
-    vec3 sphereCenter = positions[gl_InstanceID].xyz;
+    vec3 sphereCenter = loadPos(uint(gl_InstanceID));
     float radius = 0.02;
 
     // Transform vertex into world space